@@ -0,0 +1,29 @@
+#!/bin/bash
+# Scales an image with the float and the FIXED_POINT build and checks that no
+# channel differs by more than max_diff. The float build snaps weights below
+# 1% to 0 and the fixed point build only those below 1/256, which differs by
+# up to 5 at full contrast edges.
+# Usage: ./compare_fixed_point.sh <input_path> <target_width> <target_height> [max_diff]
+set -e
+
+input_path=$(realpath "$1")
+file_name=$(basename "$input_path")
+output_path="$(dirname "$input_path")/${file_name%%.*}_output.png"
+
+# Both builds go to a temporary directory, removed on exit.
+source_dir=$(dirname "$(realpath "$0")")
+build_dir=$(mktemp -d)
+trap 'rm -rf "$build_dir"' EXIT
+
+cmake -S "$source_dir" -B "$build_dir/float" -DUSE_FIXED_POINT=OFF
+cmake --build "$build_dir/float"
+cmake -S "$source_dir" -B "$build_dir/fixed" -DUSE_FIXED_POINT=ON
+cmake --build "$build_dir/fixed"
+
+"$build_dir/float/pixel_aa" "$input_path" "$2" "$3"
+mv "$output_path" "$build_dir/float/output.png"
+"$build_dir/fixed/pixel_aa" "$input_path" "$2" "$3"
+mv "$output_path" "$build_dir/fixed/output.png"
+
+"$build_dir/float/image_diff" "$build_dir/float/output.png" \
+    "$build_dir/fixed/output.png" "${4:-6}"
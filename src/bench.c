@@ -0,0 +1,828 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
+
+#include "pixel_aa.h"
+#include "pixel_aa_internal.h"
+
+// Benchmark for pixel_aa_scale(). Sweeps a matrix of sizes, kernel sets and
+// scaling modes, times every frame individually and reports ns/frame,
+// Mpixel/s and the min/median/p99 frame times, optionally with hardware
+// counters. Results can be written as JSON to compare them across commits.
+
+typedef struct {
+    int in_width;
+    int in_height;
+    int out_width;
+    int out_height;
+} BenchSize;
+
+// Where frames are read from and written to.
+typedef struct {
+    // Pixels of padding around the input, which is scaled as a
+    // sub-rectangle like an emulator frame with overscan.
+    int overscan;
+    // If set, frames are written into this file, mapped shared like a
+    // framebuffer, with rows padded to FB_PITCH_ALIGN bytes.
+    const char* fb_path;
+    // Incremental mode: Every frame changes a SPRITE_SIZE square of the
+    // input, like a sprite moving over a static background.
+    int incremental;
+    // Streaming mode: Input rows are pushed one at a time and output rows
+    // are copied out from the callback.
+    int stream;
+} BenchBuffers;
+
+// Destination of the rows emitted in streaming mode.
+typedef struct {
+    uint8_t* out;
+    int out_stride;
+    int row_bytes;
+} StreamSink;
+
+#define SPRITE_SIZE 16
+
+// Pitch alignment of DRM dumb buffers on common drivers
+#define FB_PITCH_ALIGN 64
+
+// Common handheld resolutions to VGA, plus larger and non-integer ratios.
+static const BenchSize default_sizes[] = {
+    {160, 144, 640, 480},   {240, 160, 640, 480},  {256, 224, 640, 480},
+    {320, 240, 640, 480},   {256, 224, 1280, 960}, {256, 224, 1920, 1080},
+    {320, 240, 1920, 1080}, {256, 224, 300, 300},
+};
+
+// Indexed by PixelAAFormat
+static const char* const format_names[] = {
+    "xrgb8888",
+    "bgra8888",
+    "rgba8888",
+    "rgb565",
+    "index8",
+};
+
+// Returns 0 if `name` is a format, see format_names.
+static int parse_format(const char* name, PixelAAFormat* format) {
+    for (int i = 0; i < (int)(sizeof(format_names) / sizeof(format_names[0]));
+         ++i) {
+        if (strcmp(name, format_names[i]) == 0) {
+            *format = (PixelAAFormat)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Hardware counters, in the order they're read from the group.
+enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_CACHE_MISSES,
+    COUNTER_BRANCH_MISSES,
+    NUM_COUNTERS,
+};
+
+static const char* const counter_names[NUM_COUNTERS] = {
+    "cycles",
+    "instructions",
+    "cache_misses",
+    "branch_misses",
+};
+
+typedef struct {
+    BenchSize size;
+    const char* kernels;
+    const char* mode;
+    PixelAAFormat in_format;
+    PixelAAFormat out_format;
+    int num_threads;
+    int num_frames;
+    double min_ns;
+    double median_ns;
+    double p99_ns;
+    double mean_ns;
+    double mpixels_per_s;
+    int have_counters;
+    // Per frame
+    double counters[NUM_COUNTERS];
+} BenchResult;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_int64(const void* a, const void* b) {
+    const int64_t x = *(const int64_t*)a;
+    const int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+#ifdef __linux__
+// Opens the counters as one group on the calling thread. Returns the group
+// leader, or -1 if the counters aren't available (e.g. because of
+// perf_event_paranoid). Only the calling thread is counted, so with threads
+// the numbers cover the share of the main thread.
+static int open_counters(int* fds) {
+    static const uint64_t configs[NUM_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    int leader = -1;
+    for (int i = 0; i < NUM_COUNTERS; ++i) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.disabled = leader < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+        if (fds[i] < 0) {
+            for (int j = 0; j < i; ++j) {
+                close(fds[j]);
+            }
+            return -1;
+        }
+        if (leader < 0) {
+            leader = fds[i];
+        }
+    }
+    return leader;
+}
+
+static void close_counters(int* fds) {
+    for (int i = 0; i < NUM_COUNTERS; ++i) {
+        close(fds[i]);
+    }
+}
+#endif  // __linux__
+
+// Gives INDEX8 contexts a palette of 256 random colors.
+static void set_random_palette(PixelAAContext* ctx) {
+    if (ctx->in_format != PIXEL_AA_FORMAT_INDEX8) {
+        return;
+    }
+    uint32_t colors[256];
+    uint32_t state = 54321;
+    for (int i = 0; i < 256; ++i) {
+        state = state * 1664525u + 1013904223u;
+        colors[i] = (state >> 8) | 0xFF000000u;
+    }
+    pixel_aa_set_palette(ctx, colors, 256);
+}
+
+// Output buffer of `size` bytes, mapped from `fb_path` if set. Returns NULL
+// on failure.
+static void* alloc_output(const char* fb_path, size_t size) {
+    if (!fb_path) {
+        return malloc(size);
+    }
+#ifdef __linux__
+    const int fd = open(fb_path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    void* fb = ftruncate(fd, (off_t)size) == 0
+                   ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                          0)
+                   : MAP_FAILED;
+    // The mapping keeps the file open.
+    close(fd);
+    return fb != MAP_FAILED ? fb : NULL;
+#else   // !__linux__
+    return NULL;
+#endif  // __linux__
+}
+
+static void free_output(const char* fb_path, void* out, size_t size) {
+    if (!fb_path) {
+        free(out);
+        return;
+    }
+#ifdef __linux__
+    if (out) {
+        munmap(out, size);
+    }
+#else   // !__linux__
+    (void)size;
+#endif  // __linux__
+}
+
+static void emit_row(void* user, int y, const void* row) {
+    StreamSink* sink = (StreamSink*)user;
+    memcpy(sink->out + (size_t)y * sink->out_stride, row, sink->row_bytes);
+}
+
+// Scales one frame, through the stream if there is one.
+static void scale_frame(PixelAAContext* ctx, PixelAAStream* stream,
+                        const uint8_t* in, int overscan, int in_stride,
+                        void* out, int out_stride) {
+    if (!stream) {
+        pixel_aa_scale_rect(ctx, in, overscan, overscan, in_stride, out,
+                            out_stride);
+        return;
+    }
+    const int bytes = pixel_aa_bytes_per_pixel(ctx->in_format);
+    for (int y = 0; y < ctx->in_height; ++y) {
+        pixel_aa_stream_push_row(stream,
+                                 in + (size_t)(y + overscan) * in_stride +
+                                     (size_t)overscan * bytes);
+    }
+}
+
+// Returned by the benchmarks when a buffer can't be allocated, as opposed
+// to -1 for configurations the scaler doesn't support.
+#define BENCH_OUT_OF_MEMORY -2
+
+// Creates a context with the given kernels, picked through the
+// PIXEL_AA_KERNELS override like a user would. Returns NULL if the
+// configuration isn't supported.
+static PixelAAContext* create_context(const BenchSize* size,
+                                      const PixelAAKernels* kernels,
+                                      const PixelAAOptions* options) {
+    setenv("PIXEL_AA_KERNELS", kernels->name, 1);
+    PixelAAContext* ctx = pixel_aa_create_with_options(
+        size->in_width, size->in_height, size->out_width, size->out_height,
+        options);
+    if (ctx && strcmp(pixel_aa_get_kernels_name(ctx), kernels->name) != 0) {
+        pixel_aa_destroy(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+// Runs `num_frames` timed frames after a few warmup frames. Returns 0 on
+// success, -1 if the configuration isn't supported or BENCH_OUT_OF_MEMORY.
+static int run_bench(const BenchSize* size, const PixelAAKernels* kernels,
+                     const PixelAAOptions* base_options,
+                     const BenchBuffers* buffers, int separable,
+                     int num_frames, int use_counters, BenchResult* result) {
+    PixelAAOptions options = *base_options;
+    options.separable = separable;
+    options.incremental = buffers->incremental;
+    PixelAAContext* ctx = create_context(size, kernels, &options);
+    const int overscan = buffers->overscan;
+    const int in_stride = (size->in_width + 2 * overscan) *
+                          pixel_aa_bytes_per_pixel(options.in_format);
+    const size_t in_bytes =
+        (size_t)in_stride * (size->in_height + 2 * overscan);
+    const size_t out_size = (size_t)size->out_width * size->out_height;
+    int out_stride =
+        size->out_width * pixel_aa_bytes_per_pixel(options.out_format);
+    if (buffers->fb_path) {
+        out_stride = (out_stride + FB_PITCH_ALIGN - 1) & ~(FB_PITCH_ALIGN - 1);
+    }
+    const size_t out_bytes = (size_t)out_stride * size->out_height;
+    uint8_t* in = (uint8_t*)malloc(in_bytes);
+    void* out = alloc_output(buffers->fb_path, out_bytes);
+    int64_t* frame_ns = (int64_t*)malloc(num_frames * sizeof(int64_t));
+    if (!ctx || !in || !out || !frame_ns) {
+        pixel_aa_destroy(ctx);
+        free(in);
+        free_output(buffers->fb_path, out, out_bytes);
+        free(frame_ns);
+        // An mmap failure of the framebuffer counts as out of memory, too.
+        return ctx ? BENCH_OUT_OF_MEMORY : -1;
+    }
+    set_random_palette(ctx);
+    StreamSink sink = {(uint8_t*)out, out_stride,
+                       size->out_width *
+                           pixel_aa_bytes_per_pixel(options.out_format)};
+    PixelAAStream* stream = NULL;
+    if (buffers->stream) {
+        stream = pixel_aa_stream_create(ctx, emit_row, &sink);
+        if (!stream) {
+            pixel_aa_destroy(ctx);
+            free(in);
+            free_output(buffers->fb_path, out, out_bytes);
+            free(frame_ns);
+            return -1;
+        }
+    }
+
+    // Deterministic noise, so that no row or column is trivially uniform.
+    uint32_t state = 12345;
+    for (size_t i = 0; i < in_bytes; ++i) {
+        state = state * 1664525u + 1013904223u;
+        in[i] = (uint8_t)(state >> 24);
+    }
+
+    const int num_warmup_frames = 10;
+    for (int frame = 0; frame < num_warmup_frames; ++frame) {
+        scale_frame(ctx, stream, in, overscan, in_stride, out, out_stride);
+    }
+
+    result->have_counters = 0;
+#ifdef __linux__
+    int fds[NUM_COUNTERS];
+    const int leader = use_counters ? open_counters(fds) : -1;
+    if (leader >= 0) {
+        ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif  // __linux__
+
+    for (int frame = 0; frame < num_frames; ++frame) {
+        if (buffers->incremental) {
+            // Not timed, changing the input is the caller's work.
+            // The sprite is clipped to inputs smaller than it.
+            const int bytes = pixel_aa_bytes_per_pixel(options.in_format);
+            const int sprite_width = size->in_width < SPRITE_SIZE
+                                         ? size->in_width
+                                         : SPRITE_SIZE;
+            const int sprite_height = size->in_height < SPRITE_SIZE
+                                          ? size->in_height
+                                          : SPRITE_SIZE;
+            const int x0 = frame * 3 % (size->in_width - sprite_width + 1);
+            const int y0 = frame % (size->in_height - sprite_height + 1);
+            for (int y = y0; y < y0 + sprite_height; ++y) {
+                uint8_t* row = in + (size_t)(y + overscan) * in_stride +
+                               (size_t)(x0 + overscan) * bytes;
+                for (int i = 0; i < sprite_width * bytes; ++i) {
+                    row[i] ^= (uint8_t)(frame | 1);
+                }
+            }
+        }
+        const int64_t start = now_ns();
+        scale_frame(ctx, stream, in, overscan, in_stride, out, out_stride);
+        frame_ns[frame] = now_ns() - start;
+    }
+
+#ifdef __linux__
+    if (leader >= 0) {
+        ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        uint64_t values[1 + NUM_COUNTERS];
+        if (read(leader, values, sizeof(values)) == sizeof(values) &&
+            values[0] == NUM_COUNTERS) {
+            for (int i = 0; i < NUM_COUNTERS; ++i) {
+                result->counters[i] = (double)values[1 + i] / num_frames;
+            }
+            result->have_counters = 1;
+        }
+        close_counters(fds);
+    }
+#else   // !__linux__
+    (void)use_counters;
+#endif  // __linux__
+
+    int64_t total_ns = 0;
+    for (int frame = 0; frame < num_frames; ++frame) {
+        total_ns += frame_ns[frame];
+    }
+    qsort(frame_ns, num_frames, sizeof(int64_t), compare_int64);
+
+    result->size = *size;
+    result->kernels = kernels->name;
+    if (buffers->stream) {
+        result->mode = separable ? "separable+stream" : "direct+stream";
+    } else if (buffers->incremental) {
+        result->mode = separable ? "separable+inc" : "direct+inc";
+    } else {
+        result->mode = separable ? "separable" : "direct";
+    }
+    result->in_format = options.in_format;
+    result->out_format = options.out_format;
+    result->num_threads = ctx->num_threads;
+    result->num_frames = num_frames;
+    result->min_ns = (double)frame_ns[0];
+    result->median_ns = (double)frame_ns[num_frames / 2];
+    result->p99_ns = (double)frame_ns[(num_frames - 1) * 99 / 100];
+    result->mean_ns = (double)total_ns / num_frames;
+    result->mpixels_per_s = result->median_ns > 0.0
+                                ? (double)out_size * 1000.0 / result->median_ns
+                                : 0.0;
+
+    pixel_aa_stream_destroy(stream);
+    pixel_aa_destroy(ctx);
+    free(in);
+    free_output(buffers->fb_path, out, out_bytes);
+    free(frame_ns);
+    return 0;
+}
+
+typedef struct {
+    PixelAAPipeline* pipeline;
+    size_t out_bytes;
+    uint32_t checksum;
+} PipelineConsumer;
+
+// Consumer side of the pipeline benchmark. "Presents" every completed frame
+// by summing it up, which touches it once like a copy to the screen would.
+// Returns the number of frames.
+static int consume_frames(PipelineConsumer* consumer) {
+    int num_frames = 0;
+    const void* out;
+    while ((out = pixel_aa_pipeline_complete(consumer->pipeline)) != NULL) {
+        for (size_t i = 0; i < consumer->out_bytes / 4; ++i) {
+            consumer->checksum += ((const uint32_t*)out)[i];
+        }
+        pixel_aa_pipeline_release(consumer->pipeline);
+        ++num_frames;
+    }
+    return num_frames;
+}
+
+#ifdef USE_THREADS
+static void* consumer_main(void* arg) {
+    consume_frames((PipelineConsumer*)arg);
+    return NULL;
+}
+#endif  // USE_THREADS
+
+// Runs `num_frames` frames through a pipeline of `depth` slots. The calling
+// thread converts a packed RGB frame into every input buffer, in the input
+// format, a second thread consumes the output. Returns 0 on success.
+static int run_pipeline_bench(const BenchSize* size,
+                              const PixelAAOptions* options, int depth,
+                              int num_frames, FILE* f) {
+    PixelAAContext* ctx = pixel_aa_create_with_options(
+        size->in_width, size->in_height, size->out_width, size->out_height,
+        options);
+    PixelAAPipeline* pipeline = ctx ? pixel_aa_pipeline_create(ctx, depth)
+                                    : NULL;
+    const size_t in_size = (size_t)size->in_width * size->in_height;
+    uint8_t* rgb = pipeline ? (uint8_t*)malloc(in_size * 3) : NULL;
+    if (!pipeline || !rgb) {
+        pixel_aa_pipeline_destroy(pipeline);
+        pixel_aa_destroy(ctx);
+        free(rgb);
+        return pipeline ? BENCH_OUT_OF_MEMORY : -1;
+    }
+    set_random_palette(ctx);
+    uint32_t state = 12345;
+    for (size_t i = 0; i < in_size * 3; ++i) {
+        state = state * 1664525u + 1013904223u;
+        rgb[i] = (uint8_t)(state >> 24);
+    }
+
+    PipelineConsumer consumer = {
+        pipeline,
+        (size_t)size->out_width * size->out_height *
+            pixel_aa_bytes_per_pixel(options->out_format),
+        0};
+#ifdef USE_THREADS
+    pthread_t consumer_thread;
+    pthread_create(&consumer_thread, NULL, consumer_main, &consumer);
+#endif  // USE_THREADS
+    const int64_t start = now_ns();
+    for (int frame = 0; frame < num_frames; ++frame) {
+        void* in = pixel_aa_pipeline_acquire_input(pipeline);
+        for (size_t i = 0; i < in_size; ++i) {
+            if (ctx->in_layout == LAYOUT_INDEX8) {
+                ((uint8_t*)in)[i] = rgb[i * 3];
+            } else {
+                store_pixel(in, (int)i,
+                            0xFF000000u | (uint32_t)rgb[i * 3] << 16 |
+                                (uint32_t)rgb[i * 3 + 1] << 8 | rgb[i * 3 + 2],
+                            ctx->in_layout);
+            }
+        }
+        pixel_aa_pipeline_submit(pipeline);
+#ifndef USE_THREADS
+        consume_frames(&consumer);
+#endif  // USE_THREADS
+    }
+    pixel_aa_pipeline_finish(pipeline);
+#ifdef USE_THREADS
+    pthread_join(consumer_thread, NULL);
+#endif  // USE_THREADS
+    const double total_ms = (now_ns() - start) * 1.0e-6;
+
+    PixelAAPipelineStats stats;
+    pixel_aa_pipeline_get_stats(pipeline, &stats);
+    char sizes[64];
+    snprintf(sizes, sizeof(sizes), "%dx%d->%dx%d", size->in_width,
+             size->in_height, size->out_width, size->out_height);
+    fprintf(f,
+            "%-22s %5d %8.1f %8.3f %8.3f %8.3f %8.3f %9.1f %9.1f %9.1f "
+            "%8.1f\n",
+            sizes, depth, stats.frames_per_s, stats.scale_ms_mean,
+            stats.scale_ms_max, stats.latency_ms_mean, stats.latency_ms_max,
+            stats.input_stall_ms, stats.scaler_idle_ms, stats.output_stall_ms,
+            total_ms);
+    fflush(f);
+
+    pixel_aa_pipeline_destroy(pipeline);
+    pixel_aa_destroy(ctx);
+    free(rgb);
+    return 0;
+}
+
+static void print_result(FILE* f, const BenchResult* r) {
+    char sizes[64];
+    snprintf(sizes, sizeof(sizes), "%dx%d->%dx%d", r->size.in_width,
+             r->size.in_height, r->size.out_width, r->size.out_height);
+    fprintf(f, "%-22s %-7s %-16s %11.0f %9.1f %11.0f %11.0f", sizes,
+            r->kernels, r->mode, r->median_ns, r->mpixels_per_s, r->min_ns,
+            r->p99_ns);
+    if (r->have_counters) {
+        fprintf(f, " %12.0f %12.0f %10.0f %10.0f",
+                r->counters[COUNTER_CYCLES],
+                r->counters[COUNTER_INSTRUCTIONS],
+                r->counters[COUNTER_CACHE_MISSES],
+                r->counters[COUNTER_BRANCH_MISSES]);
+    }
+    fprintf(f, "\n");
+    fflush(f);
+}
+
+static void write_json(FILE* f, const BenchResult* results,
+                       int num_results) {
+    fprintf(f, "{\n");
+#ifdef FIXED_POINT
+    fprintf(f, "  \"fixed_point\": true,\n");
+#else   // !FIXED_POINT
+    fprintf(f, "  \"fixed_point\": false,\n");
+#endif  // FIXED_POINT
+    fprintf(f, "  \"results\": [\n");
+    for (int i = 0; i < num_results; ++i) {
+        const BenchResult* r = &results[i];
+        fprintf(f,
+                "    {\"input\": \"%dx%d\", \"output\": \"%dx%d\", "
+                "\"kernels\": \"%s\", \"mode\": \"%s\", "
+                "\"in_format\": \"%s\", \"out_format\": \"%s\", "
+                "\"threads\": %d, \"frames\": %d, "
+                "\"ns_per_frame\": %.0f, \"mpixels_per_s\": %.3f, "
+                "\"min_ns\": %.0f, \"median_ns\": %.0f, \"p99_ns\": %.0f, "
+                "\"mean_ns\": %.0f",
+                r->size.in_width, r->size.in_height, r->size.out_width,
+                r->size.out_height, r->kernels, r->mode,
+                format_names[r->in_format], format_names[r->out_format],
+                r->num_threads, r->num_frames,
+                r->median_ns, r->mpixels_per_s, r->min_ns, r->median_ns,
+                r->p99_ns, r->mean_ns);
+        if (r->have_counters) {
+            fprintf(f, ", \"counters\": {");
+            for (int c = 0; c < NUM_COUNTERS; ++c) {
+                fprintf(f, "%s\"%s\": %.0f", c > 0 ? ", " : "",
+                        counter_names[c], r->counters[c]);
+            }
+            fprintf(f, "}");
+        }
+        fprintf(f, "}%s\n", i + 1 < num_results ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+int main(int argc, char* argv[]) {
+    int num_frames = 200;
+    int use_counters = 0;
+    const char* json_path = NULL;
+    const char* only_kernels = NULL;
+    BenchSize* sizes = NULL;
+    int num_sizes = 0;
+    PixelAAOptions options;
+    pixel_aa_default_options(&options);
+    int cpus[64];
+    int pipeline_depth = 0;
+    BenchBuffers buffers = {0, NULL, 0};
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            num_frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            use_counters = 1;
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--kernels") == 0 && i + 1 < argc) {
+            only_kernels = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options.num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            pipeline_depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            // <in>[:<out>], the output format defaults to the input format,
+            // or XRGB8888 for INDEX8
+            char* in_name = strtok(argv[++i], ":");
+            char* out_name = strtok(NULL, ":");
+            if (!in_name || parse_format(in_name, &options.in_format) != 0) {
+                printf("Invalid format: %s\n", argv[i]);
+                free(sizes);
+                return 1;
+            }
+            options.out_format =
+                options.in_format == PIXEL_AA_FORMAT_INDEX8
+                    ? PIXEL_AA_FORMAT_XRGB8888
+                    : options.in_format;
+            if (out_name && parse_format(out_name, &options.out_format) != 0) {
+                printf("Invalid format: %s\n", argv[i]);
+                free(sizes);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--overscan") == 0 && i + 1 < argc) {
+            buffers.overscan = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--incremental") == 0) {
+            buffers.incremental = 1;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            buffers.stream = 1;
+        } else if (strcmp(argv[i], "--fb") == 0 && i + 1 < argc) {
+            buffers.fb_path = argv[++i];
+        } else if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc) {
+            options.tile_width = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cpus") == 0 && i + 1 < argc) {
+            // Comma separated, one per worker thread
+            int num_cpus = 0;
+            for (char* cpu = strtok(argv[++i], ","); cpu && num_cpus < 64;
+                 cpu = strtok(NULL, ",")) {
+                cpus[num_cpus++] = atoi(cpu);
+            }
+            options.cpus = cpus;
+            if (options.num_threads == 0) {
+                options.num_threads = num_cpus + 1;
+            }
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            BenchSize size;
+            if (sscanf(argv[++i], "%dx%d:%dx%d", &size.in_width,
+                       &size.in_height, &size.out_width,
+                       &size.out_height) != 4) {
+                printf("Invalid size: %s\n", argv[i]);
+                free(sizes);
+                return 1;
+            }
+            BenchSize* new_sizes = (BenchSize*)realloc(
+                sizes, (num_sizes + 1) * sizeof(BenchSize));
+            if (!new_sizes) {
+                printf("Failed to allocate the sizes.\n");
+                free(sizes);
+                return 1;
+            }
+            sizes = new_sizes;
+            sizes[num_sizes++] = size;
+        } else {
+            printf(
+                "Usage: %s [options]\n"
+                "Options:\n"
+                "  --size <w>x<h>:<w>x<h>  Input and output size, may be "
+                "repeated. Default: a matrix of common sizes\n"
+                "  --kernels <name>        Only run one kernel set, e.g. "
+                "scalar\n"
+                "  --frames <n>            Timed frames per configuration "
+                "(default 200)\n"
+                "  --threads <n>           Threads including the main "
+                "thread, 0 for one per CPU\n"
+                "  --cpus <a,b,...>        Pin the worker threads to these "
+                "CPUs\n"
+                "  --tile <width>          Tile width, 0 to pick one "
+                "(default)\n"
+                "  --format <in>[:<out>]   Pixel formats: xrgb8888 "
+                "(default), bgra8888, rgba8888,\n"
+                "                          rgb565, index8 (input only)\n"
+                "  --overscan <n>          Scale the input as the inner "
+                "rectangle of a frame with n\n"
+                "                          pixels of padding on each side\n"
+                "  --fb <path>             Write the output into this file, "
+                "mapped like a\n"
+                "                          framebuffer with 64 byte aligned "
+                "rows\n"
+                "  --incremental           Only rescale what changed, with "
+                "a moving 16x16 sprite\n"
+                "                          on a static input\n"
+                "  --stream                Push the input row by row "
+                "through a stream\n"
+                "  --pipeline <depth>      Run the frames through a "
+                "pipeline with this many slots\n"
+                "                          and report its stats instead\n"
+                "  --perf                  Read hardware counters with "
+                "perf_event_open\n"
+                "  --json <path>           Write the results as JSON, - for "
+                "stdout\n",
+                argv[0]);
+            free(sizes);
+            return 1;
+        }
+    }
+    if (num_frames < 1) {
+        num_frames = 1;
+    }
+    if (!sizes) {
+        num_sizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+        sizes = (BenchSize*)malloc(sizeof(default_sizes));
+        if (!sizes) {
+            printf("Failed to allocate the sizes.\n");
+            return 1;
+        }
+        memcpy(sizes, default_sizes, sizeof(default_sizes));
+    }
+
+    if (pipeline_depth > 0) {
+        printf("%-22s %5s %8s %8s %8s %8s %8s %9s %9s %9s %8s\n", "size",
+               "depth", "frames/s", "scale", "max", "latency", "max",
+               "in stall", "idle", "out stall", "total");
+        for (int s = 0; s < num_sizes; ++s) {
+            const int status = run_pipeline_bench(
+                &sizes[s], &options, pipeline_depth, num_frames, stdout);
+            if (status == BENCH_OUT_OF_MEMORY) {
+                fprintf(stderr, "Out of memory at %dx%d->%dx%d\n",
+                        sizes[s].in_width, sizes[s].in_height,
+                        sizes[s].out_width, sizes[s].out_height);
+                free(sizes);
+                return 1;
+            }
+            if (status != 0) {
+                fprintf(stderr, "Skipping unsupported size %dx%d->%dx%d\n",
+                        sizes[s].in_width, sizes[s].in_height,
+                        sizes[s].out_width, sizes[s].out_height);
+            }
+        }
+        printf("Times in ms.\n");
+        free(sizes);
+        return 0;
+    }
+
+    const int num_kernel_sets = pixel_aa_num_kernel_sets;
+    BenchResult* results = (BenchResult*)malloc(
+        (size_t)num_sizes * num_kernel_sets * 2 * sizeof(BenchResult));
+    if (!results) {
+        printf("Failed to allocate the results.\n");
+        free(sizes);
+        return 1;
+    }
+    int num_results = 0;
+
+    // Keep stdout clean when it receives the JSON.
+    FILE* table = json_path && strcmp(json_path, "-") == 0 ? stderr : stdout;
+    fprintf(table, "%-22s %-7s %-16s %11s %9s %11s %11s", "size", "kernels",
+            "mode", "ns/frame", "Mpix/s", "min ns", "p99 ns");
+    if (use_counters) {
+        fprintf(table, " %12s %12s %10s %10s", "cycles", "instructions",
+                "cache-miss", "br-miss");
+    }
+    fprintf(table, "\n");
+    fflush(table);
+
+    int counters_failed = 0;
+    for (int s = 0; s < num_sizes; ++s) {
+        for (int k = 0; k < num_kernel_sets; ++k) {
+            const PixelAAKernels* kernels = pixel_aa_kernel_sets[k];
+            if ((only_kernels && strcmp(only_kernels, kernels->name)) ||
+                !kernels_supported(kernels)) {
+                continue;
+            }
+            for (int separable = 0; separable < 2; ++separable) {
+                BenchResult* r = &results[num_results];
+                const int status =
+                    run_bench(&sizes[s], kernels, &options, &buffers,
+                              separable, num_frames, use_counters, r);
+                if (status == BENCH_OUT_OF_MEMORY) {
+                    fprintf(stderr, "Out of memory at %dx%d->%dx%d\n",
+                            sizes[s].in_width, sizes[s].in_height,
+                            sizes[s].out_width, sizes[s].out_height);
+                    free(results);
+                    free(sizes);
+                    return 1;
+                }
+                if (status != 0) {
+                    fprintf(stderr, "Skipping unsupported size %dx%d->%dx%d\n",
+                            sizes[s].in_width, sizes[s].in_height,
+                            sizes[s].out_width, sizes[s].out_height);
+                    break;
+                }
+                counters_failed |= use_counters && !r->have_counters;
+                ++num_results;
+                print_result(table, r);
+            }
+        }
+    }
+    if (counters_failed) {
+        fprintf(stderr,
+                "Hardware counters unavailable, check "
+                "/proc/sys/kernel/perf_event_paranoid.\n");
+    }
+
+    if (json_path) {
+        FILE* f = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (!f) {
+            printf("Failed to open %s\n", json_path);
+        } else {
+            write_json(f, results, num_results);
+            if (f != stdout) {
+                fclose(f);
+            }
+        }
+    }
+
+    free(results);
+    free(sizes);
+    return 0;
+}
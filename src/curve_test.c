@@ -0,0 +1,130 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixel_aa.h"
+
+// Switching curves with pixel_aa_set_curve(): A call that fails must leave
+// the context as it was, and switching back to the original curve must give
+// the original output again. Registered with ctest, exits with 1 on the
+// first failure.
+
+#define IN_WIDTH 23
+#define IN_HEIGHT 17
+#define OUT_WIDTH 97
+#define OUT_HEIGHT 61
+
+typedef struct {
+    PixelAACurve curve;
+    float sharpness;
+} CurveArgs;
+
+// Rejected by pixel_aa_set_curve()
+static const CurveArgs invalid_args[] = {
+    {(PixelAACurve)(PIXEL_AA_CURVE_LINEAR + 1), 1.5f},
+    {(PixelAACurve)-1, 1.5f},
+    {PIXEL_AA_CURVE_SLOPESTEP, 0.0f},
+    {PIXEL_AA_CURVE_SLOPESTEP, -2.0f},
+};
+
+// Scales `in` and compares the output with `expected`. Returns 0 if they
+// match.
+static int check_output(PixelAAContext* ctx, const void* in, uint32_t* out,
+                        const uint32_t* expected, const char* what) {
+    memset(out, 0, (size_t)OUT_WIDTH * OUT_HEIGHT * sizeof(uint32_t));
+    pixel_aa_scale(ctx, in, out);
+    if (memcmp(out, expected,
+               (size_t)OUT_WIDTH * OUT_HEIGHT * sizeof(uint32_t)) != 0) {
+        printf("Output changed %s\n", what);
+        return -1;
+    }
+    return 0;
+}
+
+// Returns 0 if all checks pass.
+static int run_test(PixelAAFormat in_format, int separable) {
+    PixelAAOptions options;
+    pixel_aa_default_options(&options);
+    options.in_format = in_format;
+    options.separable = separable;
+    PixelAAContext* ctx = pixel_aa_create_with_options(
+        IN_WIDTH, IN_HEIGHT, OUT_WIDTH, OUT_HEIGHT, &options);
+    const size_t out_size = (size_t)OUT_WIDTH * OUT_HEIGHT * sizeof(uint32_t);
+    uint32_t* in = (uint32_t*)malloc(IN_WIDTH * IN_HEIGHT * sizeof(uint32_t));
+    uint32_t* expected = (uint32_t*)malloc(out_size);
+    uint32_t* out = (uint32_t*)malloc(out_size);
+    if (!ctx || !in || !expected || !out) {
+        printf("Failed to set up the test\n");
+        pixel_aa_destroy(ctx);
+        free(in);
+        free(expected);
+        free(out);
+        return -1;
+    }
+    uint32_t state = 12345;
+    for (int i = 0; i < IN_WIDTH * IN_HEIGHT; ++i) {
+        state = state * 1664525u + 1013904223u;
+        in[i] = (state >> 8) | 0xFF000000u;
+    }
+    if (in_format == PIXEL_AA_FORMAT_INDEX8) {
+        pixel_aa_set_palette(ctx, in, 256);
+        for (int i = 0; i < IN_WIDTH * IN_HEIGHT; ++i) {
+            ((uint8_t*)in)[i] = (uint8_t)(in[i] >> 8);
+        }
+    }
+    pixel_aa_scale(ctx, in, expected);
+
+    int result = 0;
+    const int num_invalid =
+        (int)(sizeof(invalid_args) / sizeof(invalid_args[0]));
+    for (int i = 0; i < num_invalid && result == 0; ++i) {
+        if (pixel_aa_set_curve(ctx, invalid_args[i].curve,
+                               invalid_args[i].sharpness) != -1) {
+            printf("Invalid curve %d, sharpness %g was accepted\n",
+                   (int)invalid_args[i].curve,
+                   (double)invalid_args[i].sharpness);
+            result = -1;
+        } else {
+            result = check_output(ctx, in, out, expected,
+                                  "after a failed pixel_aa_set_curve()");
+        }
+    }
+    if (result == 0 &&
+        pixel_aa_set_curve(ctx, PIXEL_AA_CURVE_SLOPESTEP, 3.0f) == 0) {
+        pixel_aa_scale(ctx, in, out);
+        if (memcmp(out, expected, out_size) == 0) {
+            printf("Slopestep gave the smoothstep output\n");
+            result = -1;
+        }
+    }
+    if (result == 0) {
+        pixel_aa_set_curve(ctx, PIXEL_AA_CURVE_SMOOTHSTEP, 1.5f);
+        result = check_output(ctx, in, out, expected,
+                              "after switching back to smoothstep");
+    }
+    if (result != 0) {
+        printf("With %s input%s\n",
+               in_format == PIXEL_AA_FORMAT_INDEX8 ? "INDEX8" : "XRGB8888",
+               separable ? ", separable" : "");
+    }
+    pixel_aa_destroy(ctx);
+    free(in);
+    free(expected);
+    free(out);
+    return result;
+}
+
+int main(void) {
+    static const PixelAAFormat formats[] = {PIXEL_AA_FORMAT_XRGB8888,
+                                            PIXEL_AA_FORMAT_INDEX8};
+    for (int f = 0; f < 2; ++f) {
+        for (int separable = 0; separable < 2; ++separable) {
+            if (run_test(formats[f], separable) != 0) {
+                return 1;
+            }
+        }
+    }
+    printf("Curve switches passed.\n");
+    return 0;
+}
@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixel_aa_internal.h"
+
+// Downscaling by area averaging. Each output pixel is the average of the
+// input pixels under it, each weighted by the part of it that's covered.
+// Coverage is precomputed per axis in fractions of AREA_ONE, so scaling is
+// integer only: The input rows of an output row are summed with their row
+// weights, then the column sums with the column weights. Sums are kept per
+// byte of a pixel in memory order, which makes the first step a plain
+// multiply-add over the bytes of 32 bit rows, other formats are converted
+// to XRGB8888 first. Byte sums stay below 255 * AREA_ONE after the first
+// step and below 255 * AREA_ONE * AREA_ONE after the second, which fits 32
+// bits. An axis that isn't reduced is box filtered, i.e. pixels are repeated
+// and mixed where an output pixel straddles two input pixels.
+//
+// The rounded weights make this an approximation of the exact mean: Each
+// weight is off by up to half a unit of AREA_ONE, which can move a channel
+// by one step, e.g. at a ratio of 10. Only ratios that are powers of 2 up
+// to AREA_ONE have exact weights.
+//
+// When both axes are reduced by 2 or 4 and the layouts allow it, the blocks
+// are averaged by the reduce kernels instead, with the same result.
+
+// Rounding offset of the sums weighted on both axes
+#define AREA_HALF (1u << (2 * AREA_BITS - 1))
+
+// Coverage of out_size output pixels over in_size input pixels. Positions
+// are in units of 1 / out_size input pixels, so input pixel i spans
+// [i * out_size, (i + 1) * out_size) and output pixel o spans
+// [o * in_size, (o + 1) * in_size). The weights are differences of the
+// rounded covered fraction up to the end of each input pixel, so they sum
+// to AREA_ONE exactly. Output pixel o gets `taps` weights starting at
+// o * taps, padded with zeros, or only counts them if `weights` is NULL.
+// Returns the most input pixels an output pixel covers.
+static int build_coverage(Coverage* coverage, uint16_t* weights,
+                          int out_size, int in_size, int taps) {
+    int max_count = 0;
+    for (int o = 0; o < out_size; ++o) {
+        const int64_t start = (int64_t)o * in_size;
+        const int64_t end = start + in_size;
+        const int first = (int)(start / out_size);
+        const int count = (int)((end - 1) / out_size) - first + 1;
+        max_count = count > max_count ? count : max_count;
+        if (!weights) {
+            continue;
+        }
+        coverage[o].src = first;
+        coverage[o].count = count;
+        uint16_t* w = weights + (size_t)o * taps;
+        int covered = 0;
+        for (int i = 0; i < count; ++i) {
+            const int64_t stop = (int64_t)(first + i + 1) * out_size < end
+                                     ? (int64_t)(first + i + 1) * out_size
+                                     : end;
+            const int fraction =
+                (int)(((stop - start) * AREA_ONE + in_size / 2) / in_size);
+            w[i] = (uint16_t)(fraction - covered);
+            covered = fraction;
+        }
+        for (int i = count; i < taps; ++i) {
+            w[i] = 0;
+        }
+    }
+    return max_count;
+}
+
+int downscale_init(PixelAAContext* ctx) {
+    const int in_width = ctx->in_width;
+    const int in_height = ctx->in_height;
+    const int out_width = ctx->out_width;
+    const int out_height = ctx->out_height;
+    ctx->area_taps_x = build_coverage(NULL, NULL, out_width, in_width, 0);
+    ctx->area_taps_y = build_coverage(NULL, NULL, out_height, in_height, 0);
+    ctx->coverage_x = (Coverage*)malloc(out_width * sizeof(Coverage));
+    ctx->coverage_y = (Coverage*)malloc(out_height * sizeof(Coverage));
+    ctx->area_weights_x = (uint16_t*)malloc(
+        (size_t)out_width * ctx->area_taps_x * sizeof(uint16_t));
+    ctx->area_weights_y = (uint16_t*)malloc(
+        (size_t)out_height * ctx->area_taps_y * sizeof(uint16_t));
+    // The padding weights of the last columns read past the input width.
+    ctx->area_sums = (uint32_t*)malloc((size_t)ctx->num_threads * 4 *
+                                       (in_width + ctx->area_taps_x) *
+                                       sizeof(uint32_t));
+    if (!ctx->coverage_x || !ctx->coverage_y || !ctx->area_weights_x ||
+        !ctx->area_weights_y || !ctx->area_sums) {
+        return -1;
+    }
+    build_coverage(ctx->coverage_x, ctx->area_weights_x, out_width, in_width,
+                   ctx->area_taps_x);
+    build_coverage(ctx->coverage_y, ctx->area_weights_y, out_height,
+                   in_height, ctx->area_taps_y);
+
+    ctx->reduce_factor = 0;
+    if (ctx->in_layout == ctx->out_layout && ctx->in_layout != LAYOUT_RGB565 &&
+        ctx->in_layout != LAYOUT_INDEX8) {
+        for (int factor = 2; factor <= 4; factor *= 2) {
+            if (in_width == out_width * factor &&
+                in_height == out_height * factor) {
+                ctx->reduce_factor = factor;
+            }
+        }
+    }
+    return 0;
+}
+
+// Layout of the summed pixels
+static int sum_layout(int in_layout) {
+    return layout_bytes(in_layout) == 4 ? in_layout : LAYOUT_ALPHA_HIGH;
+}
+
+// Adds input columns [x0, x1) of a row, weighted with `weight`, to the byte
+// sums, which start at column x0.
+PIXEL_AA_ALWAYS_INLINE void add_row(const PixelAAContext* ctx,
+                                    const void* row, uint32_t weight,
+                                    uint32_t* sums, int x0, int x1,
+                                    int layout) {
+    if (layout_bytes(layout) == 4) {
+        const uint8_t* bytes = (const uint8_t*)row + x0 * 4;
+        const int count = (x1 - x0) * 4;
+        for (int i = 0; i < count; ++i) {
+            sums[i] += bytes[i] * weight;
+        }
+        return;
+    }
+    for (int x = x0; x < x1; ++x, sums += 4) {
+        const uint32_t col =
+            layout == LAYOUT_INDEX8
+                ? ctx->palette[((const uint8_t*)row)[x] & ctx->palette_mask]
+                : load_pixel(row, x, layout);
+        uint8_t bytes[4];
+        memcpy(bytes, &col, sizeof(col));
+        for (int b = 0; b < 4; ++b) {
+            sums[b] += bytes[b] * weight;
+        }
+    }
+}
+
+// add_row() with a constant layout.
+static void add_row_layout(const PixelAAContext* ctx, const void* row,
+                           uint32_t weight, uint32_t* sums, int x0, int x1) {
+    switch (ctx->in_layout) {
+        case LAYOUT_ALPHA_HIGH:
+            add_row(ctx, row, weight, sums, x0, x1, LAYOUT_ALPHA_HIGH);
+            break;
+        case LAYOUT_ALPHA_LOW:
+            add_row(ctx, row, weight, sums, x0, x1, LAYOUT_ALPHA_LOW);
+            break;
+        case LAYOUT_RGB565:
+            add_row(ctx, row, weight, sums, x0, x1, LAYOUT_RGB565);
+            break;
+        case LAYOUT_SWAPPED:
+            add_row(ctx, row, weight, sums, x0, x1, LAYOUT_SWAPPED);
+            break;
+        default:
+            add_row(ctx, row, weight, sums, x0, x1, LAYOUT_INDEX8);
+            break;
+    }
+}
+
+void downscale_rows(const PixelAAContext* ctx, const void* in, int in_stride,
+                    void* out, int out_stride, int x0, int x1, int y0, int y1,
+                    int thread_num) {
+    const int out_layout = ctx->out_layout;
+
+    if (ctx->reduce_factor > 0) {
+        const int factor = ctx->reduce_factor;
+        const reduce_row_fn reduce = factor == 2
+                                         ? ctx->kernels->reduce_2x2_row
+                                         : ctx->kernels->reduce_4x4_row;
+        const uint32_t alpha = out_layout == LAYOUT_ALPHA_HIGH ? 0xFF000000u
+                                                               : 0xFFu;
+        for (int y = y0; y < y1; ++y) {
+            reduce(pixel_offset(row_offset(in, y * factor, in_stride),
+                                x0 * factor, ctx->in_layout),
+                   in_stride, alpha, row_offset_mut(out, y - y0, out_stride),
+                   x1 - x0);
+        }
+        return;
+    }
+
+    // Input columns under the output columns, and up to the last padding
+    // weight
+    const int taps_x = ctx->area_taps_x;
+    const Coverage* last = &ctx->coverage_x[x1 - 1];
+    const int in_x0 = ctx->coverage_x[x0].src;
+    const int in_x1 = last->src + last->count;
+    const int sums_x1 = last->src + taps_x;
+    const int layout = sum_layout(ctx->in_layout);
+    uint32_t* sums = ctx->area_sums +
+                     (size_t)thread_num * 4 * (ctx->in_width + taps_x);
+
+    for (int y = y0; y < y1; ++y) {
+        const Coverage* coverage_y = &ctx->coverage_y[y];
+        const uint16_t* weights_y =
+            ctx->area_weights_y + (size_t)y * ctx->area_taps_y;
+        memset(sums, 0, (size_t)(sums_x1 - in_x0) * 4 * sizeof(uint32_t));
+        for (int i = 0; i < coverage_y->count; ++i) {
+            if (weights_y[i] > 0) {
+                add_row_layout(ctx,
+                               row_offset(in, coverage_y->src + i, in_stride),
+                               weights_y[i], sums, in_x0, in_x1);
+            }
+        }
+
+        // The same number of taps for every column keeps the loop
+        // predictable.
+        void* out_row = row_offset_mut(out, y - y0, out_stride);
+        for (int x = x0; x < x1; ++x) {
+            const uint32_t* col_sums =
+                sums + 4 * (ctx->coverage_x[x].src - in_x0);
+            const uint16_t* weights_x =
+                ctx->area_weights_x + (size_t)x * taps_x;
+            uint32_t byte_sums[4] = {AREA_HALF, AREA_HALF, AREA_HALF,
+                                     AREA_HALF};
+            for (int i = 0; i < taps_x; ++i) {
+                for (int b = 0; b < 4; ++b) {
+                    byte_sums[b] += col_sums[4 * i + b] * weights_x[i];
+                }
+            }
+            uint8_t bytes[4];
+            for (int b = 0; b < 4; ++b) {
+                bytes[b] = (uint8_t)(byte_sums[b] >> 2 * AREA_BITS);
+            }
+            uint32_t col;
+            memcpy(&col, bytes, sizeof(col));
+            store_pixel(out_row, x - x0,
+                        load_pixel(&col, 0, layout) | 0xFF000000u,
+                        out_layout);
+        }
+    }
+}
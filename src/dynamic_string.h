@@ -0,0 +1,66 @@
+#ifndef DYNAMIC_STRING_H
+#define DYNAMIC_STRING_H
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char* str;
+    int allocated_size;
+    int used_size;
+} DynamicString;
+
+// Function to initialize the string
+static inline void init(DynamicString* str) {
+    str->allocated_size = 2;
+    str->used_size = 0;
+    str->str = (char*)malloc(str->allocated_size * sizeof(char));
+    str->str[0] = '\0';
+}
+
+// Makes room for `needed_size` more characters plus the terminator.
+static inline void reserve(DynamicString* str, int needed_size) {
+    if (str->used_size + needed_size >= str->allocated_size) {
+        while (str->used_size + needed_size >= str->allocated_size)
+            str->allocated_size *= 2;
+
+        // Reallocate memory with the new size
+        str->str =
+            (char*)realloc(str->str, str->allocated_size * sizeof(char));
+    }
+}
+
+// Function to add a const char* to the string
+static inline void add_string(DynamicString* str, const char* new_str) {
+    int new_str_len = strlen(new_str);
+    reserve(str, new_str_len);
+
+    // Add the new string to the dynamic string. Appending at used_size
+    // instead of strcat() keeps building long sources linear.
+    memcpy(str->str + str->used_size, new_str, new_str_len + 1);
+    str->used_size += new_str_len;
+}
+
+static inline void add_fmt_string(DynamicString* str, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+
+    // Determine the size required for formatting
+    int needed_size = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    reserve(str, needed_size);
+
+    va_start(args, fmt);
+    vsprintf(str->str + str->used_size, fmt, args);
+    va_end(args);
+
+    str->used_size += needed_size;
+}
+
+// Function to destroy the string and free the memory
+static inline void destroy(DynamicString* str) { free(str->str); }
+
+#endif  // DYNAMIC_STRING_H
@@ -0,0 +1,187 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixel_aa.h"
+#include "pixel_aa_internal.h"
+
+// Round trip of solid colors through every pair of formats, with every
+// kernel set the CPU supports, upscaled separably and not and downscaled by
+// the reduce kernels and by area averaging. A solid image must come out as
+// the same solid color, encoded in the output format. Pure red, green and
+// blue catch channels that are swapped or misplaced by a layout.
+// Registered with ctest, exits with 1 on the first mismatch.
+
+typedef struct {
+    int in_width;
+    int in_height;
+    int out_width;
+    int out_height;
+} TestSize;
+
+// Odd widths leave a tail for the scalar fallback of the SIMD kernels.
+static const TestSize sizes[] = {
+    {5, 3, 37, 9},
+    {16, 8, 8, 4},
+    {16, 16, 4, 4},
+    {15, 7, 4, 3},
+};
+
+static const uint32_t colors[] = {
+    0xFFFF0000u,
+    0xFF00FF00u,
+    0xFF0000FFu,
+    0xFF123456u,
+};
+
+static const char* const format_names[] = {
+    "XRGB8888", "BGRA8888", "RGBA8888", "RGB565", "INDEX8",
+};
+
+// `col` given as 0xAARRGGBB in `format`, written out byte by byte from the
+// format description rather than with load_pixel() and store_pixel().
+static uint32_t encode(uint32_t col, PixelAAFormat format) {
+    const uint32_t a = col >> 24;
+    const uint32_t r = col >> 16 & 0xFF;
+    const uint32_t g = col >> 8 & 0xFF;
+    const uint32_t b = col & 0xFF;
+    switch (format) {
+        case PIXEL_AA_FORMAT_BGRA8888:
+            return b << 24 | g << 16 | r << 8 | a;
+        case PIXEL_AA_FORMAT_RGBA8888:
+            return r << 24 | g << 16 | b << 8 | a;
+        case PIXEL_AA_FORMAT_RGB565:
+            return (r >> 3) << 11 | (g >> 2) << 5 | b >> 3;
+        default:
+            return col;
+    }
+}
+
+// `col` after a round trip through `format`.
+static uint32_t quantize(uint32_t col, PixelAAFormat format) {
+    if (format != PIXEL_AA_FORMAT_RGB565) {
+        return col;
+    }
+    const uint32_t r = col >> 19 & 0x1F;
+    const uint32_t g = col >> 10 & 0x3F;
+    const uint32_t b = col >> 3 & 0x1F;
+    return 0xFF000000u | WIDEN_5(r) << 16 | WIDEN_6(g) << 8 | WIDEN_5(b);
+}
+
+static void fill(void* image, int count, uint32_t value, int bytes) {
+    for (int i = 0; i < count; ++i) {
+        if (bytes == 4) {
+            ((uint32_t*)image)[i] = value;
+        } else if (bytes == 2) {
+            ((uint16_t*)image)[i] = (uint16_t)value;
+        } else {
+            ((uint8_t*)image)[i] = (uint8_t)value;
+        }
+    }
+}
+
+static uint32_t read_pixel(const void* image, int i, int bytes) {
+    return bytes == 4 ? ((const uint32_t*)image)[i]
+                      : ((const uint16_t*)image)[i];
+}
+
+// Returns 0 if every output pixel matches.
+static int run_test(const TestSize* size, const PixelAAKernels* kernels,
+                    PixelAAFormat in_format, PixelAAFormat out_format,
+                    int separable, uint32_t col) {
+    PixelAAOptions options;
+    pixel_aa_default_options(&options);
+    options.in_format = in_format;
+    options.out_format = out_format;
+    options.separable = separable;
+    setenv("PIXEL_AA_KERNELS", kernels->name, 1);
+    PixelAAContext* ctx = pixel_aa_create_with_options(
+        size->in_width, size->in_height, size->out_width, size->out_height,
+        &options);
+    if (!ctx) {
+        printf("Failed to create a context for %dx%d->%dx%d\n",
+               size->in_width, size->in_height, size->out_width,
+               size->out_height);
+        return -1;
+    }
+    if (strcmp(pixel_aa_get_kernels_name(ctx), kernels->name) != 0) {
+        printf("Asked for %s kernels, got %s\n", kernels->name,
+               pixel_aa_get_kernels_name(ctx));
+        pixel_aa_destroy(ctx);
+        return -1;
+    }
+
+    const int in_bytes = pixel_aa_bytes_per_pixel(in_format);
+    const int out_bytes = pixel_aa_bytes_per_pixel(out_format);
+    const int in_count = size->in_width * size->in_height;
+    const int out_count = size->out_width * size->out_height;
+    void* in = malloc((size_t)in_count * in_bytes);
+    void* out = malloc((size_t)out_count * out_bytes);
+    if (!in || !out) {
+        printf("Failed to allocate the images\n");
+        free(in);
+        free(out);
+        pixel_aa_destroy(ctx);
+        return -1;
+    }
+    if (in_format == PIXEL_AA_FORMAT_INDEX8) {
+        pixel_aa_set_palette(ctx, &col, 1);
+        fill(in, in_count, 0, in_bytes);
+    } else {
+        fill(in, in_count, encode(col, in_format), in_bytes);
+    }
+    pixel_aa_scale(ctx, in, out);
+
+    const uint32_t expected = encode(quantize(col, in_format), out_format);
+    int result = 0;
+    for (int i = 0; i < out_count; ++i) {
+        const uint32_t actual = read_pixel(out, i, out_bytes);
+        if (actual != expected) {
+            printf("%s %s->%s %dx%d->%dx%d%s, color %08x: pixel %d is %0*x, "
+                   "expected %0*x\n",
+                   kernels->name, format_names[in_format],
+                   format_names[out_format], size->in_width, size->in_height,
+                   size->out_width, size->out_height,
+                   separable ? " separable" : "", col, i, 2 * out_bytes,
+                   actual, 2 * out_bytes, expected);
+            result = -1;
+            break;
+        }
+    }
+    free(in);
+    free(out);
+    pixel_aa_destroy(ctx);
+    return result;
+}
+
+int main(void) {
+    const int num_sizes = (int)(sizeof(sizes) / sizeof(sizes[0]));
+    const int num_colors = (int)(sizeof(colors) / sizeof(colors[0]));
+    int num_tests = 0;
+    for (int k = 0; k < pixel_aa_num_kernel_sets; ++k) {
+        const PixelAAKernels* kernels = pixel_aa_kernel_sets[k];
+        if (!kernels_supported(kernels)) {
+            continue;
+        }
+        for (int in = 0; in <= PIXEL_AA_FORMAT_INDEX8; ++in) {
+            // INDEX8 is input only.
+            for (int out = 0; out < PIXEL_AA_FORMAT_INDEX8; ++out) {
+                for (int s = 0; s < num_sizes; ++s) {
+                    for (int separable = 0; separable < 2; ++separable) {
+                        for (int c = 0; c < num_colors; ++c) {
+                            if (run_test(&sizes[s], kernels,
+                                         (PixelAAFormat)in, (PixelAAFormat)out,
+                                         separable, colors[c]) != 0) {
+                                return 1;
+                            }
+                            ++num_tests;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    printf("%d format round trips passed.\n", num_tests);
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+// clang-format off
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+// clang-format on
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        printf(
+            "Usage: %s <image_a> <image_b> [max_diff]\n"
+            "Fails if any RGB channel of the two images differs by more than "
+            "max_diff (default 0).\n",
+            argv[0]);
+        return 1;
+    }
+    const int max_allowed = argc > 3 ? atoi(argv[3]) : 0;
+
+    int width_a, height_a, width_b, height_b, channels;
+    unsigned char* a =
+        stbi_load(argv[1], &width_a, &height_a, &channels, STBI_rgb);
+    unsigned char* b =
+        stbi_load(argv[2], &width_b, &height_b, &channels, STBI_rgb);
+    if (!a || !b) {
+        printf("Failed to load image.\n");
+        stbi_image_free(a);
+        stbi_image_free(b);
+        return 1;
+    }
+    if (width_a != width_b || height_a != height_b) {
+        printf("Image sizes differ: %dx%d vs. %dx%d\n", width_a, height_a,
+               width_b, height_b);
+        stbi_image_free(a);
+        stbi_image_free(b);
+        return 1;
+    }
+
+    const long num_pixels = (long)width_a * height_a;
+    int max_diff = 0;
+    long sum_diff = 0;
+    long num_diff_pixels = 0;
+    for (long i = 0; i < num_pixels; ++i) {
+        int pixel_diff = 0;
+        for (int c = 0; c < 3; ++c) {
+            const int diff = abs((int)a[i * 3 + c] - (int)b[i * 3 + c]);
+            sum_diff += diff;
+            if (diff > pixel_diff) {
+                pixel_diff = diff;
+            }
+        }
+        if (pixel_diff > max_diff) {
+            max_diff = pixel_diff;
+        }
+        if (pixel_diff > 0) {
+            ++num_diff_pixels;
+        }
+    }
+
+    printf("Max. channel difference: %d\n", max_diff);
+    printf("Mean channel difference: %f\n",
+           (double)sum_diff / (num_pixels * 3));
+    printf("Differing pixels: %ld of %ld\n", num_diff_pixels, num_pixels);
+
+    stbi_image_free(a);
+    stbi_image_free(b);
+    if (max_diff > max_allowed) {
+        printf("Difference exceeds %d.\n", max_allowed);
+        return 1;
+    }
+    return 0;
+}
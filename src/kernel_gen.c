@@ -0,0 +1,425 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "kernel_gen.h"
+
+// Emits C source for a kernel that scales one whole frame of one fixed
+// configuration. It produces the same output as the direct path of
+// pixel_aa_scale(), but every source offset and weight is a literal in the
+// code, so no index math or weight loads are left at run time:
+//
+//   row_x(r, o)           One output row from one input row. The center
+//                         columns are an unrolled x cycle, run in a loop,
+//                         with unrolled prologue and tail.
+//   row_xy(r0, r1, w, o)  Same, mixed vertically between two input rows.
+//   <name>(in, out)       One unrolled y cycle of row_x / row_xy calls and
+//                         copies of the previous output row, run in a loop,
+//                         with unrolled prologue and tail.
+
+// Bump when the generated code changes, so cached kernels built by older
+// versions are not picked up anymore.
+#define KERNEL_GEN_VERSION 1
+
+#if defined(__x86_64__)
+#define KERNEL_ARCH "x86_64"
+#elif defined(__aarch64__)
+#define KERNEL_ARCH "aarch64"
+#elif defined(__arm__)
+#define KERNEL_ARCH "arm"
+#elif defined(__i386__)
+#define KERNEL_ARCH "i386"
+#else
+#define KERNEL_ARCH "unknown"
+#endif
+
+#ifdef FIXED_POINT
+#define KERNEL_WEIGHTS "fixed"
+#else   // !FIXED_POINT
+#define KERNEL_WEIGHTS "float"
+#endif  // FIXED_POINT
+
+void kernel_gen_plan_columns(const PixelAAContext* ctx, ColumnPlan* plan) {
+    const int32_t* src_x = ctx->src_x + ctx->border_x;
+    plan->center_width = ctx->out_width - ctx->border_x - ctx->border_x;
+    plan->prologue_width = ctx->prologue_width;
+    plan->cycle_length = ctx->x_cycle_length;
+    plan->in_advance = ctx->x_in_advance;
+    plan->num_cycles = 0;
+    plan->cycle_src = 0;
+    if (plan->prologue_width < plan->center_width) {
+        plan->num_cycles = (plan->center_width - plan->prologue_width) /
+                           plan->cycle_length;
+        plan->cycle_src = src_x[plan->prologue_width];
+    }
+    plan->tail_start =
+        plan->prologue_width + plan->num_cycles * plan->cycle_length;
+    plan->tail_src = plan->cycle_src + plan->num_cycles * plan->in_advance;
+}
+
+static int rows_equal(const RowDesc* a, const RowDesc* b, int in_advance) {
+    if (a->kind != b->kind) {
+        return 0;
+    }
+    if (a->kind == ROW_COPY) {
+        return 1;
+    }
+    return b->sample == a->sample + in_advance && b->weight == a->weight;
+}
+
+int kernel_gen_plan_rows(const PixelAAContext* ctx, RowPlan* plan) {
+    const int in_height = ctx->in_height;
+    const int out_height = ctx->out_height;
+
+    // Generated kernels only handle upscaling in the default format.
+    if (ctx->downscale || ctx->in_format != PIXEL_AA_FORMAT_XRGB8888 ||
+        ctx->out_format != PIXEL_AA_FORMAT_XRGB8888) {
+        return -1;
+    }
+
+    // Classify the output rows the same way pixel_aa_scale() does.
+    RowDesc* rows = (RowDesc*)malloc(out_height * sizeof(RowDesc));
+    if (!rows) {
+        return -1;
+    }
+    plan->rows = rows;
+    plan->have_row_x = 0;
+    plan->have_row_xy = 0;
+    for (int y = 0; y < out_height; ++y) {
+        const weight_t offset_y = ctx->weights_y[y];
+        RowDesc* row = &rows[y];
+        row->weight = offset_y;
+        if (offset_y < WEIGHT_TOL || offset_y > WEIGHT_TOL_UPPER) {
+            row->kind = ROW_X;
+            row->sample = ctx->src_y[y] + (offset_y < WEIGHT_TOL ? 0 : 1);
+            row->weight = 0;
+            if (y > 0 && rows[y - 1].kind != ROW_XY &&
+                rows[y - 1].sample == row->sample) {
+                row->kind = ROW_COPY;
+            }
+        } else {
+            row->kind = ROW_XY;
+            row->sample = ctx->src_y[y];
+        }
+        plan->have_row_x |= row->kind == ROW_X;
+        plan->have_row_xy |= row->kind == ROW_XY;
+    }
+
+    // Like the columns, the rows repeat every cycle_length rows, except
+    // possibly for the first ones.
+    int y_gcd = in_height;
+    for (int b = out_height; b != 0;) {
+        const int remainder = y_gcd % b;
+        y_gcd = b;
+        b = remainder;
+    }
+    plan->cycle_length = out_height / y_gcd;
+    plan->in_advance = in_height / y_gcd;
+    plan->prologue_height = 0;
+    for (int y = out_height - plan->cycle_length - 1; y >= 0; --y) {
+        if (!rows_equal(&rows[y], &rows[y + plan->cycle_length],
+                        plan->in_advance)) {
+            plan->prologue_height = y + 1;
+            break;
+        }
+    }
+    plan->num_cycles =
+        (out_height - plan->prologue_height) / plan->cycle_length;
+    plan->tail_start =
+        plan->prologue_height + plan->num_cycles * plan->cycle_length;
+    plan->cycle_sample = plan->prologue_height < out_height
+                             ? rows[plan->prologue_height].sample
+                             : 0;
+    plan->tail_sample =
+        plan->cycle_sample + plan->num_cycles * plan->in_advance;
+    return 0;
+}
+
+static void add_weight(DynamicString* str, weight_t weight) {
+#ifdef FIXED_POINT
+    add_fmt_string(str, "%d", (int)weight);
+#else   // !FIXED_POINT
+    // 9 significant digits round-trip any float exactly.
+    add_fmt_string(str, "%.8ef", weight);
+#endif  // FIXED_POINT
+}
+
+static void add_prelude(DynamicString* str) {
+    add_string(str,
+               "#include <stdint.h>\n"
+               "#include <string.h>\n"
+               "#define CH(p, c) (((p) >> (8 * (2 - (c)))) & 0xFF)\n"
+               "#define COL(r, g, b) (((uint32_t)(r) << 16) | "
+               "((uint32_t)(g) << 8) | (uint32_t)(b) | 0xFF000000u)\n");
+#ifdef FIXED_POINT
+    add_fmt_string(str,
+                   "typedef int weight_t;\n"
+                   "#define MIX(x, y, a) ((int)(x) + (((a) * ((int)(y) - "
+                   "(int)(x))) >> %d))\n",
+                   FIXED_POINT_BITS);
+#else   // !FIXED_POINT
+    add_string(str,
+               "typedef float weight_t;\n"
+               "#define MIX(x, y, a) ((float)(x) + (a) * ((float)(y) - "
+               "(float)(x)))\n");
+#endif  // FIXED_POINT
+    add_string(
+        str,
+        "#define BLEND(d, p0, p1, a) do { \\\n"
+        "    const uint32_t s0_ = (p0), s1_ = (p1); \\\n"
+        "    (d) = COL(MIX(CH(s0_, 0), CH(s1_, 0), a), \\\n"
+        "              MIX(CH(s0_, 1), CH(s1_, 1), a), \\\n"
+        "              MIX(CH(s0_, 2), CH(s1_, 2), a)); \\\n"
+        "} while (0)\n"
+        "#define BLEND4(d, p0, p1, p2, p3, a, b) do { \\\n"
+        "    const uint32_t s0_ = (p0), s1_ = (p1), s2_ = (p2), s3_ = (p3); "
+        "\\\n"
+        "    (d) = COL(MIX(MIX(CH(s0_, 0), CH(s1_, 0), a), "
+        "MIX(CH(s2_, 0), CH(s3_, 0), a), b), \\\n"
+        "              MIX(MIX(CH(s0_, 1), CH(s1_, 1), a), "
+        "MIX(CH(s2_, 1), CH(s3_, 1), a), b), \\\n"
+        "              MIX(MIX(CH(s0_, 2), CH(s1_, 2), a), "
+        "MIX(CH(s2_, 2), CH(s3_, 2), a), b)); \\\n"
+        "} while (0)\n");
+}
+
+// Emits output pixel o[index] from input columns p0[src] and p0[src + 1], and
+// the same columns of p1 if `vertical` is set.
+static void add_pixel(DynamicString* str, int index, int src,
+                      weight_t weight_x, int vertical) {
+    if (!vertical) {
+        if (weight_x < WEIGHT_TOL) {
+            // Need 1 sample, no mixing
+            add_fmt_string(str, "    o[%d] = p0[%d];\n", index, src);
+        } else if (weight_x > WEIGHT_TOL_UPPER) {
+            // Need 1 sample, no mixing
+            add_fmt_string(str, "    o[%d] = p0[%d];\n", index, src + 1);
+        } else {
+            // Need 2 samples, mix with weight_x
+            add_fmt_string(str, "    BLEND(o[%d], p0[%d], p0[%d], ", index,
+                           src, src + 1);
+            add_weight(str, weight_x);
+            add_string(str, ");\n");
+        }
+        return;
+    }
+
+    if (weight_x < WEIGHT_TOL || weight_x > WEIGHT_TOL_UPPER) {
+        // Need 2 samples, mix with w
+        const int sample = weight_x < WEIGHT_TOL ? src : src + 1;
+        add_fmt_string(str, "    BLEND(o[%d], p0[%d], p1[%d], w);\n", index,
+                       sample, sample);
+    } else {
+        // Need 4 samples, mix with weight_x and w
+        add_fmt_string(str,
+                       "    BLEND4(o[%d], p0[%d], p0[%d], p1[%d], p1[%d], ",
+                       index, src, src + 1, src, src + 1);
+        add_weight(str, weight_x);
+        add_string(str, ", w);\n");
+    }
+}
+
+// Emits `count` center pixels starting at center column `first`, with input
+// columns relative to `src_base` and output columns relative to o.
+static void add_pixels(DynamicString* str, const PixelAAContext* ctx,
+                       int first, int count, int src_base, int vertical) {
+    const int32_t* src_x = ctx->src_x + ctx->border_x;
+    const weight_t* weights_x = ctx->weights_x + ctx->border_x;
+    for (int x = 0; x < count; ++x) {
+        add_pixel(str, x, src_x[first + x] - src_base, weights_x[first + x],
+                  vertical);
+    }
+}
+
+static void add_row_function(DynamicString* str, const PixelAAContext* ctx,
+                             int vertical) {
+    const int in_width = ctx->in_width;
+    const int out_width = ctx->out_width;
+    const int border_x = ctx->border_x;
+    const int center_width = out_width - border_x - border_x;
+
+    if (vertical) {
+        add_string(str,
+                   "static void row_xy(const uint32_t* restrict r0, "
+                   "const uint32_t* restrict r1, weight_t w, "
+                   "uint32_t* restrict out) {\n"
+                   "    uint32_t* o = out;\n");
+    } else {
+        add_string(str,
+                   "static void row_x(const uint32_t* restrict r0, "
+                   "uint32_t* restrict out) {\n"
+                   "    uint32_t* o = out;\n");
+    }
+
+    // Left and right border
+    if (border_x > 0) {
+        if (vertical) {
+            add_fmt_string(str,
+                           "    uint32_t first, last;\n"
+                           "    BLEND(first, r0[0], r1[0], w);\n"
+                           "    BLEND(last, r0[%d], r1[%d], w);\n",
+                           in_width - 1, in_width - 1);
+        } else {
+            add_fmt_string(str,
+                           "    const uint32_t first = r0[0];\n"
+                           "    const uint32_t last = r0[%d];\n",
+                           in_width - 1);
+        }
+        add_fmt_string(str,
+                       "    for (int x = 0; x < %d; ++x) {\n"
+                       "        o[x] = first;\n"
+                       "    }\n"
+                       "    for (int x = %d; x < %d; ++x) {\n"
+                       "        o[x] = last;\n"
+                       "    }\n",
+                       border_x, out_width - border_x, out_width);
+    }
+    if (center_width <= 0) {
+        add_string(str, "}\n");
+        return;
+    }
+    add_string(str, "    const uint32_t* p0 = r0;\n");
+    if (vertical) {
+        add_string(str, "    const uint32_t* p1 = r1;\n");
+    }
+    add_fmt_string(str, "    o += %d;\n", border_x);
+
+    // Prologue
+    ColumnPlan plan;
+    kernel_gen_plan_columns(ctx, &plan);
+    add_pixels(str, ctx, 0, plan.prologue_width, 0, vertical);
+
+    // Cycles
+    if (plan.prologue_width < center_width) {
+        add_fmt_string(str, "    o += %d;\n    p0 += %d;\n",
+                       plan.prologue_width, plan.cycle_src);
+        if (vertical) {
+            add_fmt_string(str, "    p1 += %d;\n", plan.cycle_src);
+        }
+    }
+    if (plan.num_cycles > 0) {
+        add_fmt_string(str, "    for (int c = 0; c < %d; ++c) {\n",
+                       plan.num_cycles);
+        add_pixels(str, ctx, plan.prologue_width, plan.cycle_length,
+                   plan.cycle_src, vertical);
+        add_fmt_string(str, "    o += %d;\n    p0 += %d;\n",
+                       plan.cycle_length, plan.in_advance);
+        if (vertical) {
+            add_fmt_string(str, "    p1 += %d;\n", plan.in_advance);
+        }
+        add_string(str, "    }\n");
+    }
+
+    // Tail
+    add_pixels(str, ctx, plan.tail_start, center_width - plan.tail_start,
+               plan.tail_src, vertical);
+    add_string(str, "}\n");
+}
+
+// Emits output rows [first, first + count), with input rows relative to
+// `sample_base` and output rows relative to the `in` and `out` pointers.
+static void add_rows(DynamicString* str, const PixelAAContext* ctx,
+                     const RowDesc* rows, int first, int count,
+                     int sample_base, const char* indent) {
+    const int in_width = ctx->in_width;
+    const int out_width = ctx->out_width;
+    for (int y = 0; y < count; ++y) {
+        const RowDesc* row = &rows[first + y];
+        const int sample = row->sample - sample_base;
+        switch (row->kind) {
+            case ROW_COPY:
+                add_fmt_string(str,
+                               "%smemcpy(out + %" PRId64 ", out + %" PRId64
+                               ", %d * sizeof(uint32_t));\n",
+                               indent, (int64_t)y * out_width,
+                               (int64_t)(y - 1) * out_width, out_width);
+                break;
+            case ROW_X:
+                add_fmt_string(str,
+                               "%srow_x(in + %" PRId64 ", out + %" PRId64
+                               ");\n",
+                               indent, (int64_t)sample * in_width,
+                               (int64_t)y * out_width);
+                break;
+            case ROW_XY:
+                add_fmt_string(str,
+                               "%srow_xy(in + %" PRId64 ", in + %" PRId64
+                               ", ",
+                               indent, (int64_t)sample * in_width,
+                               (int64_t)(sample + 1) * in_width);
+                add_weight(str, row->weight);
+                add_fmt_string(str, ", out + %" PRId64 ");\n",
+                               (int64_t)y * out_width);
+                break;
+        }
+    }
+}
+
+char* pixel_aa_generate_kernel(const PixelAAContext* ctx, const char* name) {
+    RowPlan plan;
+    if (kernel_gen_plan_rows(ctx, &plan) != 0) {
+        return NULL;
+    }
+
+    DynamicString str;
+    init(&str);
+    add_prelude(&str);
+    if (plan.have_row_x) {
+        add_row_function(&str, ctx, 0);
+    }
+    if (plan.have_row_xy) {
+        add_row_function(&str, ctx, 1);
+    }
+    add_fmt_string(&str,
+                   "void %s(const uint32_t* restrict in_ptr, "
+                   "uint32_t* restrict out_ptr) {\n"
+                   "    const uint32_t* in = in_ptr;\n"
+                   "    uint32_t* out = out_ptr;\n",
+                   name);
+
+    // Prologue
+    add_rows(&str, ctx, plan.rows, 0, plan.prologue_height, 0, "    ");
+    add_fmt_string(&str, "    in += %" PRId64 ";\n    out += %" PRId64 ";\n",
+                   (int64_t)plan.cycle_sample * ctx->in_width,
+                   (int64_t)plan.prologue_height * ctx->out_width);
+
+    // Cycles
+    if (plan.num_cycles > 0) {
+        add_fmt_string(&str, "    for (int c = 0; c < %d; ++c) {\n",
+                       plan.num_cycles);
+        add_rows(&str, ctx, plan.rows, plan.prologue_height,
+                 plan.cycle_length, plan.cycle_sample, "        ");
+        add_fmt_string(&str,
+                       "        in += %" PRId64 ";\n"
+                       "        out += %" PRId64 ";\n"
+                       "    }\n",
+                       (int64_t)plan.in_advance * ctx->in_width,
+                       (int64_t)plan.cycle_length * ctx->out_width);
+    }
+
+    // Tail
+    add_rows(&str, ctx, plan.rows, plan.tail_start,
+             ctx->out_height - plan.tail_start, plan.tail_sample, "    ");
+    add_string(&str, "}\n");
+
+    free(plan.rows);
+    return str.str;
+}
+
+int pixel_aa_kernel_key(const PixelAAContext* ctx, char* key, int size) {
+    static const char* const curve_names[] = {"smoothstep", "slopestep",
+                                              "linear"};
+    char curve[32];
+    if (ctx->curve == PIXEL_AA_CURVE_SLOPESTEP) {
+        // The sharpness changes the weights that are baked in. 9 digits
+        // tell every float apart.
+        snprintf(curve, sizeof(curve), "slopestep%.9g",
+                 (double)ctx->sharpness);
+    } else {
+        snprintf(curve, sizeof(curve), "%s", curve_names[ctx->curve]);
+    }
+    return snprintf(key, size, "%dx%d_%dx%d_%s_%s_%s_v%d", ctx->in_width,
+                    ctx->in_height, ctx->out_width, ctx->out_height, curve,
+                    KERNEL_WEIGHTS, KERNEL_ARCH, KERNEL_GEN_VERSION);
+}
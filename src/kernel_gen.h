@@ -0,0 +1,60 @@
+#ifndef KERNEL_GEN_H
+#define KERNEL_GEN_H
+
+#include "dynamic_string.h"
+#include "pixel_aa_internal.h"
+
+// Shared by the C and LLVM IR generators, see kernel_gen.c.
+
+// How an output row is produced
+enum {
+    // Same as the previous output row
+    ROW_COPY,
+    // From one input row
+    ROW_X,
+    // Mixed from two input rows
+    ROW_XY,
+};
+
+typedef struct {
+    int kind;
+    int sample;
+    weight_t weight;
+} RowDesc;
+
+// Center columns of a row: An unrolled prologue, num_cycles repetitions of
+// one unrolled x cycle and an unrolled tail. Input columns of the cycles and
+// the tail are relative to cycle_src and tail_src.
+typedef struct {
+    int center_width;
+    int prologue_width;
+    int cycle_length;
+    int in_advance;
+    int num_cycles;
+    int cycle_src;
+    int tail_start;
+    int tail_src;
+} ColumnPlan;
+
+// Same for the rows of a frame. Input rows of the cycles and the tail are
+// relative to cycle_sample and tail_sample.
+typedef struct {
+    RowDesc* rows;
+    int prologue_height;
+    int cycle_length;
+    int in_advance;
+    int num_cycles;
+    int cycle_sample;
+    int tail_start;
+    int tail_sample;
+    int have_row_x;
+    int have_row_xy;
+} RowPlan;
+
+void kernel_gen_plan_columns(const PixelAAContext* ctx, ColumnPlan* plan);
+
+// Returns 0 on success, -1 if allocation fails or the formats of the
+// context aren't supported. plan->rows must be freed by the caller.
+int kernel_gen_plan_rows(const PixelAAContext* ctx, RowPlan* plan);
+
+#endif  // KERNEL_GEN_H
@@ -0,0 +1,445 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernel_gen.h"
+
+// Emits the same kernel as pixel_aa_generate_kernel() as textual LLVM IR, for
+// JITs that have no C frontend. Loop counters and moving pointers live in
+// allocas, which the optimizer turns into registers.
+
+typedef struct {
+    DynamicString* str;
+    // Next free temporary, %t<n>
+    int next;
+} IrFunction;
+
+// A value operand, e.g. "%t12" or "%r0" or a constant
+typedef struct {
+    char name[32];
+} IrValue;
+
+static IrValue ir_temp(IrFunction* f) {
+    IrValue value;
+    snprintf(value.name, sizeof(value.name), "%%t%d", f->next++);
+    return value;
+}
+
+static IrValue ir_named(const char* name) {
+    IrValue value;
+    snprintf(value.name, sizeof(value.name), "%s", name);
+    return value;
+}
+
+static IrValue ir_weight(weight_t weight) {
+    IrValue value;
+#ifdef FIXED_POINT
+    snprintf(value.name, sizeof(value.name), "%d", (int)weight);
+#else   // !FIXED_POINT
+    // Float constants are written as the bits of the equivalent double.
+    double as_double = weight;
+    uint64_t bits;
+    memcpy(&bits, &as_double, sizeof(bits));
+    snprintf(value.name, sizeof(value.name), "0x%016llX",
+             (unsigned long long)bits);
+#endif  // FIXED_POINT
+    return value;
+}
+
+#ifdef FIXED_POINT
+#define IR_WEIGHT_TYPE "i32"
+#else   // !FIXED_POINT
+#define IR_WEIGHT_TYPE "float"
+#endif  // FIXED_POINT
+
+// Pointer to element `index` of `ptr`
+static IrValue ir_gep(IrFunction* f, IrValue ptr, int64_t index) {
+    if (index == 0) {
+        return ptr;
+    }
+    IrValue result = ir_temp(f);
+    add_fmt_string(f->str,
+                   "  %s = getelementptr inbounds i32, i32* %s, i64 %" PRId64
+                   "\n",
+                   result.name, ptr.name, index);
+    return result;
+}
+
+static IrValue ir_load(IrFunction* f, IrValue ptr, int index) {
+    IrValue addr = ir_gep(f, ptr, index);
+    IrValue result = ir_temp(f);
+    add_fmt_string(f->str, "  %s = load i32, i32* %s, align 4\n", result.name,
+                   addr.name);
+    return result;
+}
+
+static void ir_store(IrFunction* f, IrValue value, IrValue ptr, int index) {
+    IrValue addr = ir_gep(f, ptr, index);
+    add_fmt_string(f->str, "  store i32 %s, i32* %s, align 4\n", value.name,
+                   addr.name);
+}
+
+// Channel c of a pixel, as weight type
+static IrValue ir_channel(IrFunction* f, IrValue pixel, int c) {
+    IrValue shifted = ir_temp(f);
+    add_fmt_string(f->str, "  %s = lshr i32 %s, %d\n", shifted.name,
+                   pixel.name, 8 * (2 - c));
+    IrValue masked = ir_temp(f);
+    add_fmt_string(f->str, "  %s = and i32 %s, 255\n", masked.name,
+                   shifted.name);
+#ifdef FIXED_POINT
+    return masked;
+#else   // !FIXED_POINT
+    IrValue result = ir_temp(f);
+    add_fmt_string(f->str, "  %s = uitofp i32 %s to float\n", result.name,
+                   masked.name);
+    return result;
+#endif  // FIXED_POINT
+}
+
+// Same as mix()
+static IrValue ir_mix(IrFunction* f, IrValue x, IrValue y, IrValue a) {
+    IrValue diff = ir_temp(f);
+    IrValue scaled = ir_temp(f);
+    IrValue result = ir_temp(f);
+#ifdef FIXED_POINT
+    IrValue product = ir_temp(f);
+    add_fmt_string(f->str,
+                   "  %s = sub i32 %s, %s\n"
+                   "  %s = mul i32 %s, %s\n"
+                   "  %s = ashr i32 %s, %d\n"
+                   "  %s = add i32 %s, %s\n",
+                   diff.name, y.name, x.name, product.name, a.name, diff.name,
+                   scaled.name, product.name, FIXED_POINT_BITS, result.name,
+                   x.name, scaled.name);
+#else   // !FIXED_POINT
+    add_fmt_string(f->str,
+                   "  %s = fsub float %s, %s\n"
+                   "  %s = fmul float %s, %s\n"
+                   "  %s = fadd float %s, %s\n",
+                   diff.name, y.name, x.name, scaled.name, a.name, diff.name,
+                   result.name, x.name, scaled.name);
+#endif  // FIXED_POINT
+    return result;
+}
+
+// Same as GET_COL()
+static IrValue ir_col(IrFunction* f, const IrValue* channels) {
+    IrValue col = ir_named("-16777216");  // 0xFF000000
+    for (int c = 0; c < 3; ++c) {
+        IrValue value = channels[c];
+#ifndef FIXED_POINT
+        value = ir_temp(f);
+        add_fmt_string(f->str, "  %s = fptoui float %s to i32\n", value.name,
+                       channels[c].name);
+#endif  // FIXED_POINT
+        if (c < 2) {
+            IrValue shifted = ir_temp(f);
+            add_fmt_string(f->str, "  %s = shl i32 %s, %d\n", shifted.name,
+                           value.name, 8 * (2 - c));
+            value = shifted;
+        }
+        IrValue merged = ir_temp(f);
+        add_fmt_string(f->str, "  %s = or i32 %s, %s\n", merged.name,
+                       col.name, value.name);
+        col = merged;
+    }
+    return col;
+}
+
+static IrValue ir_blend(IrFunction* f, IrValue p0, IrValue p1, IrValue a) {
+    IrValue channels[3];
+    for (int c = 0; c < 3; ++c) {
+        channels[c] =
+            ir_mix(f, ir_channel(f, p0, c), ir_channel(f, p1, c), a);
+    }
+    return ir_col(f, channels);
+}
+
+static IrValue ir_blend4(IrFunction* f, IrValue p0, IrValue p1, IrValue p2,
+                         IrValue p3, IrValue a, IrValue b) {
+    IrValue channels[3];
+    for (int c = 0; c < 3; ++c) {
+        channels[c] = ir_mix(
+            f, ir_mix(f, ir_channel(f, p0, c), ir_channel(f, p1, c), a),
+            ir_mix(f, ir_channel(f, p2, c), ir_channel(f, p3, c), a), b);
+    }
+    return ir_col(f, channels);
+}
+
+// Loads a pointer from the alloca `addr`.
+static IrValue ir_load_ptr(IrFunction* f, const char* addr) {
+    IrValue result = ir_temp(f);
+    add_fmt_string(f->str, "  %s = load i32*, i32** %s, align 8\n",
+                   result.name, addr);
+    return result;
+}
+
+// Advances the pointer in the alloca `addr` by `count` elements.
+static void ir_advance_ptr(IrFunction* f, const char* addr,
+                           int64_t count) {
+    IrValue ptr = ir_load_ptr(f, addr);
+    IrValue next = ir_gep(f, ptr, count);
+    add_fmt_string(f->str, "  store i32* %s, i32** %s, align 8\n", next.name,
+                   addr);
+}
+
+// Starts a loop with the alloca %c.addr as counter. The body runs at least
+// once, ir_loop_end() gives the number of iterations.
+static void ir_loop_begin(IrFunction* f) {
+    add_string(f->str,
+               "  store i32 0, i32* %c.addr, align 4\n"
+               "  br label %loop\n"
+               "loop:\n");
+}
+
+static void ir_loop_end(IrFunction* f, int count) {
+    IrValue c = ir_temp(f);
+    IrValue next = ir_temp(f);
+    IrValue done = ir_temp(f);
+    add_fmt_string(f->str,
+                   "  %s = load i32, i32* %%c.addr, align 4\n"
+                   "  %s = add i32 %s, 1\n"
+                   "  store i32 %s, i32* %%c.addr, align 4\n"
+                   "  %s = icmp eq i32 %s, %d\n"
+                   "  br i1 %s, label %%loop.end, label %%loop\n"
+                   "loop.end:\n",
+                   c.name, next.name, c.name, next.name, done.name, next.name,
+                   count, done.name);
+}
+
+// Emits `count` center pixels starting at center column `first`, with input
+// columns relative to `src_base`, from the pointers in %p0.addr and %p1.addr
+// to the one in %o.addr.
+static void ir_pixels(IrFunction* f, const PixelAAContext* ctx, int first,
+                      int count, int src_base, int vertical, IrValue w) {
+    if (count <= 0) {
+        return;
+    }
+    const int32_t* src_x = ctx->src_x + ctx->border_x;
+    const weight_t* weights_x = ctx->weights_x + ctx->border_x;
+    IrValue p0 = ir_load_ptr(f, "%p0.addr");
+    IrValue p1 = vertical ? ir_load_ptr(f, "%p1.addr") : p0;
+    IrValue o = ir_load_ptr(f, "%o.addr");
+    for (int x = 0; x < count; ++x) {
+        const int src = src_x[first + x] - src_base;
+        const weight_t weight_x = weights_x[first + x];
+        IrValue col;
+        if (weight_x < WEIGHT_TOL || weight_x > WEIGHT_TOL_UPPER) {
+            // Need 1 sample per row
+            const int sample = weight_x < WEIGHT_TOL ? src : src + 1;
+            col = ir_load(f, p0, sample);
+            if (vertical) {
+                col = ir_blend(f, col, ir_load(f, p1, sample), w);
+            }
+        } else if (!vertical) {
+            // Need 2 samples, mix with weight_x
+            col = ir_blend(f, ir_load(f, p0, src), ir_load(f, p0, src + 1),
+                           ir_weight(weight_x));
+        } else {
+            // Need 4 samples, mix with weight_x and w
+            col = ir_blend4(f, ir_load(f, p0, src), ir_load(f, p0, src + 1),
+                            ir_load(f, p1, src), ir_load(f, p1, src + 1),
+                            ir_weight(weight_x), w);
+        }
+        ir_store(f, col, o, x);
+    }
+}
+
+static void ir_row_function(DynamicString* str, const PixelAAContext* ctx,
+                            int vertical) {
+    const int in_width = ctx->in_width;
+    const int out_width = ctx->out_width;
+    const int border_x = ctx->border_x;
+    IrFunction f = {str, 0};
+    const IrValue r0 = ir_named("%r0");
+    const IrValue r1 = ir_named("%r1");
+    const IrValue out = ir_named("%out");
+    const IrValue w = ir_named("%w");
+
+    if (vertical) {
+        add_string(str,
+                   "define internal void @row_xy(i32* noalias %r0, "
+                   "i32* noalias %r1, " IR_WEIGHT_TYPE
+                   " %w, i32* noalias %out) {\n");
+    } else {
+        add_string(str,
+                   "define internal void @row_x(i32* noalias %r0, "
+                   "i32* noalias %out) {\n");
+    }
+    add_string(str,
+               "entry:\n"
+               "  %p0.addr = alloca i32*, align 8\n"
+               "  %p1.addr = alloca i32*, align 8\n"
+               "  %o.addr = alloca i32*, align 8\n"
+               "  %c.addr = alloca i32, align 4\n");
+
+    // Left and right border
+    if (border_x > 0) {
+        IrValue first = ir_load(&f, r0, 0);
+        IrValue last = ir_load(&f, r0, in_width - 1);
+        if (vertical) {
+            first = ir_blend(&f, first, ir_load(&f, r1, 0), w);
+            last = ir_blend(&f, last, ir_load(&f, r1, in_width - 1), w);
+        }
+        for (int x = 0; x < border_x; ++x) {
+            ir_store(&f, first, out, x);
+        }
+        for (int x = out_width - border_x; x < out_width; ++x) {
+            ir_store(&f, last, out, x);
+        }
+    }
+
+    ColumnPlan plan;
+    kernel_gen_plan_columns(ctx, &plan);
+    if (plan.center_width > 0) {
+        // Prologue
+        add_string(str, "  store i32* %r0, i32** %p0.addr, align 8\n");
+        if (vertical) {
+            add_string(str, "  store i32* %r1, i32** %p1.addr, align 8\n");
+        }
+        IrValue center = ir_gep(&f, out, border_x);
+        add_fmt_string(str, "  store i32* %s, i32** %%o.addr, align 8\n",
+                       center.name);
+        ir_pixels(&f, ctx, 0, plan.prologue_width, 0, vertical, w);
+        ir_advance_ptr(&f, "%o.addr", plan.prologue_width);
+        ir_advance_ptr(&f, "%p0.addr", plan.cycle_src);
+        if (vertical) {
+            ir_advance_ptr(&f, "%p1.addr", plan.cycle_src);
+        }
+
+        // Cycles
+        if (plan.num_cycles > 0) {
+            ir_loop_begin(&f);
+            ir_pixels(&f, ctx, plan.prologue_width, plan.cycle_length,
+                      plan.cycle_src, vertical, w);
+            ir_advance_ptr(&f, "%o.addr", plan.cycle_length);
+            ir_advance_ptr(&f, "%p0.addr", plan.in_advance);
+            if (vertical) {
+                ir_advance_ptr(&f, "%p1.addr", plan.in_advance);
+            }
+            ir_loop_end(&f, plan.num_cycles);
+        }
+
+        // Tail
+        ir_pixels(&f, ctx, plan.tail_start,
+                  plan.center_width - plan.tail_start, plan.tail_src,
+                  vertical, w);
+    }
+    add_string(str,
+               "  ret void\n"
+               "}\n");
+}
+
+// Emits output rows [first, first + count), with input rows relative to
+// `sample_base`, from the pointer in %in.addr to the one in %out.addr.
+static void ir_rows(IrFunction* f, const PixelAAContext* ctx,
+                    const RowDesc* rows, int first, int count,
+                    int sample_base) {
+    if (count <= 0) {
+        return;
+    }
+    const int in_width = ctx->in_width;
+    const int out_width = ctx->out_width;
+    IrValue in = ir_load_ptr(f, "%in.addr");
+    IrValue out = ir_load_ptr(f, "%out.addr");
+    for (int y = 0; y < count; ++y) {
+        const RowDesc* row = &rows[first + y];
+        const int sample = row->sample - sample_base;
+        IrValue out_row = ir_gep(f, out, (int64_t)y * out_width);
+        switch (row->kind) {
+            case ROW_COPY: {
+                IrValue prev_row = ir_gep(f, out, (int64_t)(y - 1) * out_width);
+                IrValue dst = ir_temp(f);
+                IrValue src = ir_temp(f);
+                add_fmt_string(
+                    f->str,
+                    "  %s = bitcast i32* %s to i8*\n"
+                    "  %s = bitcast i32* %s to i8*\n"
+                    "  call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 4 %s, "
+                    "i8* align 4 %s, i64 %d, i1 false)\n",
+                    dst.name, out_row.name, src.name, prev_row.name, dst.name,
+                    src.name, out_width * 4);
+                break;
+            }
+            case ROW_X: {
+                IrValue in_row = ir_gep(f, in, (int64_t)sample * in_width);
+                add_fmt_string(f->str, "  call void @row_x(i32* %s, i32* %s)\n",
+                               in_row.name, out_row.name);
+                break;
+            }
+            case ROW_XY: {
+                IrValue in_row0 = ir_gep(f, in, (int64_t)sample * in_width);
+                IrValue in_row1 =
+                    ir_gep(f, in, (int64_t)(sample + 1) * in_width);
+                add_fmt_string(f->str,
+                               "  call void @row_xy(i32* %s, i32* %s, "
+                               "" IR_WEIGHT_TYPE " %s, i32* %s)\n",
+                               in_row0.name, in_row1.name,
+                               ir_weight(row->weight).name, out_row.name);
+                break;
+            }
+        }
+    }
+}
+
+char* pixel_aa_generate_kernel_ir(const PixelAAContext* ctx,
+                                  const char* name) {
+    RowPlan plan;
+    if (kernel_gen_plan_rows(ctx, &plan) != 0) {
+        return NULL;
+    }
+
+    DynamicString str;
+    init(&str);
+    add_string(&str,
+               "declare void @llvm.memcpy.p0i8.p0i8.i64(i8*, i8*, i64, i1)\n");
+    if (plan.have_row_x) {
+        ir_row_function(&str, ctx, 0);
+    }
+    if (plan.have_row_xy) {
+        ir_row_function(&str, ctx, 1);
+    }
+
+    IrFunction f = {&str, 0};
+    add_fmt_string(&str,
+                   "define void @%s(i32* noalias %%in, i32* noalias %%out) {\n"
+                   "entry:\n"
+                   "  %%in.addr = alloca i32*, align 8\n"
+                   "  %%out.addr = alloca i32*, align 8\n"
+                   "  %%c.addr = alloca i32, align 4\n"
+                   "  store i32* %%in, i32** %%in.addr, align 8\n"
+                   "  store i32* %%out, i32** %%out.addr, align 8\n",
+                   name);
+
+    // Prologue
+    ir_rows(&f, ctx, plan.rows, 0, plan.prologue_height, 0);
+    ir_advance_ptr(&f, "%in.addr",
+                   (int64_t)plan.cycle_sample * ctx->in_width);
+    ir_advance_ptr(&f, "%out.addr",
+                   (int64_t)plan.prologue_height * ctx->out_width);
+
+    // Cycles
+    if (plan.num_cycles > 0) {
+        ir_loop_begin(&f);
+        ir_rows(&f, ctx, plan.rows, plan.prologue_height, plan.cycle_length,
+                plan.cycle_sample);
+        ir_advance_ptr(&f, "%in.addr",
+                       (int64_t)plan.in_advance * ctx->in_width);
+        ir_advance_ptr(&f, "%out.addr",
+                       (int64_t)plan.cycle_length * ctx->out_width);
+        ir_loop_end(&f, plan.num_cycles);
+    }
+
+    // Tail
+    ir_rows(&f, ctx, plan.rows, plan.tail_start,
+            ctx->out_height - plan.tail_start, plan.tail_sample);
+    add_string(&str,
+               "  ret void\n"
+               "}\n");
+
+    free(plan.rows);
+    return str.str;
+}
@@ -0,0 +1,378 @@
+#include "pixel_aa_internal.h"
+
+#ifdef PIXEL_AA_HAVE_AVX2
+#include <immintrin.h>
+
+// 8 RGB565 pixels in the low halves of 32 bit lanes to 0xAARRGGBB.
+static inline __m256i widen_565(__m256i p) {
+    const __m256i mask_5 = _mm256_set1_epi32(0x1F);
+    __m256i r = _mm256_and_si256(_mm256_srli_epi32(p, 11), mask_5);
+    __m256i g =
+        _mm256_and_si256(_mm256_srli_epi32(p, 5), _mm256_set1_epi32(0x3F));
+    __m256i b = _mm256_and_si256(p, mask_5);
+    r = _mm256_or_si256(_mm256_slli_epi32(r, 3), _mm256_srli_epi32(r, 2));
+    g = _mm256_or_si256(_mm256_slli_epi32(g, 2), _mm256_srli_epi32(g, 4));
+    b = _mm256_or_si256(_mm256_slli_epi32(b, 3), _mm256_srli_epi32(b, 2));
+    return _mm256_or_si256(
+        _mm256_or_si256(_mm256_slli_epi32(r, 16), _mm256_slli_epi32(g, 8)),
+        _mm256_or_si256(b, _mm256_set1_epi32((int)0xFF000000)));
+}
+
+// Pixels loaded as 32 bit lanes in one of the 32 bit layouts to 0xAARRGGBB.
+PIXEL_AA_ALWAYS_INLINE __m256i unpack_8(__m256i p, int layout) {
+    if (layout == LAYOUT_SWAPPED) {
+        return _mm256_shuffle_epi8(
+            p, _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14,
+                                13, 12, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8,
+                                15, 14, 13, 12));
+    }
+    if (layout == LAYOUT_ALPHA_LOW) {
+        return _mm256_or_si256(_mm256_srli_epi32(p, 8),
+                               _mm256_slli_epi32(p, 24));
+    }
+    return p;
+}
+
+// Pixels i, ..., i + 7 of a row as 0xAARRGGBB.
+PIXEL_AA_ALWAYS_INLINE __m256i load_8(const void* row, int i, int layout) {
+    if (layout == LAYOUT_RGB565) {
+        return widen_565(_mm256_cvtepu16_epi32(
+            _mm_loadu_si128((const __m128i*)((const uint16_t*)row + i))));
+    }
+    return unpack_8(
+        _mm256_loadu_si256((const __m256i*)((const uint32_t*)row + i)),
+        layout);
+}
+
+// Pixels src_x[0] + offset, ..., src_x[7] + offset of a row as 0xAARRGGBB.
+// RGB565 rows are gathered one by one, a 32 bit gather could read past the
+// end of the image.
+PIXEL_AA_ALWAYS_INLINE __m256i gather_8(const void* row, const int32_t* src_x,
+                                        int offset, int layout) {
+    if (layout == LAYOUT_RGB565) {
+        const uint16_t* row16 = (const uint16_t*)row + offset;
+        return widen_565(_mm256_set_epi32(
+            row16[src_x[7]], row16[src_x[6]], row16[src_x[5]], row16[src_x[4]],
+            row16[src_x[3]], row16[src_x[2]], row16[src_x[1]],
+            row16[src_x[0]]));
+    }
+    return unpack_8(_mm256_i32gather_epi32(
+                        (const int*)row + offset,
+                        _mm256_loadu_si256((const __m256i*)src_x), 4),
+                    layout);
+}
+
+// Stores 8 pixels given as 0xAARRGGBB to pixels i, ..., i + 7 of a row.
+PIXEL_AA_ALWAYS_INLINE void store_8(void* row, int i, __m256i col,
+                                    int layout) {
+    if (layout == LAYOUT_RGB565) {
+        __m256i p = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(col, 8),
+                                             _mm256_set1_epi32(0xF800)),
+                            _mm256_and_si256(_mm256_srli_epi32(col, 5),
+                                             _mm256_set1_epi32(0x07E0))),
+            _mm256_and_si256(_mm256_srli_epi32(col, 3),
+                             _mm256_set1_epi32(0x001F)));
+        // Sign extend, so that the saturating pack keeps all 16 bits. It
+        // packs within 128 bit lanes, so pixels 4 - 7 end up in the third
+        // quarter.
+        p = _mm256_srai_epi32(_mm256_slli_epi32(p, 16), 16);
+        p = _mm256_permute4x64_epi64(_mm256_packs_epi32(p, p),
+                                     _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)((uint16_t*)row + i),
+                         _mm256_castsi256_si128(p));
+        return;
+    }
+    if (layout == LAYOUT_SWAPPED) {
+        // Reversing the bytes is its own inverse.
+        col = unpack_8(col, layout);
+    } else if (layout == LAYOUT_ALPHA_LOW) {
+        col = _mm256_or_si256(_mm256_slli_epi32(col, 8),
+                              _mm256_srli_epi32(col, 24));
+    }
+    _mm256_storeu_si256((__m256i*)((uint32_t*)row + i), col);
+}
+
+#ifdef FIXED_POINT
+// Same as the SSE2 kernels, on 4 pixels per register. Unpacking works within
+// 128 bit lanes, so lo holds pixels 0, 1, 4, 5 and hi pixels 2, 3, 6, 7.
+static inline __m256i mix_epu16(__m256i x, __m256i y, __m256i a) {
+    const __m256i inv_a = _mm256_sub_epi16(_mm256_set1_epi16(WEIGHT_ONE), a);
+    return _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(x, inv_a),
+                                              _mm256_mullo_epi16(y, a)),
+                             FIXED_POINT_BITS);
+}
+
+// Weights of 8 pixels, each repeated for the 4 channels of its pixel, in the
+// order of the unpacked pixels.
+static inline void load_weights_8(const weight_t* weights, __m256i* lo,
+                                  __m256i* hi) {
+    __m256i w = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)weights));
+    w = _mm256_or_si256(w, _mm256_slli_epi32(w, 16));
+    *lo = _mm256_unpacklo_epi32(w, w);
+    *hi = _mm256_unpackhi_epi32(w, w);
+}
+
+static inline __m256i pack_8(__m256i lo, __m256i hi) {
+    return _mm256_or_si256(_mm256_packus_epi16(lo, hi),
+                           _mm256_set1_epi32((int)0xFF000000));
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_x_row_avx2(const void* row,
+                                             const int32_t* src_x,
+                                             const weight_t* weights_x,
+                                             void* out, int count,
+                                             int in_layout, int out_layout) {
+    const __m256i zero = _mm256_setzero_si256();
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const __m256i p0 = gather_8(row, src_x + x, 0, in_layout);
+        const __m256i p1 = gather_8(row, src_x + x, 1, in_layout);
+        __m256i offset_lo, offset_hi;
+        load_weights_8(weights_x + x, &offset_lo, &offset_hi);
+        const __m256i lo =
+            mix_epu16(_mm256_unpacklo_epi8(p0, zero),
+                      _mm256_unpacklo_epi8(p1, zero), offset_lo);
+        const __m256i hi =
+            mix_epu16(_mm256_unpackhi_epi8(p0, zero),
+                      _mm256_unpackhi_epi8(p1, zero), offset_hi);
+        store_8(out, x, pack_8(lo, hi), out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_x_row(
+        row, src_x + x, weights_x + x, pixel_offset_mut(out, x, out_layout),
+        count - x);
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_y_row_avx2(const void* row0,
+                                             const void* row1,
+                                             weight_t weight_y, void* out,
+                                             int count, int in_layout,
+                                             int out_layout) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i offset_y = _mm256_set1_epi16(weight_y);
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const __m256i p0 = load_8(row0, x, in_layout);
+        const __m256i p1 = load_8(row1, x, in_layout);
+        const __m256i lo =
+            mix_epu16(_mm256_unpacklo_epi8(p0, zero),
+                      _mm256_unpacklo_epi8(p1, zero), offset_y);
+        const __m256i hi =
+            mix_epu16(_mm256_unpackhi_epi8(p0, zero),
+                      _mm256_unpackhi_epi8(p1, zero), offset_y);
+        store_8(out, x, pack_8(lo, hi), out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_y_row(
+        pixel_offset(row0, x, in_layout), pixel_offset(row1, x, in_layout),
+        weight_y, pixel_offset_mut(out, x, out_layout), count - x);
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_xy_row_avx2(
+    const void* row0, const void* row1, const int32_t* src_x,
+    const weight_t* weights_x, weight_t weight_y, void* out, int count,
+    int in_layout, int out_layout) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i offset_y = _mm256_set1_epi16(weight_y);
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const __m256i p0 = gather_8(row0, src_x + x, 0, in_layout);
+        const __m256i p1 = gather_8(row0, src_x + x, 1, in_layout);
+        const __m256i p2 = gather_8(row1, src_x + x, 0, in_layout);
+        const __m256i p3 = gather_8(row1, src_x + x, 1, in_layout);
+        __m256i offset_lo, offset_hi;
+        load_weights_8(weights_x + x, &offset_lo, &offset_hi);
+        const __m256i top_lo =
+            mix_epu16(_mm256_unpacklo_epi8(p0, zero),
+                      _mm256_unpacklo_epi8(p1, zero), offset_lo);
+        const __m256i top_hi =
+            mix_epu16(_mm256_unpackhi_epi8(p0, zero),
+                      _mm256_unpackhi_epi8(p1, zero), offset_hi);
+        const __m256i bottom_lo =
+            mix_epu16(_mm256_unpacklo_epi8(p2, zero),
+                      _mm256_unpacklo_epi8(p3, zero), offset_lo);
+        const __m256i bottom_hi =
+            mix_epu16(_mm256_unpackhi_epi8(p2, zero),
+                      _mm256_unpackhi_epi8(p3, zero), offset_hi);
+        store_8(out, x,
+                pack_8(mix_epu16(top_lo, bottom_lo, offset_y),
+                       mix_epu16(top_hi, bottom_hi, offset_y)),
+                out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_xy_row(
+        row0, row1, src_x + x, weights_x + x, weight_y,
+        pixel_offset_mut(out, x, out_layout), count - x);
+}
+#else  // !FIXED_POINT
+// Channel c of 8 packed pixels as floats
+#define CH_PS(pixels, c)                                      \
+    _mm256_cvtepi32_ps(_mm256_and_si256(                      \
+        _mm256_srli_epi32((pixels), 8 * (2 - (c))), _mm256_set1_epi32(0xFF)))
+
+static inline __m256 mix_ps(__m256 x, __m256 y, __m256 a) {
+    return _mm256_add_ps(x, _mm256_mul_ps(a, _mm256_sub_ps(y, x)));
+}
+
+// Channel c of 8 output pixels from samples p0..p3
+#define BILINEAR_PS(c)                                   \
+    mix_ps(mix_ps(CH_PS(p0, c), CH_PS(p1, c), offset_x), \
+           mix_ps(CH_PS(p2, c), CH_PS(p3, c), offset_x), offset_y)
+
+static inline __m256i get_col_8(__m256 r, __m256 g, __m256 b) {
+    __m256i col =
+        _mm256_or_si256(_mm256_slli_epi32(_mm256_cvttps_epi32(r), 16),
+                        _mm256_slli_epi32(_mm256_cvttps_epi32(g), 8));
+    col = _mm256_or_si256(col, _mm256_cvttps_epi32(b));
+    return _mm256_or_si256(col, _mm256_set1_epi32((int)0xFF000000));
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_x_row_avx2(const void* row,
+                                             const int32_t* src_x,
+                                             const weight_t* weights_x,
+                                             void* out, int count,
+                                             int in_layout, int out_layout) {
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const __m256i p0 = gather_8(row, src_x + x, 0, in_layout);
+        const __m256i p1 = gather_8(row, src_x + x, 1, in_layout);
+        const __m256 offset_x = _mm256_loadu_ps(weights_x + x);
+        store_8(out, x,
+                get_col_8(mix_ps(CH_PS(p0, 0), CH_PS(p1, 0), offset_x),
+                          mix_ps(CH_PS(p0, 1), CH_PS(p1, 1), offset_x),
+                          mix_ps(CH_PS(p0, 2), CH_PS(p1, 2), offset_x)),
+                out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_x_row(
+        row, src_x + x, weights_x + x, pixel_offset_mut(out, x, out_layout),
+        count - x);
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_y_row_avx2(const void* row0,
+                                             const void* row1,
+                                             weight_t weight_y, void* out,
+                                             int count, int in_layout,
+                                             int out_layout) {
+    const __m256 offset_y = _mm256_set1_ps(weight_y);
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const __m256i p0 = load_8(row0, x, in_layout);
+        const __m256i p1 = load_8(row1, x, in_layout);
+        store_8(out, x,
+                get_col_8(mix_ps(CH_PS(p0, 0), CH_PS(p1, 0), offset_y),
+                          mix_ps(CH_PS(p0, 1), CH_PS(p1, 1), offset_y),
+                          mix_ps(CH_PS(p0, 2), CH_PS(p1, 2), offset_y)),
+                out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_y_row(
+        pixel_offset(row0, x, in_layout), pixel_offset(row1, x, in_layout),
+        weight_y, pixel_offset_mut(out, x, out_layout), count - x);
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_xy_row_avx2(
+    const void* row0, const void* row1, const int32_t* src_x,
+    const weight_t* weights_x, weight_t weight_y, void* out, int count,
+    int in_layout, int out_layout) {
+    const __m256 offset_y = _mm256_set1_ps(weight_y);
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const __m256i p0 = gather_8(row0, src_x + x, 0, in_layout);
+        const __m256i p1 = gather_8(row0, src_x + x, 1, in_layout);
+        const __m256i p2 = gather_8(row1, src_x + x, 0, in_layout);
+        const __m256i p3 = gather_8(row1, src_x + x, 1, in_layout);
+        const __m256 offset_x = _mm256_loadu_ps(weights_x + x);
+        store_8(out, x,
+                get_col_8(BILINEAR_PS(0), BILINEAR_PS(1), BILINEAR_PS(2)),
+                out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_xy_row(
+        row0, row1, src_x + x, weights_x + x, weight_y,
+        pixel_offset_mut(out, x, out_layout), count - x);
+}
+#endif  // FIXED_POINT
+
+// Adds the two pixels of a to each other and those of b within each 128 bit
+// lane, for pixels widened to 16 bits per channel.
+static inline __m256i add_pairs(__m256i a, __m256i b) {
+    return _mm256_add_epi16(_mm256_unpacklo_epi64(a, b),
+                            _mm256_unpackhi_epi64(a, b));
+}
+
+static inline __m256i round_shift(__m256i sums, int shift) {
+    return _mm256_srli_epi16(
+        _mm256_add_epi16(sums, _mm256_set1_epi16((1 << shift) >> 1)), shift);
+}
+
+static void reduce_2x2_row_avx2(const void* row, int stride, uint32_t alpha,
+                                void* out, int count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha_8 = _mm256_set1_epi32((int)alpha);
+    const uint8_t* row0 = (const uint8_t*)row;
+    const uint8_t* row1 = row0 + stride;
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        __m256i sums[2];
+        for (int i = 0; i < 2; ++i) {
+            const __m256i a =
+                _mm256_loadu_si256((const __m256i*)(row0 + x * 8 + i * 32));
+            const __m256i b =
+                _mm256_loadu_si256((const __m256i*)(row1 + x * 8 + i * 32));
+            // Input pixels 0, 1 | 4, 5 and 2, 3 | 6, 7, summed vertically
+            const __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero),
+                                                _mm256_unpacklo_epi8(b, zero));
+            const __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero),
+                                                _mm256_unpackhi_epi8(b, zero));
+            // Output pixels 0, 1 | 2, 3
+            sums[i] = round_shift(add_pairs(lo, hi), 2);
+        }
+        // Packed to output pixels 0, 1, 4, 5 | 2, 3, 6, 7, then reordered
+        const __m256i col = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(sums[0], sums[1]), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)((uint32_t*)out + x),
+                            _mm256_or_si256(col, alpha_8));
+    }
+    pixel_aa_kernels_scalar.reduce_2x2_row(row0 + x * 8, stride, alpha,
+                                           (uint32_t*)out + x, count - x);
+}
+
+static void reduce_4x4_row_avx2(const void* row, int stride, uint32_t alpha,
+                                void* out, int count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha_8 = _mm256_set1_epi32((int)alpha);
+    const uint8_t* src = (const uint8_t*)row;
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        // Output pixels 2 * i | 2 * i + 1 as two partial sums each: Input
+        // pixels 0 + 2 and 1 + 3 of the block, over all rows.
+        __m256i sums[4];
+        for (int i = 0; i < 4; ++i) {
+            sums[i] = zero;
+            for (int j = 0; j < 4; ++j) {
+                const __m256i p = _mm256_loadu_si256(
+                    (const __m256i*)(src + (intptr_t)j * stride +
+                                     (x + 2 * i) * 16));
+                sums[i] = _mm256_add_epi16(
+                    sums[i], _mm256_add_epi16(_mm256_unpacklo_epi8(p, zero),
+                                              _mm256_unpackhi_epi8(p, zero)));
+            }
+        }
+        // Output pixels 0, 2 | 1, 3 and 4, 6 | 5, 7, packed to
+        // 0, 2, 4, 6 | 1, 3, 5, 7
+        const __m256i col = _mm256_permutevar8x32_epi32(
+            _mm256_packus_epi16(round_shift(add_pairs(sums[0], sums[1]), 4),
+                                round_shift(add_pairs(sums[2], sums[3]), 4)),
+            _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        _mm256_storeu_si256((__m256i*)((uint32_t*)out + x),
+                            _mm256_or_si256(col, alpha_8));
+    }
+    pixel_aa_kernels_scalar.reduce_4x4_row(src + x * 16, stride, alpha,
+                                           (uint32_t*)out + x, count - x);
+}
+
+PIXEL_AA_DEFINE_ROW_KERNELS(avx2)
+
+const PixelAAKernels pixel_aa_kernels_avx2 = {
+    "avx2",
+    PIXEL_AA_ROW_KERNEL_TABLE(avx2),
+    reduce_2x2_row_avx2,
+    reduce_4x4_row_avx2,
+};
+#endif  // PIXEL_AA_HAVE_AVX2
@@ -0,0 +1,360 @@
+#include "pixel_aa_internal.h"
+
+#ifdef PIXEL_AA_HAVE_NEON
+#include <arm_neon.h>
+
+// 8 pixels at a time, split into one vector per byte of 0xAARRGGBB, with
+// val[2 - c] holding channel c of GET_CH and val[3] alpha.
+static inline uint8x8x4_t widen_565(uint16x8_t p) {
+    // Replicate the top bits of each field into the low bits it lacks.
+    const uint8x8_t r = vshrn_n_u16(p, 8);
+    const uint8x8_t g = vshrn_n_u16(p, 3);
+    const uint8x8_t b = vmovn_u16(vshlq_n_u16(p, 3));
+    uint8x8x4_t col;
+    col.val[0] = vsri_n_u8(b, b, 5);
+    col.val[1] = vsri_n_u8(g, g, 6);
+    col.val[2] = vsri_n_u8(r, r, 5);
+    col.val[3] = vdup_n_u8(0xFF);
+    return col;
+}
+
+// Moves the alpha byte of the alpha low layouts to the back.
+static inline uint8x8x4_t rotate_alpha(uint8x8x4_t p) {
+    uint8x8x4_t col;
+    col.val[0] = p.val[1];
+    col.val[1] = p.val[2];
+    col.val[2] = p.val[3];
+    col.val[3] = p.val[0];
+    return col;
+}
+
+// Reverses the bytes of the swapped layout. It's its own inverse.
+static inline uint8x8x4_t reverse_bytes(uint8x8x4_t p) {
+    uint8x8x4_t col;
+    col.val[0] = p.val[3];
+    col.val[1] = p.val[2];
+    col.val[2] = p.val[1];
+    col.val[3] = p.val[0];
+    return col;
+}
+
+PIXEL_AA_ALWAYS_INLINE uint8x8x4_t load_8(const void* row, int i,
+                                          int layout) {
+    if (layout == LAYOUT_RGB565) {
+        return widen_565(vld1q_u16((const uint16_t*)row + i));
+    }
+    const uint8x8x4_t p = vld4_u8((const uint8_t*)((const uint32_t*)row + i));
+    if (layout == LAYOUT_SWAPPED) {
+        return reverse_bytes(p);
+    }
+    return layout == LAYOUT_ALPHA_LOW ? rotate_alpha(p) : p;
+}
+
+PIXEL_AA_ALWAYS_INLINE uint8x8x4_t gather_8(const void* row,
+                                            const int32_t* src_x, int offset,
+                                            int layout) {
+    if (layout == LAYOUT_RGB565) {
+        const uint16_t* row16 = (const uint16_t*)row + offset;
+        uint16_t pixels[8];
+        for (int i = 0; i < 8; ++i) {
+            pixels[i] = row16[src_x[i]];
+        }
+        return widen_565(vld1q_u16(pixels));
+    }
+    const uint32_t* row32 = (const uint32_t*)row + offset;
+    uint32_t pixels[8];
+    for (int i = 0; i < 8; ++i) {
+        pixels[i] = row32[src_x[i]];
+    }
+    return load_8(pixels, 0, layout);
+}
+
+// Stores `col`, whose alpha is opaque.
+PIXEL_AA_ALWAYS_INLINE void store_8(void* row, int i, uint8x8x4_t col,
+                                    int layout) {
+    if (layout == LAYOUT_RGB565) {
+        uint16x8_t p = vshll_n_u8(col.val[2], 8);
+        p = vsriq_n_u16(p, vshll_n_u8(col.val[1], 8), 5);
+        p = vsriq_n_u16(p, vshll_n_u8(col.val[0], 8), 11);
+        vst1q_u16((uint16_t*)row + i, p);
+        return;
+    }
+    uint8_t* dst = (uint8_t*)((uint32_t*)row + i);
+    if (layout == LAYOUT_SWAPPED) {
+        vst4_u8(dst, reverse_bytes(col));
+        return;
+    }
+    if (layout == LAYOUT_ALPHA_LOW) {
+        uint8x8x4_t rotated;
+        rotated.val[0] = col.val[3];
+        rotated.val[1] = col.val[0];
+        rotated.val[2] = col.val[1];
+        rotated.val[3] = col.val[2];
+        vst4_u8(dst, rotated);
+        return;
+    }
+    vst4_u8(dst, col);
+}
+
+#ifdef FIXED_POINT
+// (x * (1 - a) + y * a) >> FIXED_POINT_BITS is the same as mix(), but never
+// leaves the unsigned 16 bit range for 8 bit x and y.
+static inline uint16x8_t mix_u16(uint16x8_t x, uint16x8_t y, uint16x8_t a) {
+    const uint16x8_t inv_a = vsubq_u16(vdupq_n_u16(WEIGHT_ONE), a);
+    return vshrq_n_u16(vmlaq_u16(vmulq_u16(x, inv_a), y, a),
+                       FIXED_POINT_BITS);
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_x_row_neon(const void* row,
+                                             const int32_t* src_x,
+                                             const weight_t* weights_x,
+                                             void* out, int count,
+                                             int in_layout, int out_layout) {
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const uint8x8x4_t p0 = gather_8(row, src_x + x, 0, in_layout);
+        const uint8x8x4_t p1 = gather_8(row, src_x + x, 1, in_layout);
+        const uint16x8_t offset_x =
+            vreinterpretq_u16_s16(vld1q_s16(weights_x + x));
+        uint8x8x4_t col;
+        for (int b = 0; b < 3; ++b) {
+            col.val[b] = vmovn_u16(mix_u16(vmovl_u8(p0.val[b]),
+                                           vmovl_u8(p1.val[b]), offset_x));
+        }
+        col.val[3] = vdup_n_u8(0xFF);
+        store_8(out, x, col, out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_x_row(
+        row, src_x + x, weights_x + x, pixel_offset_mut(out, x, out_layout),
+        count - x);
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_y_row_neon(const void* row0,
+                                             const void* row1,
+                                             weight_t weight_y, void* out,
+                                             int count, int in_layout,
+                                             int out_layout) {
+    const uint16x8_t offset_y = vdupq_n_u16((uint16_t)weight_y);
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const uint8x8x4_t p0 = load_8(row0, x, in_layout);
+        const uint8x8x4_t p1 = load_8(row1, x, in_layout);
+        uint8x8x4_t col;
+        for (int b = 0; b < 3; ++b) {
+            col.val[b] = vmovn_u16(mix_u16(vmovl_u8(p0.val[b]),
+                                           vmovl_u8(p1.val[b]), offset_y));
+        }
+        col.val[3] = vdup_n_u8(0xFF);
+        store_8(out, x, col, out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_y_row(
+        pixel_offset(row0, x, in_layout), pixel_offset(row1, x, in_layout),
+        weight_y, pixel_offset_mut(out, x, out_layout), count - x);
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_xy_row_neon(
+    const void* row0, const void* row1, const int32_t* src_x,
+    const weight_t* weights_x, weight_t weight_y, void* out, int count,
+    int in_layout, int out_layout) {
+    const uint16x8_t offset_y = vdupq_n_u16((uint16_t)weight_y);
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const uint8x8x4_t p0 = gather_8(row0, src_x + x, 0, in_layout);
+        const uint8x8x4_t p1 = gather_8(row0, src_x + x, 1, in_layout);
+        const uint8x8x4_t p2 = gather_8(row1, src_x + x, 0, in_layout);
+        const uint8x8x4_t p3 = gather_8(row1, src_x + x, 1, in_layout);
+        const uint16x8_t offset_x =
+            vreinterpretq_u16_s16(vld1q_s16(weights_x + x));
+        uint8x8x4_t col;
+        for (int b = 0; b < 3; ++b) {
+            const uint16x8_t top = mix_u16(vmovl_u8(p0.val[b]),
+                                           vmovl_u8(p1.val[b]), offset_x);
+            const uint16x8_t bottom = mix_u16(vmovl_u8(p2.val[b]),
+                                              vmovl_u8(p3.val[b]), offset_x);
+            col.val[b] = vmovn_u16(mix_u16(top, bottom, offset_y));
+        }
+        col.val[3] = vdup_n_u8(0xFF);
+        store_8(out, x, col, out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_xy_row(
+        row0, row1, src_x + x, weights_x + x, weight_y,
+        pixel_offset_mut(out, x, out_layout), count - x);
+}
+#else  // !FIXED_POINT
+static inline float32x4_t mix_f32(float32x4_t x, float32x4_t y,
+                                  float32x4_t a) {
+    return vaddq_f32(x, vmulq_f32(a, vsubq_f32(y, x)));
+}
+
+// Lower and upper 4 pixels of one channel as floats
+static inline float32x4_t lo_f32(uint8x8_t ch) {
+    return vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(ch))));
+}
+
+static inline float32x4_t hi_f32(uint8x8_t ch) {
+    return vcvtq_f32_u32(vmovl_u16(vget_high_u16(vmovl_u8(ch))));
+}
+
+// Truncates like the (uint32_t) cast in GET_COL.
+static inline uint8x8_t narrow_f32(float32x4_t lo, float32x4_t hi) {
+    return vmovn_u16(vcombine_u16(vmovn_u32(vcvtq_u32_f32(lo)),
+                                  vmovn_u32(vcvtq_u32_f32(hi))));
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_x_row_neon(const void* row,
+                                             const int32_t* src_x,
+                                             const weight_t* weights_x,
+                                             void* out, int count,
+                                             int in_layout, int out_layout) {
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const uint8x8x4_t p0 = gather_8(row, src_x + x, 0, in_layout);
+        const uint8x8x4_t p1 = gather_8(row, src_x + x, 1, in_layout);
+        const float32x4_t offset_x_lo = vld1q_f32(weights_x + x);
+        const float32x4_t offset_x_hi = vld1q_f32(weights_x + x + 4);
+        uint8x8x4_t col;
+        for (int b = 0; b < 3; ++b) {
+            col.val[b] = narrow_f32(
+                mix_f32(lo_f32(p0.val[b]), lo_f32(p1.val[b]), offset_x_lo),
+                mix_f32(hi_f32(p0.val[b]), hi_f32(p1.val[b]), offset_x_hi));
+        }
+        col.val[3] = vdup_n_u8(0xFF);
+        store_8(out, x, col, out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_x_row(
+        row, src_x + x, weights_x + x, pixel_offset_mut(out, x, out_layout),
+        count - x);
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_y_row_neon(const void* row0,
+                                             const void* row1,
+                                             weight_t weight_y, void* out,
+                                             int count, int in_layout,
+                                             int out_layout) {
+    const float32x4_t offset_y = vdupq_n_f32(weight_y);
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const uint8x8x4_t p0 = load_8(row0, x, in_layout);
+        const uint8x8x4_t p1 = load_8(row1, x, in_layout);
+        uint8x8x4_t col;
+        for (int b = 0; b < 3; ++b) {
+            col.val[b] = narrow_f32(
+                mix_f32(lo_f32(p0.val[b]), lo_f32(p1.val[b]), offset_y),
+                mix_f32(hi_f32(p0.val[b]), hi_f32(p1.val[b]), offset_y));
+        }
+        col.val[3] = vdup_n_u8(0xFF);
+        store_8(out, x, col, out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_y_row(
+        pixel_offset(row0, x, in_layout), pixel_offset(row1, x, in_layout),
+        weight_y, pixel_offset_mut(out, x, out_layout), count - x);
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_xy_row_neon(
+    const void* row0, const void* row1, const int32_t* src_x,
+    const weight_t* weights_x, weight_t weight_y, void* out, int count,
+    int in_layout, int out_layout) {
+    const float32x4_t offset_y = vdupq_n_f32(weight_y);
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const uint8x8x4_t p0 = gather_8(row0, src_x + x, 0, in_layout);
+        const uint8x8x4_t p1 = gather_8(row0, src_x + x, 1, in_layout);
+        const uint8x8x4_t p2 = gather_8(row1, src_x + x, 0, in_layout);
+        const uint8x8x4_t p3 = gather_8(row1, src_x + x, 1, in_layout);
+        const float32x4_t offset_x_lo = vld1q_f32(weights_x + x);
+        const float32x4_t offset_x_hi = vld1q_f32(weights_x + x + 4);
+        uint8x8x4_t col;
+        for (int b = 0; b < 3; ++b) {
+            const float32x4_t top_lo =
+                mix_f32(lo_f32(p0.val[b]), lo_f32(p1.val[b]), offset_x_lo);
+            const float32x4_t top_hi =
+                mix_f32(hi_f32(p0.val[b]), hi_f32(p1.val[b]), offset_x_hi);
+            const float32x4_t bottom_lo =
+                mix_f32(lo_f32(p2.val[b]), lo_f32(p3.val[b]), offset_x_lo);
+            const float32x4_t bottom_hi =
+                mix_f32(hi_f32(p2.val[b]), hi_f32(p3.val[b]), offset_x_hi);
+            col.val[b] = narrow_f32(mix_f32(top_lo, bottom_lo, offset_y),
+                                    mix_f32(top_hi, bottom_hi, offset_y));
+        }
+        col.val[3] = vdup_n_u8(0xFF);
+        store_8(out, x, col, out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_xy_row(
+        row0, row1, src_x + x, weights_x + x, weight_y,
+        pixel_offset_mut(out, x, out_layout), count - x);
+}
+#endif  // FIXED_POINT
+
+// Sets the alpha or padding byte of 8 pixels loaded with vld4. Byte b of the
+// vectors is byte b of the pixels in memory, ARM is little endian.
+static inline uint8x8x4_t set_alpha(uint8x8x4_t col, uint32_t alpha) {
+    for (int b = 0; b < 4; ++b) {
+        col.val[b] =
+            vorr_u8(col.val[b], vdup_n_u8((uint8_t)(alpha >> 8 * b)));
+    }
+    return col;
+}
+
+static void reduce_2x2_row_neon(const void* row, int stride, uint32_t alpha,
+                                void* out, int count) {
+    const uint8_t* row0 = (const uint8_t*)row;
+    const uint8_t* row1 = row0 + stride;
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const uint8x16x4_t a = vld4q_u8(row0 + x * 8);
+        const uint8x16x4_t b = vld4q_u8(row1 + x * 8);
+        uint8x8x4_t col;
+        for (int c = 0; c < 4; ++c) {
+            // Pairs of horizontally adjacent bytes of both rows
+            const uint16x8_t sums = vpadalq_u8(vpaddlq_u8(a.val[c]), b.val[c]);
+            col.val[c] = vrshrn_n_u16(sums, 2);
+        }
+        vst4_u8((uint8_t*)((uint32_t*)out + x), set_alpha(col, alpha));
+    }
+    pixel_aa_kernels_scalar.reduce_2x2_row(row0 + x * 8, stride, alpha,
+                                           (uint32_t*)out + x, count - x);
+}
+
+static void reduce_4x4_row_neon(const void* row, int stride, uint32_t alpha,
+                                void* out, int count) {
+    const uint8_t* src = (const uint8_t*)row;
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        // Sums of 2 x 4 pixels, of output pixels 0 - 3 and 4 - 7
+        uint16x8_t sums0[4];
+        uint16x8_t sums1[4];
+        for (int c = 0; c < 4; ++c) {
+            sums0[c] = vdupq_n_u16(0);
+            sums1[c] = vdupq_n_u16(0);
+        }
+        for (int j = 0; j < 4; ++j) {
+            const uint8_t* p = src + (intptr_t)j * stride + x * 16;
+            const uint8x16x4_t p0 = vld4q_u8(p);
+            const uint8x16x4_t p1 = vld4q_u8(p + 64);
+            for (int c = 0; c < 4; ++c) {
+                sums0[c] = vpadalq_u8(sums0[c], p0.val[c]);
+                sums1[c] = vpadalq_u8(sums1[c], p1.val[c]);
+            }
+        }
+        uint8x8x4_t col;
+        for (int c = 0; c < 4; ++c) {
+            const uint16x8_t sums = vcombine_u16(
+                vpadd_u16(vget_low_u16(sums0[c]), vget_high_u16(sums0[c])),
+                vpadd_u16(vget_low_u16(sums1[c]), vget_high_u16(sums1[c])));
+            col.val[c] = vrshrn_n_u16(sums, 4);
+        }
+        vst4_u8((uint8_t*)((uint32_t*)out + x), set_alpha(col, alpha));
+    }
+    pixel_aa_kernels_scalar.reduce_4x4_row(src + x * 16, stride, alpha,
+                                           (uint32_t*)out + x, count - x);
+}
+
+PIXEL_AA_DEFINE_ROW_KERNELS(neon)
+
+const PixelAAKernels pixel_aa_kernels_neon = {
+    "neon",
+    PIXEL_AA_ROW_KERNEL_TABLE(neon),
+    reduce_2x2_row_neon,
+    reduce_4x4_row_neon,
+};
+#endif  // PIXEL_AA_HAVE_NEON
@@ -0,0 +1,126 @@
+#include "pixel_aa_internal.h"
+
+PIXEL_AA_ALWAYS_INLINE void blend_x_row_scalar(const void* row,
+                                               const int32_t* src_x,
+                                               const weight_t* weights_x,
+                                               void* out, int count,
+                                               int in_layout, int out_layout) {
+    for (int x = 0; x < count; ++x) {
+        const weight_t offset_x = weights_x[x];
+        if (offset_x < WEIGHT_TOL) {
+            // Need 1 sample, no mixing
+            store_pixel(out, x, load_pixel(row, src_x[x], in_layout),
+                        out_layout);
+        } else if (offset_x > WEIGHT_TOL_UPPER) {
+            // Need 1 sample, no mixing
+            store_pixel(out, x, load_pixel(row, src_x[x] + 1, in_layout),
+                        out_layout);
+        } else {
+            // Need 2 samples, mix with offset_x
+            const uint32_t in[2] = {load_pixel(row, src_x[x], in_layout),
+                                    load_pixel(row, src_x[x] + 1, in_layout)};
+            store_pixel(out, x,
+                        GET_COL(mix(GET_CH(in[0], 0), GET_CH(in[1], 0),
+                                    offset_x),
+                                mix(GET_CH(in[0], 1), GET_CH(in[1], 1),
+                                    offset_x),
+                                mix(GET_CH(in[0], 2), GET_CH(in[1], 2),
+                                    offset_x)),
+                        out_layout);
+        }
+    }
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_y_row_scalar(const void* row0,
+                                               const void* row1,
+                                               weight_t offset_y, void* out,
+                                               int count, int in_layout,
+                                               int out_layout) {
+    for (int x = 0; x < count; ++x) {
+        const uint32_t in[2] = {load_pixel(row0, x, in_layout),
+                                load_pixel(row1, x, in_layout)};
+        store_pixel(out, x,
+                    GET_COL(mix(GET_CH(in[0], 0), GET_CH(in[1], 0), offset_y),
+                            mix(GET_CH(in[0], 1), GET_CH(in[1], 1), offset_y),
+                            mix(GET_CH(in[0], 2), GET_CH(in[1], 2), offset_y)),
+                    out_layout);
+    }
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_xy_row_scalar(
+    const void* row0, const void* row1, const int32_t* src_x,
+    const weight_t* weights_x, weight_t offset_y, void* out, int count,
+    int in_layout, int out_layout) {
+    for (int x = 0; x < count; ++x) {
+        const weight_t offset_x = weights_x[x];
+        uint32_t col;
+        if (offset_x < WEIGHT_TOL || offset_x > WEIGHT_TOL_UPPER) {
+            // Need 2 samples, mix with offset_y
+            const int sample = offset_x < WEIGHT_TOL ? src_x[x] : src_x[x] + 1;
+            const uint32_t in[2] = {load_pixel(row0, sample, in_layout),
+                                    load_pixel(row1, sample, in_layout)};
+            col = GET_COL(mix(GET_CH(in[0], 0), GET_CH(in[1], 0), offset_y),
+                          mix(GET_CH(in[0], 1), GET_CH(in[1], 1), offset_y),
+                          mix(GET_CH(in[0], 2), GET_CH(in[1], 2), offset_y));
+        } else {
+            // Need 4 samples, mix with offset_x and offset_y
+            const uint32_t in[4] = {load_pixel(row0, src_x[x], in_layout),
+                                    load_pixel(row0, src_x[x] + 1, in_layout),
+                                    load_pixel(row1, src_x[x], in_layout),
+                                    load_pixel(row1, src_x[x] + 1, in_layout)};
+            col = GET_COL(
+                mix(mix(GET_CH(in[0], 0), GET_CH(in[1], 0), offset_x),
+                    mix(GET_CH(in[2], 0), GET_CH(in[3], 0), offset_x),
+                    offset_y),
+                mix(mix(GET_CH(in[0], 1), GET_CH(in[1], 1), offset_x),
+                    mix(GET_CH(in[2], 1), GET_CH(in[3], 1), offset_x),
+                    offset_y),
+                mix(mix(GET_CH(in[0], 2), GET_CH(in[1], 2), offset_x),
+                    mix(GET_CH(in[2], 2), GET_CH(in[3], 2), offset_x),
+                    offset_y));
+        }
+        store_pixel(out, x, col, out_layout);
+    }
+}
+
+// All four bytes of a pixel are averaged the same way, so their order
+// doesn't matter.
+PIXEL_AA_ALWAYS_INLINE void reduce_row_scalar(const void* row, int stride,
+                                              uint32_t alpha, void* out,
+                                              int count, int factor) {
+    for (int x = 0; x < count; ++x) {
+        uint32_t sums[4] = {0, 0, 0, 0};
+        for (int j = 0; j < factor; ++j) {
+            const uint8_t* block =
+                (const uint8_t*)row_offset(row, j, stride) + x * factor * 4;
+            for (int i = 0; i < factor * 4; ++i) {
+                sums[i & 3] += block[i];
+            }
+        }
+        uint8_t* dst = (uint8_t*)((uint32_t*)out + x);
+        for (int b = 0; b < 4; ++b) {
+            dst[b] = (uint8_t)((sums[b] + factor * factor / 2) /
+                               (factor * factor));
+        }
+        ((uint32_t*)out)[x] |= alpha;
+    }
+}
+
+static void reduce_2x2_row_scalar(const void* row, int stride, uint32_t alpha,
+                                  void* out, int count) {
+    reduce_row_scalar(row, stride, alpha, out, count, 2);
+}
+
+static void reduce_4x4_row_scalar(const void* row, int stride, uint32_t alpha,
+                                  void* out, int count) {
+    reduce_row_scalar(row, stride, alpha, out, count, 4);
+}
+
+PIXEL_AA_DEFINE_ROW_KERNELS(scalar)
+
+const PixelAAKernels pixel_aa_kernels_scalar = {
+    "scalar",
+    PIXEL_AA_ROW_KERNEL_TABLE(scalar),
+    reduce_2x2_row_scalar,
+    reduce_4x4_row_scalar,
+};
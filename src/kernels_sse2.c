@@ -0,0 +1,363 @@
+#include "pixel_aa_internal.h"
+
+#ifdef PIXEL_AA_HAVE_SSE2
+#include <emmintrin.h>
+
+// 4 RGB565 pixels in the low halves of 32 bit lanes to 0xAARRGGBB.
+static inline __m128i widen_565(__m128i p) {
+    const __m128i mask_5 = _mm_set1_epi32(0x1F);
+    __m128i r = _mm_and_si128(_mm_srli_epi32(p, 11), mask_5);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x3F));
+    __m128i b = _mm_and_si128(p, mask_5);
+    r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+    g = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 4));
+    b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+    return _mm_or_si128(
+        _mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(g, 8)),
+        _mm_or_si128(b, _mm_set1_epi32((int)0xFF000000)));
+}
+
+// Reverses the bytes of each 32 bit lane: Swaps the bytes of the 16 bit
+// halves, then the halves.
+static inline __m128i bswap_epi32(__m128i p) {
+    p = _mm_or_si128(_mm_slli_epi16(p, 8), _mm_srli_epi16(p, 8));
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(p, 0xB1), 0xB1);
+}
+
+// 4 pixels in the given layout, loaded as 32 bit lanes, to 0xAARRGGBB.
+PIXEL_AA_ALWAYS_INLINE __m128i unpack_4(__m128i p, int layout) {
+    if (layout == LAYOUT_RGB565) {
+        return widen_565(p);
+    }
+    if (layout == LAYOUT_SWAPPED) {
+        return bswap_epi32(p);
+    }
+    if (layout == LAYOUT_ALPHA_LOW) {
+        return _mm_or_si128(_mm_srli_epi32(p, 8), _mm_slli_epi32(p, 24));
+    }
+    return p;
+}
+
+// Pixels i, ..., i + 3 of a row.
+PIXEL_AA_ALWAYS_INLINE __m128i load_4(const void* row, int i, int layout) {
+    if (layout == LAYOUT_RGB565) {
+        return widen_565(_mm_unpacklo_epi16(
+            _mm_loadl_epi64((const __m128i*)((const uint16_t*)row + i)),
+            _mm_setzero_si128()));
+    }
+    return unpack_4(_mm_loadu_si128((const __m128i*)((const uint32_t*)row + i)),
+                    layout);
+}
+
+// Pixels src_x[0] + offset, ..., src_x[3] + offset of a row.
+PIXEL_AA_ALWAYS_INLINE __m128i gather_4(const void* row, const int32_t* src_x,
+                                        int offset, int layout) {
+    if (layout == LAYOUT_RGB565) {
+        const uint16_t* row16 = (const uint16_t*)row + offset;
+        return widen_565(_mm_set_epi32(row16[src_x[3]], row16[src_x[2]],
+                                       row16[src_x[1]], row16[src_x[0]]));
+    }
+    const uint32_t* row32 = (const uint32_t*)row + offset;
+    return unpack_4(_mm_set_epi32((int)row32[src_x[3]], (int)row32[src_x[2]],
+                                  (int)row32[src_x[1]], (int)row32[src_x[0]]),
+                    layout);
+}
+
+// Stores 4 pixels given as 0xAARRGGBB to pixels i, ..., i + 3 of a row.
+PIXEL_AA_ALWAYS_INLINE void store_4(void* row, int i, __m128i col,
+                                    int layout) {
+    if (layout == LAYOUT_RGB565) {
+        __m128i p = _mm_or_si128(
+            _mm_or_si128(
+                _mm_and_si128(_mm_srli_epi32(col, 8), _mm_set1_epi32(0xF800)),
+                _mm_and_si128(_mm_srli_epi32(col, 5), _mm_set1_epi32(0x07E0))),
+            _mm_and_si128(_mm_srli_epi32(col, 3), _mm_set1_epi32(0x001F)));
+        // Sign extend, so that the saturating pack keeps all 16 bits.
+        p = _mm_srai_epi32(_mm_slli_epi32(p, 16), 16);
+        _mm_storel_epi64((__m128i*)((uint16_t*)row + i), _mm_packs_epi32(p, p));
+        return;
+    }
+    if (layout == LAYOUT_SWAPPED) {
+        col = bswap_epi32(col);
+    } else if (layout == LAYOUT_ALPHA_LOW) {
+        col = _mm_or_si128(_mm_slli_epi32(col, 8), _mm_srli_epi32(col, 24));
+    }
+    _mm_storeu_si128((__m128i*)((uint32_t*)row + i), col);
+}
+
+#ifdef FIXED_POINT
+// Pixels are widened to 16 bits per channel, two pixels per register, and
+// mixed with 8.8 weights. (x * (1 - a) + y * a) >> FIXED_POINT_BITS is the
+// same as mix(), but never leaves the unsigned 16 bit range for 8 bit x and
+// y.
+static inline __m128i mix_epu16(__m128i x, __m128i y, __m128i a) {
+    const __m128i inv_a = _mm_sub_epi16(_mm_set1_epi16(WEIGHT_ONE), a);
+    return _mm_srli_epi16(
+        _mm_add_epi16(_mm_mullo_epi16(x, inv_a), _mm_mullo_epi16(y, a)),
+        FIXED_POINT_BITS);
+}
+
+// Weights of 4 pixels, each repeated for the 4 channels of its pixel: Pixels
+// 0, 1 in lo and 2, 3 in hi, matching the unpacked pixels.
+static inline void load_weights_4(const weight_t* weights, __m128i* lo,
+                                  __m128i* hi) {
+    __m128i w = _mm_loadl_epi64((const __m128i*)weights);
+    w = _mm_unpacklo_epi16(w, w);
+    *lo = _mm_unpacklo_epi32(w, w);
+    *hi = _mm_unpackhi_epi32(w, w);
+}
+
+static inline __m128i pack_4(__m128i lo, __m128i hi) {
+    return _mm_or_si128(_mm_packus_epi16(lo, hi),
+                        _mm_set1_epi32((int)0xFF000000));
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_x_row_sse2(const void* row,
+                                             const int32_t* src_x,
+                                             const weight_t* weights_x,
+                                             void* out, int count,
+                                             int in_layout, int out_layout) {
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        const __m128i p0 = gather_4(row, src_x + x, 0, in_layout);
+        const __m128i p1 = gather_4(row, src_x + x, 1, in_layout);
+        __m128i offset_lo, offset_hi;
+        load_weights_4(weights_x + x, &offset_lo, &offset_hi);
+        const __m128i lo = mix_epu16(_mm_unpacklo_epi8(p0, zero),
+                                     _mm_unpacklo_epi8(p1, zero), offset_lo);
+        const __m128i hi = mix_epu16(_mm_unpackhi_epi8(p0, zero),
+                                     _mm_unpackhi_epi8(p1, zero), offset_hi);
+        store_4(out, x, pack_4(lo, hi), out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_x_row(
+        row, src_x + x, weights_x + x, pixel_offset_mut(out, x, out_layout),
+        count - x);
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_y_row_sse2(const void* row0,
+                                             const void* row1,
+                                             weight_t weight_y, void* out,
+                                             int count, int in_layout,
+                                             int out_layout) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i offset_y = _mm_set1_epi16(weight_y);
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        const __m128i p0 = load_4(row0, x, in_layout);
+        const __m128i p1 = load_4(row1, x, in_layout);
+        const __m128i lo = mix_epu16(_mm_unpacklo_epi8(p0, zero),
+                                     _mm_unpacklo_epi8(p1, zero), offset_y);
+        const __m128i hi = mix_epu16(_mm_unpackhi_epi8(p0, zero),
+                                     _mm_unpackhi_epi8(p1, zero), offset_y);
+        store_4(out, x, pack_4(lo, hi), out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_y_row(
+        pixel_offset(row0, x, in_layout), pixel_offset(row1, x, in_layout),
+        weight_y, pixel_offset_mut(out, x, out_layout), count - x);
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_xy_row_sse2(
+    const void* row0, const void* row1, const int32_t* src_x,
+    const weight_t* weights_x, weight_t weight_y, void* out, int count,
+    int in_layout, int out_layout) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i offset_y = _mm_set1_epi16(weight_y);
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        const __m128i p0 = gather_4(row0, src_x + x, 0, in_layout);
+        const __m128i p1 = gather_4(row0, src_x + x, 1, in_layout);
+        const __m128i p2 = gather_4(row1, src_x + x, 0, in_layout);
+        const __m128i p3 = gather_4(row1, src_x + x, 1, in_layout);
+        __m128i offset_lo, offset_hi;
+        load_weights_4(weights_x + x, &offset_lo, &offset_hi);
+        const __m128i top_lo =
+            mix_epu16(_mm_unpacklo_epi8(p0, zero),
+                      _mm_unpacklo_epi8(p1, zero), offset_lo);
+        const __m128i top_hi =
+            mix_epu16(_mm_unpackhi_epi8(p0, zero),
+                      _mm_unpackhi_epi8(p1, zero), offset_hi);
+        const __m128i bottom_lo =
+            mix_epu16(_mm_unpacklo_epi8(p2, zero),
+                      _mm_unpacklo_epi8(p3, zero), offset_lo);
+        const __m128i bottom_hi =
+            mix_epu16(_mm_unpackhi_epi8(p2, zero),
+                      _mm_unpackhi_epi8(p3, zero), offset_hi);
+        store_4(out, x,
+                pack_4(mix_epu16(top_lo, bottom_lo, offset_y),
+                       mix_epu16(top_hi, bottom_hi, offset_y)),
+                out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_xy_row(
+        row0, row1, src_x + x, weights_x + x, weight_y,
+        pixel_offset_mut(out, x, out_layout), count - x);
+}
+#else  // !FIXED_POINT
+// Channel c of 4 packed pixels as floats
+#define CH_PS(pixels, c)                                                   \
+    _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32((pixels), 8 * (2 - (c))), \
+                                  _mm_set1_epi32(0xFF)))
+
+static inline __m128 mix_ps(__m128 x, __m128 y, __m128 a) {
+    return _mm_add_ps(x, _mm_mul_ps(a, _mm_sub_ps(y, x)));
+}
+
+// Channel c of 4 output pixels from samples p0..p3
+#define BILINEAR_PS(c)                                   \
+    mix_ps(mix_ps(CH_PS(p0, c), CH_PS(p1, c), offset_x), \
+           mix_ps(CH_PS(p2, c), CH_PS(p3, c), offset_x), offset_y)
+
+static inline __m128i get_col_4(__m128 r, __m128 g, __m128 b) {
+    __m128i col = _mm_or_si128(_mm_slli_epi32(_mm_cvttps_epi32(r), 16),
+                               _mm_slli_epi32(_mm_cvttps_epi32(g), 8));
+    col = _mm_or_si128(col, _mm_cvttps_epi32(b));
+    return _mm_or_si128(col, _mm_set1_epi32((int)0xFF000000));
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_x_row_sse2(const void* row,
+                                             const int32_t* src_x,
+                                             const weight_t* weights_x,
+                                             void* out, int count,
+                                             int in_layout, int out_layout) {
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        const __m128i p0 = gather_4(row, src_x + x, 0, in_layout);
+        const __m128i p1 = gather_4(row, src_x + x, 1, in_layout);
+        const __m128 offset_x = _mm_loadu_ps(weights_x + x);
+        store_4(out, x,
+                get_col_4(mix_ps(CH_PS(p0, 0), CH_PS(p1, 0), offset_x),
+                          mix_ps(CH_PS(p0, 1), CH_PS(p1, 1), offset_x),
+                          mix_ps(CH_PS(p0, 2), CH_PS(p1, 2), offset_x)),
+                out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_x_row(
+        row, src_x + x, weights_x + x, pixel_offset_mut(out, x, out_layout),
+        count - x);
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_y_row_sse2(const void* row0,
+                                             const void* row1,
+                                             weight_t weight_y, void* out,
+                                             int count, int in_layout,
+                                             int out_layout) {
+    const __m128 offset_y = _mm_set1_ps(weight_y);
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        const __m128i p0 = load_4(row0, x, in_layout);
+        const __m128i p1 = load_4(row1, x, in_layout);
+        store_4(out, x,
+                get_col_4(mix_ps(CH_PS(p0, 0), CH_PS(p1, 0), offset_y),
+                          mix_ps(CH_PS(p0, 1), CH_PS(p1, 1), offset_y),
+                          mix_ps(CH_PS(p0, 2), CH_PS(p1, 2), offset_y)),
+                out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_y_row(
+        pixel_offset(row0, x, in_layout), pixel_offset(row1, x, in_layout),
+        weight_y, pixel_offset_mut(out, x, out_layout), count - x);
+}
+
+PIXEL_AA_ALWAYS_INLINE void blend_xy_row_sse2(
+    const void* row0, const void* row1, const int32_t* src_x,
+    const weight_t* weights_x, weight_t weight_y, void* out, int count,
+    int in_layout, int out_layout) {
+    const __m128 offset_y = _mm_set1_ps(weight_y);
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        const __m128i p0 = gather_4(row0, src_x + x, 0, in_layout);
+        const __m128i p1 = gather_4(row0, src_x + x, 1, in_layout);
+        const __m128i p2 = gather_4(row1, src_x + x, 0, in_layout);
+        const __m128i p3 = gather_4(row1, src_x + x, 1, in_layout);
+        const __m128 offset_x = _mm_loadu_ps(weights_x + x);
+        store_4(out, x,
+                get_col_4(BILINEAR_PS(0), BILINEAR_PS(1), BILINEAR_PS(2)),
+                out_layout);
+    }
+    pixel_aa_kernels_scalar.rows[in_layout][out_layout].blend_xy_row(
+        row0, row1, src_x + x, weights_x + x, weight_y,
+        pixel_offset_mut(out, x, out_layout), count - x);
+}
+#endif  // FIXED_POINT
+
+// Adds the two pixels of a to each other and those of b, for pixels widened
+// to 16 bits per channel.
+static inline __m128i add_pairs(__m128i a, __m128i b) {
+    return _mm_add_epi16(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+}
+
+// Sums of 4 blocks, rounded, to 4 pixels
+static inline __m128i average_4(__m128i sums01, __m128i sums23, int shift) {
+    const __m128i round = _mm_set1_epi16((1 << shift) >> 1);
+    return _mm_packus_epi16(
+        _mm_srli_epi16(_mm_add_epi16(sums01, round), shift),
+        _mm_srli_epi16(_mm_add_epi16(sums23, round), shift));
+}
+
+static void reduce_2x2_row_sse2(const void* row, int stride, uint32_t alpha,
+                                void* out, int count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha_4 = _mm_set1_epi32((int)alpha);
+    const uint8_t* row0 = (const uint8_t*)row;
+    const uint8_t* row1 = row0 + stride;
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        const __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+        const __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x * 8 + 16));
+        const __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+        const __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x * 8 + 16));
+        // Input pixels 0, 1 and 2, 3 of the first load, summed vertically
+        const __m128i lo0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero),
+                                          _mm_unpacklo_epi8(b0, zero));
+        const __m128i hi0 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero),
+                                          _mm_unpackhi_epi8(b0, zero));
+        const __m128i lo1 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero),
+                                          _mm_unpacklo_epi8(b1, zero));
+        const __m128i hi1 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero),
+                                          _mm_unpackhi_epi8(b1, zero));
+        const __m128i col =
+            average_4(add_pairs(lo0, hi0), add_pairs(lo1, hi1), 2);
+        _mm_storeu_si128((__m128i*)((uint32_t*)out + x),
+                         _mm_or_si128(col, alpha_4));
+    }
+    pixel_aa_kernels_scalar.reduce_2x2_row(row0 + x * 8, stride, alpha,
+                                           (uint32_t*)out + x, count - x);
+}
+
+static void reduce_4x4_row_sse2(const void* row, int stride, uint32_t alpha,
+                                void* out, int count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha_4 = _mm_set1_epi32((int)alpha);
+    const uint8_t* src = (const uint8_t*)row;
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        // Output pixel i as two partial sums: Input pixels 0 + 2 and 1 + 3
+        // of its block, over all rows.
+        __m128i sums[4];
+        for (int i = 0; i < 4; ++i) {
+            sums[i] = zero;
+            for (int j = 0; j < 4; ++j) {
+                const __m128i p = _mm_loadu_si128(
+                    (const __m128i*)(src + (intptr_t)j * stride +
+                                     (x + i) * 16));
+                sums[i] = _mm_add_epi16(
+                    sums[i], _mm_add_epi16(_mm_unpacklo_epi8(p, zero),
+                                           _mm_unpackhi_epi8(p, zero)));
+            }
+        }
+        const __m128i col = average_4(add_pairs(sums[0], sums[1]),
+                                      add_pairs(sums[2], sums[3]), 4);
+        _mm_storeu_si128((__m128i*)((uint32_t*)out + x),
+                         _mm_or_si128(col, alpha_4));
+    }
+    pixel_aa_kernels_scalar.reduce_4x4_row(src + x * 16, stride, alpha,
+                                           (uint32_t*)out + x, count - x);
+}
+
+PIXEL_AA_DEFINE_ROW_KERNELS(sse2)
+
+const PixelAAKernels pixel_aa_kernels_sse2 = {
+    "sse2",
+    PIXEL_AA_ROW_KERNEL_TABLE(sse2),
+    reduce_2x2_row_sse2,
+    reduce_4x4_row_sse2,
+};
+#endif  // PIXEL_AA_HAVE_SSE2
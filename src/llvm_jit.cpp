@@ -1,84 +1,123 @@
+#include "llvm_jit.h"
+
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
 #include <llvm/IR/LLVMContext.h>
-#include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/Module.h>
-#include <llvm/IR/PassManager.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/IRReader/IRReader.h>
-#include <llvm/LinkAllIR.h>
-#include <llvm/LinkAllPasses.h>
-#include <llvm/Pass.h>
-#include <llvm/Support/CommandLine.h>
-#include <llvm/Support/InitLLVM.h>
+#include <llvm/Passes/PassBuilder.h>
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/Support/raw_ostream.h>
-#include <llvm/Transforms/IPO.h>
-#include <llvm/Transforms/Scalar.h>
+#include <llvm/Target/TargetMachine.h>
 
-#include <iostream>
+#include <memory>
 #include <string>
 
 using namespace llvm;
 
-// Function to generate LLVM IR from C code
-std::string generateLLVMIR(const std::string& cCode, int argc, char* argv[]) {
-    // Initialize LLVM
-    llvm::InitLLVM X(argc, argv);
+struct LlvmJitKernel {
+    std::unique_ptr<orc::LLJIT> jit;
+};
+
+// Runs the O3 pipeline on `module`, with the loop and SLP vectorizers
+// tuned for `target_machine`.
+static void optimize(Module& module, TargetMachine* target_machine) {
+    PipelineTuningOptions tuning;
+    tuning.LoopVectorization = true;
+    tuning.SLPVectorization = true;
+    tuning.LoopUnrolling = true;
+    PassBuilder pass_builder(target_machine, tuning);
+
+    LoopAnalysisManager lam;
+    FunctionAnalysisManager fam;
+    CGSCCAnalysisManager cgam;
+    ModuleAnalysisManager mam;
+    pass_builder.registerModuleAnalyses(mam);
+    pass_builder.registerCGSCCAnalyses(cgam);
+    pass_builder.registerFunctionAnalyses(fam);
+    pass_builder.registerLoopAnalyses(lam);
+    pass_builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+    ModulePassManager mpm =
+        pass_builder.buildPerModuleDefaultPipeline(OptimizationLevel::O3);
+    mpm.run(module, mam);
+}
+
+LlvmJitKernel* llvm_jit_compile(const char* ir, const char* name,
+                                pixel_aa_kernel_fn* kernel) {
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
 
-    // Parse the C code to an LLVM module
-    LLVMContext context;
+    // Target the host CPU, so the vectorizers can use all of its features.
+    auto jtmb = orc::JITTargetMachineBuilder::detectHost();
+    if (!jtmb) {
+        errs() << "Failed to detect host: " << toString(jtmb.takeError())
+               << "\n";
+        return nullptr;
+    }
+    jtmb->setCodeGenOptLevel(CodeGenOpt::Aggressive);
+    auto target_machine = jtmb->createTargetMachine();
+    if (!target_machine) {
+        errs() << "Failed to create target machine: "
+               << toString(target_machine.takeError()) << "\n";
+        return nullptr;
+    }
+
+    auto context = std::make_unique<LLVMContext>();
     SMDiagnostic error;
     std::unique_ptr<Module> module =
-        parseIR(MemoryBufferRef(cCode, "C_code"), error, context);
-
-    // Verify the module
+        parseIR(MemoryBufferRef(ir, "kernel"), error, *context);
     if (!module) {
-        std::string errorString;
-        raw_string_ostream errorStream(errorString);
-        error.print("LLVM IR generation", errorStream);
-        return errorStream.str();
+        error.print("llvm_jit", errs());
+        return nullptr;
     }
-
-    // Run optimizations on the module (optional)
-    /*
-    PassManagerBuilder builder;
-    builder.OptLevel = 3;
-    builder.SizeLevel = 0;
-    legacy::FunctionPassManager fpm(module.get());
-    legacy::PassManager mpm;
-    builder.populateFunctionPassManager(fpm);
-    builder.populateModulePassManager(mpm);
-    fpm.doInitialization();
-    for (Function& func : *module) fpm.run(func);
-    fpm.doFinalization();
-    mpm.run(*module);
-    */
-
-    // Verify the optimized module
     if (verifyModule(*module, &errs())) {
-        return "LLVM IR verification failed after optimization.\n";
+        errs() << "Kernel IR failed to verify.\n";
+        return nullptr;
     }
+    module->setDataLayout((*target_machine)->createDataLayout());
+    module->setTargetTriple((*target_machine)->getTargetTriple().str());
+    optimize(*module, target_machine->get());
 
-    // Convert the module to a string containing LLVM IR
-    std::string llvmIR;
-    raw_string_ostream llvmIROut(llvmIR);
-    llvmIROut << *module;
-    llvmIROut.flush();
-
-    return llvmIR;
-}
-
-int main(int argc, char* argv[]) {
-    std::string cCode = R"(
-        #include <stdio.h>
-        int main() {
-            printf("Hello, world!\n");
-            return 0;
-        }
-    )";
+    auto jit = orc::LLJITBuilder()
+                   .setJITTargetMachineBuilder(std::move(*jtmb))
+                   .create();
+    if (!jit) {
+        errs() << "Failed to create JIT: " << toString(jit.takeError())
+               << "\n";
+        return nullptr;
+    }
+    // The kernel calls memcpy() from the process.
+    auto generator = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+        (*jit)->getDataLayout().getGlobalPrefix());
+    if (!generator) {
+        errs() << "Failed to create symbol generator: "
+               << toString(generator.takeError()) << "\n";
+        return nullptr;
+    }
+    (*jit)->getMainJITDylib().addGenerator(std::move(*generator));
 
-    std::string llvmIR = generateLLVMIR(cCode, argc, argv);
-    std::cout << "Generated LLVM IR:\n" << llvmIR << "\n";
+    if (auto err = (*jit)->addIRModule(
+            orc::ThreadSafeModule(std::move(module), std::move(context)))) {
+        errs() << "Failed to add module: " << toString(std::move(err))
+               << "\n";
+        return nullptr;
+    }
+    auto symbol = (*jit)->lookup(name);
+    if (!symbol) {
+        errs() << "Failed to look up " << name << ": "
+               << toString(symbol.takeError()) << "\n";
+        return nullptr;
+    }
+    *kernel = reinterpret_cast<pixel_aa_kernel_fn>(symbol->getAddress());
 
-    return 0;
+    LlvmJitKernel* jit_kernel = new LlvmJitKernel;
+    jit_kernel->jit = std::move(*jit);
+    return jit_kernel;
 }
+
+void llvm_jit_destroy(LlvmJitKernel* jit_kernel) { delete jit_kernel; }
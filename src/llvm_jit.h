@@ -0,0 +1,25 @@
+#ifndef LLVM_JIT_H
+#define LLVM_JIT_H
+
+#include "pixel_aa.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Kernel compiled by the LLVM ORC JIT, owns the generated code.
+typedef struct LlvmJitKernel LlvmJitKernel;
+
+// Parses `ir` (see pixel_aa_generate_kernel_ir()), optimizes it at O3 with
+// the loop and SLP vectorizers for the host CPU, and looks up `name` in it.
+// Returns NULL on failure, printing the reason to stderr.
+LlvmJitKernel* llvm_jit_compile(const char* ir, const char* name,
+                                pixel_aa_kernel_fn* kernel);
+
+void llvm_jit_destroy(LlvmJitKernel* jit_kernel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LLVM_JIT_H
@@ -0,0 +1,1008 @@
+#include <dirent.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif  // USE_THREADS
+
+// clang-format off
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+// clang-format on
+
+#include "pixel_aa.h"
+#include "string_manip.h"
+#ifdef USE_THREADS
+#include "thread_pool.h"
+#endif  // USE_THREADS
+
+// Contexts kept per batch worker, for the most recent input and output
+// sizes. Assets of a library mostly come in a handful of sizes.
+#define CONTEXT_CACHE_SIZE 8
+
+typedef struct {
+    int in_width;
+    int in_height;
+    int out_width;
+    int out_height;
+    PixelAAContext* ctx;
+} CachedContext;
+
+typedef struct {
+    CachedContext entries[CONTEXT_CACHE_SIZE];
+    // Entry to replace next
+    int next;
+    int num_created;
+} ContextCache;
+
+// Batch mode: Every file is one task of a thread pool, which loads, scales
+// and saves it. Workers overlap their I/O with the scaling of others.
+typedef struct {
+    char** paths;
+    int num_paths;
+    const char* width_arg;
+    const char* height_arg;
+    PixelAAOptions options;
+    // One per worker, contexts aren't shared between threads.
+    ContextCache* caches;
+    // Per file: Whether it was saved, and its output pixels
+    int* saved;
+    int64_t* out_pixels;
+} Batch;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+// Target size from the command line, either in pixels or as a factor of the
+// input size, e.g. 4x or 0.25x. Rounded to the nearest pixel, at least 1.
+static int parse_target_size(const char* arg, int in_size) {
+    const size_t length = strlen(arg);
+    if (length > 1 && arg[length - 1] == 'x') {
+        const double size = atof(arg) * in_size + 0.5;
+        return size < 1.0 ? 1 : size > INT_MAX ? INT_MAX : (int)size;
+    }
+    return atoi(arg);
+}
+
+// Prints the counters of ctx, see --stats.
+static void print_stats(const PixelAAContext* ctx, FILE* f) {
+    static const char* const path_names[PIXEL_AA_NUM_PATHS] = {
+        "copied", "1 sample", "2 samples", "4 samples", "area"};
+    static const char* const stage_names[PIXEL_AA_NUM_STAGES] = {
+        "border", "center", "vertical", "copy", "hash", "downscale"};
+    PixelAAStats stats;
+    if (pixel_aa_get_stats(ctx, &stats) != 0) {
+        fprintf(f, "No stats, they are only collected in builds with "
+                   "USE_STATS.\n");
+        return;
+    }
+    fprintf(f,
+            "Frames: %lld, %.3f ms mean, %.3f ms p50, %.3f ms p90, %.3f ms "
+            "p99, %.3f ms max\n",
+            (long long)stats.frames, stats.frame_ms_mean, stats.frame_ms_p50,
+            stats.frame_ms_p90, stats.frame_ms_p99, stats.frame_ms_max);
+    int64_t num_pixels = 0;
+    for (int i = 0; i < PIXEL_AA_NUM_PATHS; ++i) {
+        num_pixels += stats.pixels[i];
+    }
+    fprintf(f, "Pixels:");
+    for (int i = 0; i < PIXEL_AA_NUM_PATHS; ++i) {
+        if (stats.pixels[i] > 0) {
+            fprintf(f, " %s %lld (%.1f%%)", path_names[i],
+                    (long long)stats.pixels[i],
+                    stats.pixels[i] * 100.0 / num_pixels);
+        }
+    }
+    fprintf(f, "\nStages:");
+    for (int i = 0; i < PIXEL_AA_NUM_STAGES; ++i) {
+        if (stats.stage_ms[i] > 0.0) {
+            fprintf(f, " %s %.3f ms", stage_names[i], stats.stage_ms[i]);
+        }
+    }
+    fprintf(f, "\n");
+    for (int t = 0; t < stats.num_threads; ++t) {
+        PixelAAThreadStats thread;
+        pixel_aa_get_thread_stats(ctx, t, &thread);
+        fprintf(f, "Thread %d: %.3f ms busy, %.3f ms idle, %lld tasks\n", t,
+                thread.busy_ms, thread.idle_ms, (long long)thread.tasks);
+    }
+}
+
+// Scales the output in bands of `band_rows` rows and appends each one to a
+// PAM file at `path`, so that only one band is in memory at a time. Unlike
+// PNG, PAM can be written in pieces without an encoder. Returns 0 on
+// success.
+static int write_banded(PixelAAContext* ctx, const uint32_t* in, int in_width,
+                        int out_width, int out_height, int band_rows,
+                        const char* path) {
+    const int channels = 4;
+    const int out_stride = out_width * channels;
+    unsigned char* band =
+        (unsigned char*)malloc((size_t)band_rows * out_stride);
+    FILE* f = fopen(path, "wb");
+    if (!band || !f) {
+        free(band);
+        if (f) {
+            fclose(f);
+        }
+        return -1;
+    }
+    fprintf(f,
+            "P7\nWIDTH %d\nHEIGHT %d\nDEPTH %d\nMAXVAL 255\n"
+            "TUPLTYPE RGB_ALPHA\nENDHDR\n",
+            out_width, out_height, channels);
+    int result = 0;
+    for (int y0 = 0; y0 < out_height && result == 0; y0 += band_rows) {
+        const int y1 =
+            y0 + band_rows < out_height ? y0 + band_rows : out_height;
+        const size_t band_size = (size_t)(y1 - y0) * out_stride;
+        if (pixel_aa_scale_band(ctx, in, in_width * channels, y0, y1, band,
+                                out_stride) != 0 ||
+            fwrite(band, 1, band_size, f) != band_size) {
+            result = -1;
+        }
+    }
+    if (fclose(f) != 0) {
+        result = -1;
+    }
+    free(band);
+    return result;
+}
+
+// Returns a context for the sizes, from the cache if possible.
+static PixelAAContext* get_context(ContextCache* cache,
+                                   const PixelAAOptions* options, int in_width,
+                                   int in_height, int out_width,
+                                   int out_height) {
+    for (int i = 0; i < CONTEXT_CACHE_SIZE; ++i) {
+        const CachedContext* entry = &cache->entries[i];
+        if (entry->ctx && entry->in_width == in_width &&
+            entry->in_height == in_height && entry->out_width == out_width &&
+            entry->out_height == out_height) {
+            return entry->ctx;
+        }
+    }
+    PixelAAContext* ctx = pixel_aa_create_with_options(
+        in_width, in_height, out_width, out_height, options);
+    if (!ctx) {
+        return NULL;
+    }
+    CachedContext* entry = &cache->entries[cache->next];
+    pixel_aa_destroy(entry->ctx);
+    *entry = (CachedContext){in_width, in_height, out_width, out_height, ctx};
+    cache->next = (cache->next + 1) % CONTEXT_CACHE_SIZE;
+    ++cache->num_created;
+    return ctx;
+}
+
+static void process_file(void* arg, int task, int thread_num) {
+    Batch* batch = (Batch*)arg;
+    const char* input_path = batch->paths[task];
+    int in_width, in_height, channels;
+    unsigned char* in_img_data =
+        stbi_load(input_path, &in_width, &in_height, &channels, STBI_rgb_alpha);
+    if (!in_img_data) {
+        printf("%s: Failed to load image.\n", input_path);
+        return;
+    }
+    if (channels != 3) {
+        printf("%s: Only 3 channel images are supported. Image has %d "
+               "channels.\n",
+               input_path, channels);
+        stbi_image_free(in_img_data);
+        return;
+    }
+    channels = 4;
+    const int out_width = parse_target_size(batch->width_arg, in_width);
+    const int out_height = parse_target_size(batch->height_arg, in_height);
+    if (out_width <= 0 || out_height <= 0 ||
+        (size_t)out_width * out_height * channels > INT_MAX) {
+        printf("%s: Unsupported target size %dx%d.\n", input_path, out_width,
+               out_height);
+        stbi_image_free(in_img_data);
+        return;
+    }
+    PixelAAContext* ctx =
+        get_context(&batch->caches[thread_num], &batch->options, in_width,
+                    in_height, out_width, out_height);
+    unsigned char* out_img_data =
+        (unsigned char*)malloc((size_t)out_width * out_height * channels);
+    if (!ctx || !out_img_data) {
+        printf("%s: Failed to allocate.\n", input_path);
+        free(out_img_data);
+        stbi_image_free(in_img_data);
+        return;
+    }
+    pixel_aa_scale(ctx, in_img_data, out_img_data);
+    stbi_image_free(in_img_data);
+
+    char* directory = get_parent_path(input_path);
+    char* file_name = get_filename(input_path);
+    char* output_file_name = remove_extension(file_name);
+    char* output_path = get_output_path(directory, output_file_name, "png");
+    if (stbi_write_png(output_path, out_width, out_height, channels,
+                       out_img_data, out_width * channels) == 0) {
+        printf("%s: Failed to save the output image.\n", output_path);
+    } else {
+        batch->saved[task] = 1;
+        batch->out_pixels[task] = (int64_t)out_width * out_height;
+    }
+    free(directory);
+    free(file_name);
+    free(output_file_name);
+    free(output_path);
+    free(out_img_data);
+}
+
+static int compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int is_image_path(const char* path) {
+    static const char* const extensions[] = {"png", "jpg", "jpeg", "bmp",
+                                             "tga", "gif", "ppm", "pgm"};
+    const char* dot = strrchr(path, '.');
+    // Skip the results of earlier runs.
+    if (!dot || (dot - path >= 7 && strncmp(dot - 7, "_output", 7) == 0)) {
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); ++i) {
+        if (strcasecmp(dot + 1, extensions[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Appends `path`, which is taken over. Returns 0 on success, -1 if `path`
+// is NULL or the list can't grow.
+static int add_path(char*** paths, int* num_paths, int* capacity,
+                    char* path) {
+    if (!path) {
+        return -1;
+    }
+    if (*num_paths == *capacity) {
+        const int new_capacity = *capacity > 0 ? *capacity * 2 : 64;
+        char** new_paths =
+            (char**)realloc(*paths, new_capacity * sizeof(char*));
+        if (!new_paths) {
+            free(path);
+            return -1;
+        }
+        *paths = new_paths;
+        *capacity = new_capacity;
+    }
+    (*paths)[(*num_paths)++] = path;
+    return 0;
+}
+
+static void free_paths(char** paths, int num_paths) {
+    for (int i = 0; i < num_paths; ++i) {
+        free(paths[i]);
+    }
+    free(paths);
+}
+
+// The images of a directory, sorted, or the paths listed in a text file,
+// one per line. Returns the number of paths, -1 if `path` can't be read or
+// -2 if allocation fails.
+static int collect_paths(const char* path, char*** paths) {
+    int num_paths = 0;
+    int capacity = 0;
+    *paths = NULL;
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return -1;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        DIR* dir = opendir(path);
+        if (!dir) {
+            return -1;
+        }
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (!is_image_path(entry->d_name)) {
+                continue;
+            }
+            char* file_path = (char*)malloc(strlen(path) + 1 +
+                                            strlen(entry->d_name) + 1);
+            if (file_path) {
+                sprintf(file_path, "%s/%s", path, entry->d_name);
+            }
+            if (add_path(paths, &num_paths, &capacity, file_path) != 0) {
+                closedir(dir);
+                free_paths(*paths, num_paths);
+                *paths = NULL;
+                return -2;
+            }
+        }
+        closedir(dir);
+        qsort(*paths, num_paths, sizeof(char*), compare_paths);
+        return num_paths;
+    }
+
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0' &&
+            add_path(paths, &num_paths, &capacity, strdup(line)) != 0) {
+            fclose(f);
+            free_paths(*paths, num_paths);
+            *paths = NULL;
+            return -2;
+        }
+    }
+    fclose(f);
+    return num_paths;
+}
+
+static int run_batch(const char* input_path, const char* width_arg,
+                     const char* height_arg, const PixelAAOptions* options,
+                     int num_jobs) {
+    Batch batch = {0};
+    batch.num_paths = collect_paths(input_path, &batch.paths);
+    if (batch.num_paths == -2) {
+        printf("Failed to allocate the list of images.\n");
+        return 1;
+    }
+    if (batch.num_paths < 0) {
+        printf("Failed to read %s.\n", input_path);
+        return 1;
+    }
+    batch.width_arg = width_arg;
+    batch.height_arg = height_arg;
+    // The files are the parallel work, each one is scaled on one thread.
+    batch.options = *options;
+    batch.options.num_threads = 1;
+
+#ifdef USE_THREADS
+    if (num_jobs < 1) {
+        num_jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    num_jobs = num_jobs < 1 ? 1 : num_jobs;
+    ThreadPool* pool =
+        num_jobs > 1 ? thread_pool_create(num_jobs, NULL) : NULL;
+    if (!pool) {
+        num_jobs = 1;
+    }
+#else   // !USE_THREADS
+    num_jobs = 1;
+#endif  // USE_THREADS
+    batch.caches = (ContextCache*)calloc(num_jobs, sizeof(ContextCache));
+    batch.saved = (int*)calloc(batch.num_paths + 1, sizeof(int));
+    batch.out_pixels = (int64_t*)calloc(batch.num_paths + 1, sizeof(int64_t));
+    if (!batch.caches || !batch.saved || !batch.out_pixels) {
+        printf("Failed to allocate the batch state.\n");
+#ifdef USE_THREADS
+        thread_pool_destroy(pool);
+#endif  // USE_THREADS
+        free_paths(batch.paths, batch.num_paths);
+        free(batch.caches);
+        free(batch.saved);
+        free(batch.out_pixels);
+        return 1;
+    }
+    printf("Scaling %d images on %d threads.\n", batch.num_paths, num_jobs);
+
+    const double start = now_s();
+#ifdef USE_THREADS
+    if (pool) {
+        thread_pool_run(pool, batch.num_paths, process_file, &batch);
+        thread_pool_destroy(pool);
+    } else
+#endif  // USE_THREADS
+    {
+        for (int i = 0; i < batch.num_paths; ++i) {
+            process_file(&batch, i, 0);
+        }
+    }
+    const double elapsed_s = now_s() - start;
+
+    int num_saved = 0;
+    int64_t out_pixels = 0;
+    for (int i = 0; i < batch.num_paths; ++i) {
+        num_saved += batch.saved[i];
+        out_pixels += batch.out_pixels[i];
+    }
+    int num_contexts = 0;
+    for (int t = 0; t < num_jobs; ++t) {
+        num_contexts += batch.caches[t].num_created;
+        for (int i = 0; i < CONTEXT_CACHE_SIZE; ++i) {
+            pixel_aa_destroy(batch.caches[t].entries[i].ctx);
+        }
+    }
+    printf("Saved %d of %d images in %.2f s: %.1f images/s, %.1f Mpix/s "
+           "written, %d contexts created.\n",
+           num_saved, batch.num_paths, elapsed_s,
+           elapsed_s > 0.0 ? num_saved / elapsed_s : 0.0,
+           elapsed_s > 0.0 ? out_pixels * 1.0e-6 / elapsed_s : 0.0,
+           num_contexts);
+    free_paths(batch.paths, batch.num_paths);
+    free(batch.caches);
+    free(batch.saved);
+    free(batch.out_pixels);
+    return num_saved == batch.num_paths ? 0 : 1;
+}
+
+// Video mode: Frames are read from a file or stdin, go through a pipeline
+// around one context and are written to stdout in the input's container.
+// The calling thread reads and submits frames while the pipeline scales the
+// previous one and a second thread writes the one before, so every stage
+// overlaps with the others.
+
+// Longest y4m header or FRAME line, with room for X parameters and comments
+#define Y4M_LINE_SIZE 4096
+
+typedef struct {
+    FILE* in;
+    int y4m;
+    int in_width;
+    int in_height;
+    int out_width;
+    int out_height;
+    // y4m stream parameters other than the size, e.g. " F60:1 Ip C420jpeg",
+    // copied to the output header
+    char y4m_params[Y4M_LINE_SIZE];
+    // Chroma subsampling of y4m streams, as shifts of the luma size
+    int chroma_shift_x;
+    int chroma_shift_y;
+    // y4m frames in planes, one for the reader and one for the writer
+    unsigned char* in_planes;
+    unsigned char* out_planes;
+    PixelAAPipeline* pipeline;
+    int64_t frames_written;
+    int write_failed;
+} Video;
+
+// Reads a line of at most size - 2 characters without the newline into
+// `line`. Returns 0 on success, -2 if the line is longer and -1 otherwise.
+static int read_line(FILE* f, char* line, int size) {
+    if (!fgets(line, size, f)) {
+        return -1;
+    }
+    const size_t length = strlen(line);
+    if (length == 0 || line[length - 1] != '\n') {
+        return length == (size_t)size - 1 ? -2 : -1;
+    }
+    line[length - 1] = '\0';
+    return 0;
+}
+
+// Size of a chroma plane along an axis of `size` luma pixels.
+static int chroma_size(int size, int shift) {
+    return (size + (1 << shift) - 1) >> shift;
+}
+
+// Bytes of a y4m frame of the given size, without the FRAME line.
+static size_t y4m_frame_bytes(const Video* video, int width, int height) {
+    return (size_t)width * height +
+           2 * (size_t)chroma_size(width, video->chroma_shift_x) *
+               chroma_size(height, video->chroma_shift_y);
+}
+
+// Parses the y4m stream header. 8 bit 4:2:0, 4:2:2 and 4:4:4 are supported,
+// 4:2:0 if there's no color space. The planes are interleaved into pixels
+// and mixed like RGB, subsampled chroma is repeated for every pixel it
+// covers and averaged back on output, regardless of its siting. Returns 0
+// on success.
+static int read_y4m_header(Video* video) {
+    char line[Y4M_LINE_SIZE];
+    const int status = read_line(video->in, line, sizeof(line));
+    if (status == -2) {
+        fprintf(stderr, "y4m header too long, at most %d characters.\n",
+                Y4M_LINE_SIZE - 2);
+        return -1;
+    }
+    if (status != 0 || strncmp(line, "YUV4MPEG2", 9) != 0) {
+        fprintf(stderr, "Not a y4m stream.\n");
+        return -1;
+    }
+    static const char* const chroma_420[] = {"C420jpeg", "C420mpeg2",
+                                             "C420paldv", "C420"};
+    video->chroma_shift_x = 1;
+    video->chroma_shift_y = 1;
+    video->y4m_params[0] = '\0';
+    for (char* token = strtok(line + 9, " "); token;
+         token = strtok(NULL, " ")) {
+        if (token[0] == 'W') {
+            video->in_width = atoi(token + 1);
+        } else if (token[0] == 'H') {
+            video->in_height = atoi(token + 1);
+        } else {
+            if (token[0] == 'C') {
+                int is_420 = 0;
+                for (size_t i = 0;
+                     i < sizeof(chroma_420) / sizeof(chroma_420[0]); ++i) {
+                    is_420 |= strcmp(token, chroma_420[i]) == 0;
+                }
+                if (strcmp(token, "C444") == 0) {
+                    video->chroma_shift_x = 0;
+                    video->chroma_shift_y = 0;
+                } else if (strcmp(token, "C422") == 0) {
+                    video->chroma_shift_y = 0;
+                } else if (!is_420) {
+                    fprintf(stderr,
+                            "Unsupported y4m color space %s, only 8 bit "
+                            "4:2:0, 4:2:2 and 4:4:4 are supported.\n",
+                            token + 1);
+                    return -1;
+                }
+            }
+            strcat(video->y4m_params, " ");
+            strcat(video->y4m_params, token);
+        }
+    }
+    if (video->in_width <= 0 || video->in_height <= 0) {
+        fprintf(stderr, "Invalid y4m frame size.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Reads the next frame into the input buffer `in`. Returns 0 on success and
+// -1 at the end of the input.
+static int read_frame(Video* video, uint32_t* in) {
+    const size_t num_pixels = (size_t)video->in_width * video->in_height;
+    if (!video->y4m) {
+        return fread(in, 4, num_pixels, video->in) == num_pixels ? 0 : -1;
+    }
+    const int width = video->in_width;
+    const int shift_x = video->chroma_shift_x;
+    const int shift_y = video->chroma_shift_y;
+    const int chroma_width = chroma_size(width, shift_x);
+    const size_t frame_bytes = y4m_frame_bytes(video, width, video->in_height);
+    char line[Y4M_LINE_SIZE];
+    if (read_line(video->in, line, sizeof(line)) != 0 ||
+        strncmp(line, "FRAME", 5) != 0 ||
+        fread(video->in_planes, 1, frame_bytes, video->in) != frame_bytes) {
+        return -1;
+    }
+    const unsigned char* luma = video->in_planes;
+    const unsigned char* u = luma + num_pixels;
+    const unsigned char* v = u + (frame_bytes - num_pixels) / 2;
+    unsigned char* bytes = (unsigned char*)in;
+    for (int y = 0; y < video->in_height; ++y) {
+        const size_t chroma_row = (size_t)(y >> shift_y) * chroma_width;
+        for (int x = 0; x < width; ++x) {
+            const size_t i = (size_t)y * width + x;
+            const size_t c = chroma_row + (x >> shift_x);
+            bytes[i * 4] = luma[i];
+            bytes[i * 4 + 1] = u[c];
+            bytes[i * 4 + 2] = v[c];
+            bytes[i * 4 + 3] = 0xFF;
+        }
+    }
+    return 0;
+}
+
+// Averages byte `channel` of the pixels of each chroma block of an output
+// frame into `plane`, rounded to nearest.
+static void subsample_chroma(const Video* video, const unsigned char* bytes,
+                             int channel, unsigned char* plane) {
+    const int width = video->out_width;
+    const int height = video->out_height;
+    const int shift_x = video->chroma_shift_x;
+    const int shift_y = video->chroma_shift_y;
+    const int chroma_width = chroma_size(width, shift_x);
+    const int chroma_height = chroma_size(height, shift_y);
+    for (int cy = 0; cy < chroma_height; ++cy) {
+        const int y0 = cy << shift_y;
+        const int y1 = y0 + (1 << shift_y) < height ? y0 + (1 << shift_y)
+                                                    : height;
+        for (int cx = 0; cx < chroma_width; ++cx) {
+            const int x0 = cx << shift_x;
+            const int x1 =
+                x0 + (1 << shift_x) < width ? x0 + (1 << shift_x) : width;
+            int sum = 0;
+            for (int y = y0; y < y1; ++y) {
+                for (int x = x0; x < x1; ++x) {
+                    sum += bytes[((size_t)y * width + x) * 4 + channel];
+                }
+            }
+            const int count = (y1 - y0) * (x1 - x0);
+            plane[(size_t)cy * chroma_width + cx] =
+                (unsigned char)((sum + count / 2) / count);
+        }
+    }
+}
+
+static int write_frame(Video* video, const uint32_t* out) {
+    const size_t num_pixels = (size_t)video->out_width * video->out_height;
+    if (!video->y4m) {
+        return fwrite(out, 4, num_pixels, stdout) == num_pixels ? 0 : -1;
+    }
+    const unsigned char* bytes = (const unsigned char*)out;
+    const size_t frame_bytes =
+        y4m_frame_bytes(video, video->out_width, video->out_height);
+    unsigned char* luma = video->out_planes;
+    unsigned char* u = luma + num_pixels;
+    unsigned char* v = u + (frame_bytes - num_pixels) / 2;
+    for (size_t i = 0; i < num_pixels; ++i) {
+        luma[i] = bytes[i * 4];
+    }
+    subsample_chroma(video, bytes, 1, u);
+    subsample_chroma(video, bytes, 2, v);
+    return fputs("FRAME\n", stdout) < 0 ||
+                   fwrite(video->out_planes, 1, frame_bytes, stdout) !=
+                       frame_bytes
+               ? -1
+               : 0;
+}
+
+// Writes completed frames until the pipeline runs dry. Frames are still
+// released after a failed write, so that the reader doesn't block.
+static void write_frames(Video* video) {
+    const void* out;
+    while ((out = pixel_aa_pipeline_complete(video->pipeline)) != NULL) {
+        if (!video->write_failed) {
+            if (write_frame(video, (const uint32_t*)out) == 0) {
+                ++video->frames_written;
+            } else {
+                video->write_failed = 1;
+            }
+        }
+        pixel_aa_pipeline_release(video->pipeline);
+    }
+}
+
+#ifdef USE_THREADS
+static void* writer_main(void* arg) {
+    write_frames((Video*)arg);
+    return NULL;
+}
+#endif  // USE_THREADS
+
+// Writes the stream header and runs all frames through the pipeline.
+// Returns 0 if all of them were written.
+static int scale_video(Video* video) {
+    if (video->y4m) {
+        printf("YUV4MPEG2 W%d H%d%s\n", video->out_width, video->out_height,
+               video->y4m_params);
+    }
+#ifdef USE_THREADS
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, writer_main, video) != 0) {
+        fprintf(stderr, "Failed to start the writer thread.\n");
+        return -1;
+    }
+#endif  // USE_THREADS
+    int64_t frames_read = 0;
+    const double start = now_s();
+    for (;;) {
+        uint32_t* in =
+            (uint32_t*)pixel_aa_pipeline_acquire_input(video->pipeline);
+        if (!in || read_frame(video, in) != 0) {
+            break;
+        }
+        pixel_aa_pipeline_submit(video->pipeline);
+        ++frames_read;
+#ifndef USE_THREADS
+        write_frames(video);
+#endif  // USE_THREADS
+    }
+    pixel_aa_pipeline_finish(video->pipeline);
+#ifdef USE_THREADS
+    pthread_join(writer, NULL);
+#endif  // USE_THREADS
+    const double elapsed_s = now_s() - start;
+    if (fflush(stdout) != 0) {
+        video->write_failed = 1;
+    }
+
+    PixelAAPipelineStats stats;
+    pixel_aa_pipeline_get_stats(video->pipeline, &stats);
+    fprintf(stderr,
+            "Wrote %lld of %lld frames in %.2f s: %.1f frames/s, %.2f ms "
+            "scaling per frame.\n"
+            "The scaler waited %.0f ms for input, the reader %.0f ms for "
+            "free slots.\n",
+            (long long)video->frames_written, (long long)frames_read,
+            elapsed_s,
+            elapsed_s > 0.0 ? video->frames_written / elapsed_s : 0.0,
+            stats.scale_ms_mean, stats.scaler_idle_ms, stats.input_stall_ms);
+    if (video->write_failed) {
+        fprintf(stderr, "Failed to write the output.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Scales the video at `input_path`, - for stdin, to stdout. Raw RGBA input
+// has the size `raw_size`, e.g. 320x240, y4m input if it is NULL. Messages
+// go to stderr, stdout carries the frames. Prints the stats of the context
+// at the end if `show_stats` is set.
+static int run_video(const char* input_path, const char* width_arg,
+                     const char* height_arg, const char* raw_size,
+                     const PixelAAOptions* options, int show_stats) {
+    Video video = {0};
+    video.in = strcmp(input_path, "-") == 0 ? stdin : fopen(input_path, "rb");
+    if (!video.in) {
+        fprintf(stderr, "Failed to open %s.\n", input_path);
+        return 1;
+    }
+    video.y4m = raw_size == NULL;
+    int valid;
+    if (video.y4m) {
+        valid = read_y4m_header(&video) == 0;
+    } else {
+        valid = sscanf(raw_size, "%dx%d", &video.in_width,
+                       &video.in_height) == 2 &&
+                video.in_width > 0 && video.in_height > 0;
+        if (!valid) {
+            fprintf(stderr, "Invalid frame size: %s\n", raw_size);
+        }
+    }
+    if (valid) {
+        video.out_width = parse_target_size(width_arg, video.in_width);
+        video.out_height = parse_target_size(height_arg, video.in_height);
+        if (video.out_width <= 0 || video.out_height <= 0) {
+            fprintf(stderr, "Error: Invalid target size.\n");
+            valid = 0;
+        }
+    }
+    if (!valid) {
+        if (video.in != stdin) {
+            fclose(video.in);
+        }
+        return 1;
+    }
+
+    // One slot per stage: read, scale and write.
+    PixelAAContext* ctx = pixel_aa_create_with_options(
+        video.in_width, video.in_height, video.out_width, video.out_height,
+        options);
+    video.pipeline = ctx ? pixel_aa_pipeline_create(ctx, 3) : NULL;
+    if (video.y4m) {
+        video.in_planes = (unsigned char*)malloc(
+            y4m_frame_bytes(&video, video.in_width, video.in_height));
+        video.out_planes = (unsigned char*)malloc(
+            y4m_frame_bytes(&video, video.out_width, video.out_height));
+    }
+    int result = 1;
+    if (!video.pipeline ||
+        (video.y4m && (!video.in_planes || !video.out_planes))) {
+        fprintf(stderr, "Failed to create the scaling pipeline.\n");
+    } else {
+        fprintf(stderr, "Scaling %s video %dx%d -> %dx%d with %s kernels.\n",
+                video.y4m ? "y4m" : "raw RGBA", video.in_width,
+                video.in_height, video.out_width, video.out_height,
+                pixel_aa_get_kernels_name(ctx));
+        result = scale_video(&video) == 0 ? 0 : 1;
+        if (show_stats) {
+            print_stats(ctx, stderr);
+        }
+    }
+
+    pixel_aa_pipeline_destroy(video.pipeline);
+    pixel_aa_destroy(ctx);
+    free(video.in_planes);
+    free(video.out_planes);
+    if (video.in != stdin) {
+        fclose(video.in);
+    }
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        printf(
+            "Usage: %s <input_path> <target_width> <target_height> "
+            "[options]\n"
+            "Options:\n"
+            "  --separable    Scale rows first, then mix scaled rows "
+            "vertically\n"
+            "  --band <rows>  Scale and write the output in bands of this "
+            "many rows, as\n"
+            "                 PAM, for outputs too big to hold in memory\n"
+            "  --batch        The input is a directory or a text file with "
+            "one path per\n"
+            "                 line, every image is scaled to "
+            "<name>_output.png\n"
+            "  --jobs <n>     Images in flight in batch mode, 0 for one per "
+            "CPU (default).\n"
+            "                 Builds without USE_THREADS scale one image at "
+            "a time\n"
+            "  --curve <name> Transition curve: smoothstep (default), "
+            "slopestep, linear\n"
+            "  --sharpness <s> Exponent of the slopestep curve (default "
+            "1.5)\n"
+            "  --video        The input is an 8 bit 4:2:0, 4:2:2 or 4:4:4 y4m "
+            "video, - for\n"
+            "                 stdin. Frames are scaled to stdout in the same "
+            "format\n"
+            "  --raw <w>x<h>  With --video: The input is raw RGBA frames of "
+            "this size\n"
+            "  --stats        Print pixel counts and timings of the scaler, "
+            "in builds\n"
+            "                 with USE_STATS. Not in batch mode\n"
+            "Target sizes may be factors of the input size, e.g. 4x. "
+            "Smaller targets,\n"
+            "e.g. 0.25x, are downscaled by area averaging.\n",
+            argv[0]);
+        return 1;
+    }
+
+    PixelAAOptions options;
+    pixel_aa_default_options(&options);
+    int band_rows = 0;
+    int batch = 0;
+    int num_jobs = 0;
+    int video = 0;
+    int show_stats = 0;
+    const char* raw_size = NULL;
+    for (int i = 4; i < argc; ++i) {
+        if (strcmp(argv[i], "--separable") == 0) {
+            options.separable = 1;
+        } else if (strcmp(argv[i], "--band") == 0 && i + 1 < argc) {
+            band_rows = atoi(argv[++i]);
+            if (band_rows < 1) {
+                printf("Invalid band height: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--curve") == 0 && i + 1 < argc) {
+            static const char* const curve_names[] = {"smoothstep",
+                                                      "slopestep", "linear"};
+            const char* name = argv[++i];
+            int curve = 0;
+            while (curve < 3 && strcmp(name, curve_names[curve]) != 0) {
+                ++curve;
+            }
+            if (curve == 3) {
+                printf("Unknown curve: %s\n", name);
+                return 1;
+            }
+            options.curve = (PixelAACurve)curve;
+        } else if (strcmp(argv[i], "--sharpness") == 0 && i + 1 < argc) {
+            options.sharpness = (float)atof(argv[++i]);
+            if (!(options.sharpness > 0.0f)) {
+                printf("Invalid sharpness: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = 1;
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            num_jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            show_stats = 1;
+        } else if (strcmp(argv[i], "--video") == 0) {
+            video = 1;
+        } else if (strcmp(argv[i], "--raw") == 0 && i + 1 < argc) {
+            raw_size = argv[++i];
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    const char* input_path = argv[1];
+    if (batch) {
+        return run_batch(input_path, argv[2], argv[3], &options, num_jobs);
+    }
+    if (video) {
+        return run_video(input_path, argv[2], argv[3], raw_size, &options,
+                         show_stats);
+    }
+    int in_width, in_height, channels;
+    unsigned char* in_img_data =
+        stbi_load(input_path, &in_width, &in_height, &channels, STBI_rgb_alpha);
+    if (!in_img_data) {
+        printf("Failed to load image.\n");
+        return 1;
+    }
+    if (channels != 3) {
+        printf("Only 3 channel images are supported. Image has %d channels.\n",
+               channels);
+        return 1;
+    }
+    channels = 4;
+    uint32_t* in = (uint32_t*)(in_img_data);
+
+    printf("Image loaded successfully.\n");
+    printf("Image width: %d\n", in_width);
+    printf("Image height: %d\n", in_height);
+    printf("Number of channels: %d\n", channels);
+
+    const int out_width = parse_target_size(argv[2], in_width);
+    const int out_height = parse_target_size(argv[3], in_height);
+    if (out_width <= 0 || out_height <= 0) {
+        printf("Error: Invalid target size.\n");
+        stbi_image_free(in_img_data);
+        return 1;
+    }
+    // The PNG writer works with int sizes.
+    const size_t output_size = (size_t)out_width * out_height * channels;
+    if (band_rows == 0 && output_size > INT_MAX) {
+        printf("Error: Output is too big for PNG, use --band.\n");
+        stbi_image_free(in_img_data);
+        return 1;
+    }
+
+    PixelAAContext* ctx = pixel_aa_create_with_options(
+        in_width, in_height, out_width, out_height, &options);
+    if (!ctx) {
+        printf("Failed to create scaling context.\n");
+        stbi_image_free(in_img_data);
+        return 1;
+    }
+
+    char* directory = get_parent_path(input_path);
+    char* file_name = get_filename(input_path);
+    char* output_file_name = remove_extension(file_name);
+    char* output_path = get_output_path(directory, output_file_name,
+                                        band_rows > 0 ? "pam" : "png");
+    int result = 0;
+
+    if (band_rows > 0) {
+        printf("Scaling in bands of %d rows to path: %s\n", band_rows,
+               output_path);
+        if (write_banded(ctx, in, in_width, out_width, out_height, band_rows,
+                         output_path) != 0) {
+            printf("Failed to save the output image.\n");
+            result = 1;
+        }
+    } else {
+        // Allocate memory for the output image
+        unsigned char* out_img_data =
+            (unsigned char*)malloc(output_size * sizeof(unsigned char));
+        uint32_t* out = (uint32_t*)out_img_data;
+        if (!out_img_data) {
+            printf("Failed to allocate the output image.\n");
+            result = 1;
+        } else {
+            // Single frame timing only, see pixel_aa_bench for proper
+            // measurements.
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+
+            pixel_aa_scale(ctx, in, out);
+
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            const double duration_ms =
+                (end.tv_sec - start.tv_sec) * 1000.0 +
+                (end.tv_nsec - start.tv_nsec) / 1000000.0;
+            printf("Scaled in %f ms.\n", duration_ms);
+
+            // Save the resulting image
+            printf("Saving output image to path: %s\n", output_path);
+            if (stbi_write_png(output_path, out_width, out_height, channels,
+                               out_img_data, out_width * channels) == 0) {
+                printf("Failed to save the output image.\n");
+                result = 1;
+            }
+        }
+        free(out_img_data);
+    }
+
+    if (result == 0) {
+        printf("Output image saved successfully!\n");
+    }
+    if (show_stats) {
+        print_stats(ctx, stdout);
+    }
+
+    free(directory);
+    free(file_name);
+    free(output_file_name);
+    free(output_path);
+    pixel_aa_destroy(ctx);
+    stbi_image_free(in_img_data);
+
+    return result;
+}
@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixel_aa_internal.h"
+
+// Palette input. Rows of indices are scaled horizontally into the ring of
+// the separable path, everything after that is the same as for other
+// formats. The horizontal blends only ever mix two palette colors with one
+// of the few weights of an x cycle, so they are precomputed for every pair
+// of colors and become a single lookup.
+
+static int compare_weights(const void* a, const void* b) {
+    const weight_t x = *(const weight_t*)a;
+    const weight_t y = *(const weight_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Index of `weight` in the sorted array `weights`.
+static int find_weight(const weight_t* weights, int count, weight_t weight) {
+    int lo = 0;
+    int hi = count - 1;
+    while (lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if (weights[mid] < weight) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int palette_init(PixelAAContext* ctx) {
+    const int out_width = ctx->out_width;
+    for (int i = 0; i < 256; ++i) {
+        ctx->palette[i] = 0xFF000000u | (uint32_t)i * 0x010101u;
+    }
+    ctx->num_colors = 256;
+    if (ctx->downscale) {
+        // Colors are looked up per pixel, there are no pairs to blend.
+        ctx->palette_mask = 255;
+        return 0;
+    }
+    ctx->pair_weights = (weight_t*)malloc(out_width * sizeof(weight_t));
+    ctx->column_weight = (int32_t*)calloc(out_width, sizeof(int32_t));
+    if (!ctx->pair_weights || !ctx->column_weight) {
+        return -1;
+    }
+    palette_set_weights(ctx);
+    return 0;
+}
+
+void palette_set_weights(PixelAAContext* ctx) {
+    const int out_width = ctx->out_width;
+    const int border_x = ctx->border_x;
+
+    // Collect the distinct weights of the blended center columns.
+    int num_weights = 0;
+    for (int x = border_x; x < out_width - border_x; ++x) {
+        const weight_t weight = ctx->weights_x[x];
+        if (weight >= WEIGHT_TOL && weight <= WEIGHT_TOL_UPPER) {
+            ctx->pair_weights[num_weights++] = weight;
+        }
+    }
+    qsort(ctx->pair_weights, num_weights, sizeof(weight_t), compare_weights);
+    int num_distinct = 0;
+    for (int i = 0; i < num_weights; ++i) {
+        if (num_distinct == 0 ||
+            ctx->pair_weights[i] != ctx->pair_weights[num_distinct - 1]) {
+            ctx->pair_weights[num_distinct++] = ctx->pair_weights[i];
+        }
+    }
+    ctx->num_pair_weights = num_distinct;
+
+    for (int x = border_x; x < out_width - border_x; ++x) {
+        const weight_t weight = ctx->weights_x[x];
+        if (weight < WEIGHT_TOL) {
+            ctx->column_weight[x] = 0;
+        } else if (weight > WEIGHT_TOL_UPPER) {
+            ctx->column_weight[x] = 1;
+        } else {
+            ctx->column_weight[x] =
+                2 + find_weight(ctx->pair_weights, num_distinct, weight);
+        }
+    }
+
+    // The blends depend on the weights. The number of colors is valid, so
+    // this can't fail.
+    uint32_t colors[256];
+    memcpy(colors, ctx->palette, sizeof(colors));
+    pixel_aa_set_palette(ctx, colors, ctx->num_colors);
+}
+
+int pixel_aa_set_palette(PixelAAContext* ctx, const uint32_t* colors,
+                         int num_colors) {
+    if (num_colors < 1 || num_colors > 256) {
+        return -1;
+    }
+    int size = 1;
+    while (size < num_colors) {
+        size *= 2;
+    }
+    memset(ctx->palette, 0, sizeof(ctx->palette));
+    memcpy(ctx->palette, colors, num_colors * sizeof(uint32_t));
+    ctx->num_colors = num_colors;
+    ctx->palette_mask = size - 1;
+
+    free(ctx->pair_tables);
+    ctx->pair_tables = NULL;
+    const size_t table_size = (size_t)size * size;
+    if (ctx->num_pair_weights == 0 ||
+        table_size * ctx->num_pair_weights * sizeof(uint32_t) >
+            MAX_PAIR_TABLE_BYTES) {
+        return 0;
+    }
+    ctx->pair_tables = (uint32_t*)malloc(table_size * ctx->num_pair_weights *
+                                         sizeof(uint32_t));
+    if (!ctx->pair_tables) {
+        // Still usable, blends are mixed per pixel.
+        return 0;
+    }
+    for (int k = 0; k < ctx->num_pair_weights; ++k) {
+        uint32_t* table = ctx->pair_tables + k * table_size;
+        const weight_t weight = ctx->pair_weights[k];
+        for (int a = 0; a < size; ++a) {
+            for (int b = 0; b < size; ++b) {
+                table[a * size + b] =
+                    mix_col(ctx->palette[a], ctx->palette[b], weight);
+            }
+        }
+    }
+    return 0;
+}
+
+void palette_scale_row_x(const PixelAAContext* ctx, const uint8_t* row,
+                         uint32_t* out, int x0, int x1) {
+    const uint32_t* palette = ctx->palette;
+    const int mask = ctx->palette_mask;
+    const int border_x = ctx->border_x;
+    const int center_end = ctx->out_width - border_x;
+    int x = x0;
+
+    // Left border, offset_x = 0
+    const uint32_t left = palette[row[0] & mask];
+    for (; x < x1 && x < border_x; ++x) {
+        out[x - x0] = left;
+    }
+
+    // Center part
+    const int end = x1 < center_end ? x1 : center_end;
+    const int32_t* src_x = ctx->src_x;
+    const int32_t* column_weight = ctx->column_weight;
+    const uint32_t* tables = ctx->pair_tables;
+    const size_t table_size = (size_t)(mask + 1) * (mask + 1);
+    for (; x < end; ++x) {
+        const int a = row[src_x[x]] & mask;
+        const int b = row[src_x[x] + 1] & mask;
+        const int k = column_weight[x];
+        uint32_t col;
+        if (k == 0) {
+            col = palette[a];
+        } else if (k == 1) {
+            col = palette[b];
+        } else if (tables) {
+            col = tables[(k - 2) * table_size + a * (mask + 1) + b];
+        } else {
+            col = mix_col(palette[a], palette[b], ctx->pair_weights[k - 2]);
+        }
+        out[x - x0] = col;
+    }
+
+    // Right border, offset_x = 1
+    const uint32_t right = palette[row[ctx->in_width - 1] & mask];
+    for (; x < x1; ++x) {
+        out[x - x0] = right;
+    }
+}
@@ -0,0 +1,329 @@
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
+
+#include "pixel_aa.h"
+#include "pixel_aa_internal.h"
+
+// A frame moves through the states of its slot in this order.
+enum {
+    SLOT_FREE,
+    // Acquired by the producer
+    SLOT_FILLING,
+    // Submitted, waiting for or being scaled
+    SLOT_QUEUED,
+    SLOT_SCALED,
+    // Completed, held by the consumer
+    SLOT_IN_USE,
+};
+
+typedef struct {
+    void* in;
+    void* out;
+    int state;
+    int64_t submit_ns;
+} PipelineSlot;
+
+struct PixelAAPipeline {
+    PixelAAContext* ctx;
+    int depth;
+    PipelineSlot* slots;
+    // Frames that went through each step so far. The next frame of a step is
+    // in slot count % depth.
+    int64_t num_acquired;
+    int64_t num_submitted;
+    int64_t num_scaled;
+    int64_t num_completed;
+    int64_t num_released;
+    int finished;
+    // Stats, in ns
+    int64_t first_submit_ns;
+    int64_t last_scaled_ns;
+    int64_t scale_ns_total;
+    int64_t scale_ns_max;
+    int64_t latency_ns_total;
+    int64_t latency_ns_max;
+    int64_t input_stall_ns;
+    int64_t scaler_idle_ns;
+    int64_t output_stall_ns;
+#ifdef USE_THREADS
+    pthread_t scaler;
+    int scaler_started;
+    int stop;
+    // Guards everything above. `changed` is broadcast whenever a slot
+    // changes state.
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+#endif  // USE_THREADS
+};
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void lock(PixelAAPipeline* pipeline) {
+#ifdef USE_THREADS
+    pthread_mutex_lock(&pipeline->mutex);
+#else   // !USE_THREADS
+    (void)pipeline;
+#endif  // USE_THREADS
+}
+
+static void unlock(PixelAAPipeline* pipeline) {
+#ifdef USE_THREADS
+    pthread_mutex_unlock(&pipeline->mutex);
+#else   // !USE_THREADS
+    (void)pipeline;
+#endif  // USE_THREADS
+}
+
+static void notify(PixelAAPipeline* pipeline) {
+#ifdef USE_THREADS
+    pthread_cond_broadcast(&pipeline->changed);
+#else   // !USE_THREADS
+    (void)pipeline;
+#endif  // USE_THREADS
+}
+
+// Scales the next queued frame. Called without the lock.
+static void scale_slot(PixelAAPipeline* pipeline, PipelineSlot* slot) {
+    const int64_t start = now_ns();
+    pixel_aa_scale(pipeline->ctx, slot->in, slot->out);
+    const int64_t end = now_ns();
+
+    lock(pipeline);
+    const int64_t scale_ns = end - start;
+    const int64_t latency_ns = end - slot->submit_ns;
+    pipeline->scale_ns_total += scale_ns;
+    if (scale_ns > pipeline->scale_ns_max) {
+        pipeline->scale_ns_max = scale_ns;
+    }
+    pipeline->latency_ns_total += latency_ns;
+    if (latency_ns > pipeline->latency_ns_max) {
+        pipeline->latency_ns_max = latency_ns;
+    }
+    pipeline->last_scaled_ns = end;
+    slot->state = SLOT_SCALED;
+    ++pipeline->num_scaled;
+    notify(pipeline);
+    unlock(pipeline);
+}
+
+#ifdef USE_THREADS
+static void* scaler_main(void* arg) {
+    PixelAAPipeline* pipeline = (PixelAAPipeline*)arg;
+    lock(pipeline);
+    for (;;) {
+        PipelineSlot* slot =
+            &pipeline->slots[pipeline->num_scaled % pipeline->depth];
+        const int64_t wait_start = now_ns();
+        while (!pipeline->stop && slot->state != SLOT_QUEUED) {
+            pthread_cond_wait(&pipeline->changed, &pipeline->mutex);
+        }
+        if (pipeline->stop) {
+            break;
+        }
+        // Waiting for the very first frame isn't a stall.
+        const int64_t idle_start = wait_start > pipeline->first_submit_ns
+                                       ? wait_start
+                                       : pipeline->first_submit_ns;
+        const int64_t idle_ns = now_ns() - idle_start;
+        if (idle_ns > 0) {
+            pipeline->scaler_idle_ns += idle_ns;
+        }
+        unlock(pipeline);
+        scale_slot(pipeline, slot);
+        lock(pipeline);
+    }
+    unlock(pipeline);
+    return NULL;
+}
+#endif  // USE_THREADS
+
+PixelAAPipeline* pixel_aa_pipeline_create(PixelAAContext* ctx, int depth) {
+    if (ctx->incremental) {
+        return NULL;
+    }
+    PixelAAPipeline* pipeline =
+        (PixelAAPipeline*)calloc(1, sizeof(PixelAAPipeline));
+    if (!pipeline) {
+        return NULL;
+    }
+    pipeline->ctx = ctx;
+    pipeline->depth = depth > 2 ? depth : 2;
+#ifdef USE_THREADS
+    pthread_mutex_init(&pipeline->mutex, NULL);
+    pthread_cond_init(&pipeline->changed, NULL);
+#endif  // USE_THREADS
+
+    pipeline->slots =
+        (PipelineSlot*)calloc(pipeline->depth, sizeof(PipelineSlot));
+    if (!pipeline->slots) {
+        pixel_aa_pipeline_destroy(pipeline);
+        return NULL;
+    }
+    for (int i = 0; i < pipeline->depth; ++i) {
+        PipelineSlot* slot = &pipeline->slots[i];
+        slot->in = malloc((size_t)ctx->in_width * ctx->in_height *
+                          pixel_aa_bytes_per_pixel(ctx->in_format));
+        slot->out = malloc((size_t)ctx->out_width * ctx->out_height *
+                           pixel_aa_bytes_per_pixel(ctx->out_format));
+        if (!slot->in || !slot->out) {
+            pixel_aa_pipeline_destroy(pipeline);
+            return NULL;
+        }
+    }
+
+#ifdef USE_THREADS
+    if (pthread_create(&pipeline->scaler, NULL, scaler_main, pipeline) != 0) {
+        pixel_aa_pipeline_destroy(pipeline);
+        return NULL;
+    }
+    pipeline->scaler_started = 1;
+#endif  // USE_THREADS
+    return pipeline;
+}
+
+void* pixel_aa_pipeline_acquire_input(PixelAAPipeline* pipeline) {
+    lock(pipeline);
+    PipelineSlot* slot =
+        &pipeline->slots[pipeline->num_acquired % pipeline->depth];
+    if (pipeline->num_acquired != pipeline->num_submitted ||
+        pipeline->finished) {
+        unlock(pipeline);
+        return NULL;
+    }
+#ifdef USE_THREADS
+    const int64_t wait_start = now_ns();
+    while (slot->state != SLOT_FREE) {
+        pthread_cond_wait(&pipeline->changed, &pipeline->mutex);
+    }
+    pipeline->input_stall_ns += now_ns() - wait_start;
+#else   // !USE_THREADS
+    // Only the caller itself could free it.
+    if (slot->state != SLOT_FREE) {
+        unlock(pipeline);
+        return NULL;
+    }
+#endif  // USE_THREADS
+    slot->state = SLOT_FILLING;
+    ++pipeline->num_acquired;
+    unlock(pipeline);
+    return slot->in;
+}
+
+void pixel_aa_pipeline_submit(PixelAAPipeline* pipeline) {
+    lock(pipeline);
+    if (pipeline->num_submitted == pipeline->num_acquired) {
+        unlock(pipeline);
+        return;
+    }
+    PipelineSlot* slot =
+        &pipeline->slots[pipeline->num_submitted % pipeline->depth];
+    slot->submit_ns = now_ns();
+    if (pipeline->num_submitted == 0) {
+        pipeline->first_submit_ns = slot->submit_ns;
+    }
+    slot->state = SLOT_QUEUED;
+    ++pipeline->num_submitted;
+    notify(pipeline);
+    unlock(pipeline);
+#ifndef USE_THREADS
+    scale_slot(pipeline, slot);
+#endif  // USE_THREADS
+}
+
+void pixel_aa_pipeline_finish(PixelAAPipeline* pipeline) {
+    lock(pipeline);
+    pipeline->finished = 1;
+    notify(pipeline);
+    unlock(pipeline);
+}
+
+const void* pixel_aa_pipeline_complete(PixelAAPipeline* pipeline) {
+    lock(pipeline);
+    PipelineSlot* slot =
+        &pipeline->slots[pipeline->num_completed % pipeline->depth];
+    const int64_t wait_start = now_ns();
+#ifdef USE_THREADS
+    while (slot->state != SLOT_SCALED &&
+           !(pipeline->finished &&
+             pipeline->num_completed == pipeline->num_submitted)) {
+        pthread_cond_wait(&pipeline->changed, &pipeline->mutex);
+    }
+#endif  // USE_THREADS
+    if (slot->state != SLOT_SCALED) {
+        unlock(pipeline);
+        return NULL;
+    }
+    pipeline->output_stall_ns += now_ns() - wait_start;
+    slot->state = SLOT_IN_USE;
+    ++pipeline->num_completed;
+    unlock(pipeline);
+    return slot->out;
+}
+
+void pixel_aa_pipeline_release(PixelAAPipeline* pipeline) {
+    lock(pipeline);
+    if (pipeline->num_released < pipeline->num_completed) {
+        pipeline->slots[pipeline->num_released % pipeline->depth].state =
+            SLOT_FREE;
+        ++pipeline->num_released;
+        notify(pipeline);
+    }
+    unlock(pipeline);
+}
+
+void pixel_aa_pipeline_get_stats(PixelAAPipeline* pipeline,
+                                 PixelAAPipelineStats* stats) {
+    lock(pipeline);
+    const int64_t num_scaled = pipeline->num_scaled;
+    stats->frames_submitted = pipeline->num_submitted;
+    stats->frames_completed = pipeline->num_completed;
+    stats->scale_ms_mean =
+        num_scaled > 0 ? pipeline->scale_ns_total * 1.0e-6 / num_scaled : 0.0;
+    stats->scale_ms_max = pipeline->scale_ns_max * 1.0e-6;
+    stats->latency_ms_mean =
+        num_scaled > 0 ? pipeline->latency_ns_total * 1.0e-6 / num_scaled
+                       : 0.0;
+    stats->latency_ms_max = pipeline->latency_ns_max * 1.0e-6;
+    stats->input_stall_ms = pipeline->input_stall_ns * 1.0e-6;
+    stats->scaler_idle_ms = pipeline->scaler_idle_ns * 1.0e-6;
+    stats->output_stall_ms = pipeline->output_stall_ns * 1.0e-6;
+    const int64_t elapsed_ns =
+        pipeline->last_scaled_ns - pipeline->first_submit_ns;
+    stats->frames_per_s =
+        num_scaled > 0 && elapsed_ns > 0 ? num_scaled * 1.0e9 / elapsed_ns
+                                         : 0.0;
+    unlock(pipeline);
+}
+
+void pixel_aa_pipeline_destroy(PixelAAPipeline* pipeline) {
+    if (!pipeline) {
+        return;
+    }
+#ifdef USE_THREADS
+    if (pipeline->scaler_started) {
+        lock(pipeline);
+        pipeline->stop = 1;
+        notify(pipeline);
+        unlock(pipeline);
+        pthread_join(pipeline->scaler, NULL);
+    }
+    pthread_mutex_destroy(&pipeline->mutex);
+    pthread_cond_destroy(&pipeline->changed);
+#endif  // USE_THREADS
+    if (pipeline->slots) {
+        for (int i = 0; i < pipeline->depth; ++i) {
+            free(pipeline->slots[i].in);
+            free(pipeline->slots[i].out);
+        }
+        free(pipeline->slots);
+    }
+    free(pipeline);
+}
@@ -2,52 +2,22 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
 
-// #define USE_OPENMP
-#ifdef USE_OPENMP
-#include "omp.h"
+#ifdef USE_THREADS
+#include <unistd.h>
 #endif
 
-// clang-format off
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <stb_image_write.h>
-// clang-format on
-
-#include "string_manip.h"
-
-#ifdef FIXED_POINT
-// We need a data type that's at least 8 bits bigger than
-// FIXED_POINT_BITS to handle multiplication with uchar and not overflow.
-// We need a signed fixed point type to deal with mix operation containing a
-// difference operation.
-// #define FIXED_POINT
-#define FIXED_POINT_BITS 8
-typedef int16_t fixed_point_t;
-typedef fixed_point_t weight_t;
-
-inline fixed_point_t float_to_fixed(float value) {
-    return (fixed_point_t)(value * (1 << FIXED_POINT_BITS));
-}
-
-inline fixed_point_t mix(fixed_point_t x, fixed_point_t y, fixed_point_t a) {
-    return x + ((a * (y - x)) >> FIXED_POINT_BITS);
-}
-
-#define WEIGHT_TOL 1
-#define WEIGHT_TOL_UPPER ((1 << FIXED_POINT_BITS) - WEIGHT_TOL)
-#else  // !FIXED_POINT
-typedef float weight_t;
-
-inline float mix(float x, float y, float a) { return x + a * (y - x); }
+#if defined(__arm__) && defined(__linux__)
+#include <sys/auxv.h>
+// From <asm/hwcap.h>, which isn't always installed
+#define HWCAP_ARM_NEON (1 << 12)
+#endif
 
-#define WEIGHT_TOL 1.0e-2f
-#define WEIGHT_TOL_UPPER (1.0f - WEIGHT_TOL)
-#endif  // FIXED_POINT
+#include "pixel_aa_internal.h"
+#include "thread_pool.h"
 
-inline float sign(float value) {
+static inline float sign(float value) {
     if (value < 0.0f) {
         return -1.0f;
     } else if (value > 0.0f) {
@@ -61,442 +31,1544 @@ inline float sign(float value) {
 
 // vec3 to_srgb(vec3 x) { return pow(x, vec3(1.0 / 2.2)); }
 
-#define GET_CH(color, c) (((color) >> (8 * (2 - (c)))) & 0xFF)
-#define GET_COL(r, g, b)                                              \
-    (((uint32_t)(r) << 16) | ((uint32_t)(g) << 8) | ((uint32_t)(b)) | \
-     0xFF << 24)
-
-float smoothstep(float edge0, float edge1, float x) {
+static inline float smoothstep(float edge0, float edge1, float x) {
     float t = fmaxf(0.0, fminf(1.0, (x - edge0) / (edge1 - edge0)));
     return t * t * (3.0 - 2.0 * t);
 }
 
-float slopestep(float edge0, float edge1, float x, float slope) {
+static inline float slopestep(float edge0, float edge1, float x, float slope) {
     x = fmaxf(0.0, fminf(1.0, (x - edge0) / (edge1 - edge0)));
     const float s = sign(x - 0.5f);
     const float o = (1.0f + s) * 0.5f;
-    return o - 0.5f * s * pow(2.0f * (o - s * x), slope);
-}
-
-int main(int argc, char* argv[]) {
-    if (argc < 4) {
-        printf("Usage: %s <input_path> <target_width> <target_height>\n",
-               argv[0]);
-        return 1;
-    }
-
-    const char* input_path = argv[1];
-    int in_width, in_height, channels;
-    unsigned char* in_img_data =
-        stbi_load(input_path, &in_width, &in_height, &channels, STBI_rgb_alpha);
-    if (!in_img_data) {
-        printf("Failed to load image.\n");
-        return 1;
-    }
-    if (channels != 3) {
-        printf("Only 3 channel images are supported. Image has %d channels.\n",
-               channels);
-        return 1;
-    }
-    channels = 4;
-    uint32_t* in = (uint32_t*)(in_img_data);
-
-    printf("Image loaded successfully.\n");
-    printf("Image width: %d\n", in_width);
-    printf("Image height: %d\n", in_height);
-    printf("Number of channels: %d\n", channels);
-
-    // Allocate memory for the output image
-    const int out_width = atoi(argv[2]);
-    const int out_height = atoi(argv[3]);
-    if (out_width < in_width || out_height < in_height) {
-        printf("Error: Target size is smaller than the input image size.\n");
-        stbi_image_free(in_img_data);
-        return 1;
-    }
-    const int output_size = out_width * out_height * channels;
-    unsigned char* out_img_data =
-        (unsigned char*)malloc(output_size * sizeof(unsigned char));
-    uint32_t* out = (uint32_t*)out_img_data;
-
-    // Stuff that's constant over the whole image
-    // Iteration limits: For the first and last N pixels in each row and column,
-    // we don't need to interpolate as we simply sample the border pixel from
-    // the input image. This not just saves computations, but also allows us to
-    // drop boundary checks throughout the sampling.
-    // Derivation:
-    /*
-    in_x >= pixel transition start
-    in_x >= 0.5f - in_x_step * 0.5f
-    (0.5 + x) * s - 0.5 >= 0.5 - s * 0.5
-    =>
-    x >= 1 / s - 1
-    */
-    const int border_x = out_width >= in_width ? out_width / in_width - 1 : 0;
-    const int border_y =
-        out_height >= in_height ? out_height / in_height - 1 : 0;
-    // Precompute interpolation weights
-    // constexpr float sharpness = 1.5f;
-    weight_t* weights_x = (weight_t*)malloc(out_width * sizeof(weight_t));
-    weight_t* weights_y = (weight_t*)malloc(out_height * sizeof(weight_t));
-
-    for (int x = 0, in_x_error = in_width / 2 - out_width / 2 - out_width;
-         x < out_width; ++x, in_x_error += in_width) {
-        if (in_x_error >= 0) {
-            in_x_error -= out_width;
+    return o - 0.5f * s * powf(2.0f * (o - s * x), slope);
+}
+
+static inline float linearstep(float edge0, float edge1, float x) {
+    return fmaxf(0.0, fminf(1.0, (x - edge0) / (edge1 - edge0)));
+}
+
+#ifdef FIXED_POINT
+// Fixed point weight of an output pixel whose phase is error / out_size,
+// without any float math. This is smoothstep() over the transition of width
+// in_size / out_size centered at 0.5, with t = num / den and
+// num = 2 * error - out_size + in_size, den = 2 * in_size. The result is
+// exactly floor(t^2 * (3 - 2t) * WEIGHT_ONE).
+static weight_t smoothstep_fixed(int error, int in_size, int out_size) {
+    int64_t num = 2 * (int64_t)error - out_size + in_size;
+    int64_t den = 2 * (int64_t)in_size;
+    if (num <= 0) {
+        return 0;
+    }
+    if (num >= den) {
+        return WEIGHT_ONE;
+    }
+    // num^2 * (3 * den - 2 * num) <= den^3, which fits in 64 bits with the
+    // fractional bits up to den = 2^18. Bigger inputs lose low bits of t.
+    while (den > (1 << 18)) {
+        num >>= 1;
+        den >>= 1;
+    }
+    return (weight_t)((num * num * (3 * den - 2 * num) << FIXED_POINT_BITS) /
+                      (den * den * den));
+}
+
+// Exactly floor(t * WEIGHT_ONE), with t as in smoothstep_fixed().
+static weight_t linearstep_fixed(int error, int in_size, int out_size) {
+    const int64_t num = 2 * (int64_t)error - out_size + in_size;
+    const int64_t den = 2 * (int64_t)in_size;
+    if (num <= 0) {
+        return 0;
+    }
+    if (num >= den) {
+        return WEIGHT_ONE;
+    }
+    return (weight_t)((num << FIXED_POINT_BITS) / den);
+}
+
+// Fractional bits of the logarithms and exponents of slopestep_fixed().
+#define LOG_BITS 16
+
+// 2^(-2^-(i + 1)) with 30 fractional bits, the factors of exp2_fixed().
+static const uint32_t exp2_factors[LOG_BITS] = {
+    759250125u,  902905651u,  984625594u,  1028218693u,
+    1050733751u, 1062175491u, 1067942999u, 1070838486u,
+    1072289173u, 1073015252u, 1073378477u, 1073560135u,
+    1073650976u, 1073696399u, 1073719111u, 1073730468u,
+};
+
+// log2(x) with LOG_BITS fractional bits, rounded down, for x > 0. The
+// mantissa is normalized to [1, 2) with 30 fractional bits and squared once
+// per fractional bit: Each time it reaches 2, that bit is set.
+static int64_t log2_fixed(int64_t x) {
+    int64_t result = 0;
+    while (x >= (int64_t)2 << 30) {
+        x >>= 1;
+        result += 1 << LOG_BITS;
+    }
+    while (x < (int64_t)1 << 30) {
+        x <<= 1;
+        result -= 1 << LOG_BITS;
+    }
+    uint64_t y = (uint64_t)x;
+    for (int bit = LOG_BITS - 1; bit >= 0; --bit) {
+        y = y * y >> 30;
+        if (y >= (uint64_t)2 << 30) {
+            y >>= 1;
+            result += 1 << bit;
         }
+    }
+    return result;
+}
 
-        // To get phase back without calc. in_x_f, shift back by +out_width
-        // again, and divide by out_width.
-        const float phase = (float)(in_x_error + out_width) / out_width;
+// 2^-e with 30 fractional bits, for e >= 0 with LOG_BITS fractional bits.
+// The fraction is a product of the exp2_factors of its bits, the integer
+// part a shift.
+static uint32_t exp2_fixed(int64_t e) {
+    if (e >= (int64_t)31 << LOG_BITS) {
+        return 0;
+    }
+    uint64_t result = 1u << 30;
+    for (int i = 0; i < LOG_BITS; ++i) {
+        if (e & (1 << (LOG_BITS - 1 - i))) {
+            result = result * exp2_factors[i] >> 30;
+        }
+    }
+    return (uint32_t)(result >> (e >> LOG_BITS));
+}
 
-        const float in_x_step = (float)(in_width) / out_width;
+// slopestep() with t as in smoothstep_fixed(), in integer math: With
+// u = 2t below the center and u = 2 - 2t above it, half of u^sharpness is
+// 2^(sharpness * log2(u)) / 2. The sharpness is rounded to LOG_BITS
+// fractional bits and capped at 2^24.
+static weight_t slopestep_fixed(int error, int in_size, int out_size,
+                                float sharpness) {
+    const int64_t num = 2 * (int64_t)error - out_size + in_size;
+    const int64_t den = 2 * (int64_t)in_size;
+    if (num <= 0) {
+        return 0;
+    }
+    if (num >= den) {
+        return WEIGHT_ONE;
+    }
+    const int64_t slope = sharpness < 16777216.0f
+                              ? (int64_t)(sharpness * (1 << LOG_BITS) + 0.5f)
+                              : (int64_t)16777216 << LOG_BITS;
+    const int upper = 2 * num >= den;
+    const int64_t u_num = upper ? 2 * (den - num) : 2 * num;
+    // -log2(u) <= log2(den) < 33, so the product fits 64 bits.
+    const int64_t log_u = log2_fixed(u_num) - log2_fixed(den);
+    const uint32_t half = exp2_fixed((-log_u * slope) >> LOG_BITS) >> 1;
+    const uint32_t weight = upper ? (1u << 30) - half : half;
+    return (weight_t)(weight >> (30 - FIXED_POINT_BITS));
+}
+#endif  // FIXED_POINT
+
+// Weight of the second sample of an output pixel whose phase is
+// error / out_size, for each PixelAACurve. The transition has a width of
+// in_size / out_size and is centered at 0.5.
+typedef weight_t (*curve_fn)(int error, int in_size, int out_size,
+                             float sharpness);
+
+static weight_t curve_smoothstep(int error, int in_size, int out_size,
+                                 float sharpness) {
+    (void)sharpness;
 #ifdef FIXED_POINT
-        weights_x[x] = float_to_fixed(smoothstep(
-            0.5f - in_x_step * 0.5f, 0.5f + in_x_step * 0.5f, phase));
+    return smoothstep_fixed(error, in_size, out_size);
 #else   // !FIXED_POINT
-        weights_x[x] =
-            smoothstep(0.5f - in_x_step * 0.5f, 0.5f + in_x_step * 0.5f, phase);
+    const float phase = (float)error / out_size;
+    const float step = (float)in_size / out_size;
+    return smoothstep(0.5f - step * 0.5f, 0.5f + step * 0.5f, phase);
 #endif  // FIXED_POINT
-    }
-    for (int y = 0, in_y_error = in_height / 2 - out_height / 2 - out_height;
-         y < out_height; ++y, in_y_error += in_height) {
-        if (in_y_error >= 0) {
-            in_y_error -= out_height;
-        }
-        const float phase = (float)(in_y_error + out_height) / out_height;
+}
+
+static weight_t curve_slopestep(int error, int in_size, int out_size,
+                                float sharpness) {
+#ifdef FIXED_POINT
+    return slopestep_fixed(error, in_size, out_size, sharpness);
+#else   // !FIXED_POINT
+    const float phase = (float)error / out_size;
+    const float step = (float)in_size / out_size;
+    return slopestep(0.5f - step * 0.5f, 0.5f + step * 0.5f, phase,
+                     sharpness);
+#endif  // FIXED_POINT
+}
 
-        const float in_y_step = (float)(in_height) / out_height;
+static weight_t curve_linear(int error, int in_size, int out_size,
+                             float sharpness) {
+    (void)sharpness;
 #ifdef FIXED_POINT
-        weights_y[y] = float_to_fixed(smoothstep(
-            0.5f - in_y_step * 0.5f, 0.5f + in_y_step * 0.5f, phase));
+    return linearstep_fixed(error, in_size, out_size);
 #else   // !FIXED_POINT
-        weights_y[y] =
-            smoothstep(0.5f - in_y_step * 0.5f, 0.5f + in_y_step * 0.5f, phase);
+    const float phase = (float)error / out_size;
+    const float step = (float)in_size / out_size;
+    return linearstep(0.5f - step * 0.5f, 0.5f + step * 0.5f, phase);
 #endif  // FIXED_POINT
+}
+
+static const curve_fn curves[] = {
+    curve_smoothstep,
+    curve_slopestep,
+    curve_linear,
+};
+
+// Weights that would make the scalar kernels take a 1 sample branch are set
+// to exactly 0 or 1, which gives the same result in branch-free kernels.
+static void snap_weights(weight_t* weights, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (weights[i] < WEIGHT_TOL) {
+            weights[i] = 0;
+        } else if (weights[i] > WEIGHT_TOL_UPPER) {
+            weights[i] = WEIGHT_ONE;
+        }
+    }
+}
+
+// Where the first sample of an output pixel is src and the second one is
+// src + 1, makes sure both lie inside the image. Samples outside of it are
+// replaced by the nearest edge pixel. Without this, the row and column
+// walks could read one pixel past the image for some ratios < 2.
+static void clamp_samples(int32_t* src, weight_t* weights, int count,
+                          int in_size) {
+    for (int i = 0; i < count; ++i) {
+        if (src[i] < 0) {
+            src[i] = 0;
+            weights[i] = 0;
+        } else if (src[i] + 1 > in_size - 1) {
+            src[i] = in_size - 2;
+            weights[i] = WEIGHT_ONE;
+        }
     }
+}
 
-    // Measure performance
-    struct timespec start, end;
-    const int num_perf_passes = 1000;
-    clock_gettime(CLOCK_MONOTONIC, &start);
+// Used for finding "cycle length" of repeating pixel offsets
+// Between input and output.
+static int gcd(int a, int b) {
+    if (b > a) {
+        int temp = a;
+        a = b;
+        b = temp;
+    }
+
+    while (b != 0) {
+        int remainder = a % b;
+        a = b;
+        b = remainder;
+    }
 
-    // Iterate over all pixels in the output image
-    for (int perf_pass = 0; perf_pass < num_perf_passes; ++perf_pass) {
-        // Top border, offset_y is effectively = 0
-        for (int y = 0; y < border_y; ++y) {
-            const int out_row_offset = y * out_width;
+    return a;
+}
 
-            // Top left corner, offset_x = 0
-            for (int x = 0; x < border_x; ++x) {
-                out[out_row_offset + x] = in[0];
+// Classifies `count` center columns into spans, merging neighbours that are
+// produced the same way. Input columns are stored relative to src_base.
+// Returns the number of spans written.
+static int build_spans(const int32_t* src_x, const weight_t* weights_x,
+                       int count, int32_t src_base, Span* spans,
+                       int32_t* blend_src, weight_t* blend_weights,
+                       int* num_blend) {
+    int num_spans = 0;
+    for (int i = 0; i < count; ++i) {
+        Span* last = num_spans > 0 ? &spans[num_spans - 1] : NULL;
+        const int32_t src = src_x[i] - src_base;
+        const weight_t offset_x = weights_x[i];
+        if (offset_x >= WEIGHT_TOL && offset_x <= WEIGHT_TOL_UPPER) {
+            // Need 2 samples, mix with offset_x
+            if (last && last->type == SPAN_BLEND) {
+                ++last->count;
+            } else {
+                spans[num_spans++] = (Span){SPAN_BLEND, 1, *num_blend, i};
             }
+            blend_src[*num_blend] = src;
+            blend_weights[*num_blend] = offset_x;
+            ++*num_blend;
+            continue;
+        }
 
-            // Middle part of top bar
-            int in_x_error =
-                in_width / 2 - out_width / 2 - out_width + in_width * border_x;
-            uint32_t* in_ptr[2] = {in, in + 1};
-            for (int x = border_x; x < out_width - border_x;
-                 ++x, in_x_error += in_width) {
-                // Update samples when we've moved enough.
-                if (in_x_error >= 0) {
-                    in_x_error -= out_width;
-                    // Shift samples one to right.
-                    ++in_ptr[0];
-                    ++in_ptr[1];
-                }
+        // Need 1 sample, no mixing
+        const int32_t sample = offset_x < WEIGHT_TOL ? src : src + 1;
+        if (last && last->type == SPAN_FILL && last->index == sample) {
+            ++last->count;
+        } else if (last && last->type == SPAN_FILL && last->count == 1 &&
+                   last->index + 1 == sample) {
+            last->type = SPAN_COPY;
+            ++last->count;
+        } else if (last && last->type == SPAN_COPY &&
+                   last->index + last->count == sample) {
+            ++last->count;
+        } else {
+            spans[num_spans++] = (Span){SPAN_FILL, 1, sample, i};
+        }
+    }
+    return num_spans;
+}
 
-                const weight_t offset_x = weights_x[x];
-                if (offset_x < WEIGHT_TOL) {
-                    // Need 1 sample, no mixing
-                    out[out_row_offset + x] = *in_ptr[0];
-                } else if (offset_x > WEIGHT_TOL_UPPER) {
-                    // Need 1 sample, no mixing
-                    out[out_row_offset + x] = *in_ptr[1];
-                } else {
-                    // Need 2 samples, mix with offset_x
-                    out[out_row_offset + x] =
-                        GET_COL(mix(GET_CH(*in_ptr[0], 0),
-                                    GET_CH(*in_ptr[1], 0), offset_x),
-                                mix(GET_CH(*in_ptr[0], 1),
-                                    GET_CH(*in_ptr[1], 1), offset_x),
-                                mix(GET_CH(*in_ptr[0], 2),
-                                    GET_CH(*in_ptr[1], 2), offset_x));
-                }
+int pixel_aa_bytes_per_pixel(PixelAAFormat format) {
+    switch (format) {
+        case PIXEL_AA_FORMAT_RGB565:
+            return 2;
+        case PIXEL_AA_FORMAT_INDEX8:
+            return 1;
+        default:
+            return 4;
+    }
+}
+
+static int format_layout(PixelAAFormat format) {
+    switch (format) {
+        case PIXEL_AA_FORMAT_BGRA8888:
+            return LAYOUT_SWAPPED;
+        case PIXEL_AA_FORMAT_RGBA8888:
+            return LAYOUT_ALPHA_LOW;
+        case PIXEL_AA_FORMAT_RGB565:
+            return LAYOUT_RGB565;
+        case PIXEL_AA_FORMAT_INDEX8:
+            return LAYOUT_INDEX8;
+        default:
+            return LAYOUT_ALPHA_HIGH;
+    }
+}
+
+// Sets up the hash and dependency tables of the incremental mode. Returns 0
+// on success.
+static int init_incremental(PixelAAContext* ctx) {
+    const int in_width = ctx->in_width;
+    const int out_width = ctx->out_width;
+    ctx->num_hash_blocks =
+        (in_width + DIRTY_BLOCK_WIDTH - 1) / DIRTY_BLOCK_WIDTH;
+    ctx->block_hashes = (uint64_t*)malloc(
+        (size_t)ctx->in_height * ctx->num_hash_blocks * sizeof(uint64_t));
+    ctx->in_dirty_x0 = (int32_t*)malloc(ctx->in_height * sizeof(int32_t));
+    ctx->in_dirty_x1 = (int32_t*)malloc(ctx->in_height * sizeof(int32_t));
+    ctx->dep_x0 = (int32_t*)malloc(in_width * sizeof(int32_t));
+    ctx->dep_x1 = (int32_t*)malloc(in_width * sizeof(int32_t));
+    ctx->out_dirty_x0 = (int32_t*)malloc(ctx->out_height * sizeof(int32_t));
+    ctx->out_dirty_x1 = (int32_t*)malloc(ctx->out_height * sizeof(int32_t));
+    if (!ctx->block_hashes || !ctx->in_dirty_x0 || !ctx->in_dirty_x1 ||
+        !ctx->dep_x0 || !ctx->dep_x1 || !ctx->out_dirty_x0 ||
+        !ctx->out_dirty_x1) {
+        return -1;
+    }
+
+    // Both samples count, whatever the weight. This is the one pixel
+    // footprint of the blend.
+    for (int x = 0; x < in_width; ++x) {
+        ctx->dep_x0[x] = out_width;
+        ctx->dep_x1[x] = 0;
+    }
+    for (int x = 0; x < out_width; ++x) {
+        int first = ctx->src_x[x];
+        int last = first + 1 < in_width ? first + 1 : first;
+        if (x < ctx->border_x) {
+            first = last = 0;
+        } else if (x >= out_width - ctx->border_x) {
+            first = last = in_width - 1;
+        }
+        for (int in_x = first; in_x <= last; ++in_x) {
+            if (x < ctx->dep_x0[in_x]) {
+                ctx->dep_x0[in_x] = x;
             }
+            ctx->dep_x1[in_x] = x + 1;
+        }
+    }
+    return 0;
+}
+
+const PixelAAKernels* const pixel_aa_kernel_sets[] = {
+    &pixel_aa_kernels_scalar,
+#ifdef PIXEL_AA_HAVE_SSE2
+    &pixel_aa_kernels_sse2,
+#endif
+#ifdef PIXEL_AA_HAVE_AVX2
+    &pixel_aa_kernels_avx2,
+#endif
+#ifdef PIXEL_AA_HAVE_NEON
+    &pixel_aa_kernels_neon,
+#endif
+};
+
+const int pixel_aa_num_kernel_sets =
+    sizeof(pixel_aa_kernel_sets) / sizeof(pixel_aa_kernel_sets[0]);
+
+int kernels_supported(const PixelAAKernels* kernels) {
+#ifdef PIXEL_AA_HAVE_AVX2
+    if (kernels == &pixel_aa_kernels_avx2) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif  // PIXEL_AA_HAVE_AVX2
+#ifdef PIXEL_AA_HAVE_SSE2
+    if (kernels == &pixel_aa_kernels_sse2) {
+        return __builtin_cpu_supports("sse2");
+    }
+#endif  // PIXEL_AA_HAVE_SSE2
+#if defined(PIXEL_AA_HAVE_NEON) && !defined(__aarch64__) && defined(__linux__)
+    if (kernels == &pixel_aa_kernels_neon) {
+        return (getauxval(AT_HWCAP) & HWCAP_ARM_NEON) != 0;
+    }
+#endif
+    (void)kernels;
+    return 1;
+}
 
-            // Top right corner, offset_x = 1
-            for (int x = out_width - border_x; x < out_width; ++x) {
-                out[out_row_offset + x] = in[in_width - 1];
+// The fastest kernels the CPU supports. The environment variable
+// PIXEL_AA_KERNELS can name a set to use instead, e.g. "scalar" for
+// testing, as long as the CPU supports it.
+static const PixelAAKernels* select_kernels(void) {
+    const char* name = getenv("PIXEL_AA_KERNELS");
+    if (name) {
+        for (int i = 0; i < pixel_aa_num_kernel_sets; ++i) {
+            if (strcmp(name, pixel_aa_kernel_sets[i]->name) == 0 &&
+                kernels_supported(pixel_aa_kernel_sets[i])) {
+                return pixel_aa_kernel_sets[i];
             }
         }
+    }
+    for (int i = pixel_aa_num_kernel_sets - 1; i > 0; --i) {
+        if (kernels_supported(pixel_aa_kernel_sets[i])) {
+            return pixel_aa_kernel_sets[i];
+        }
+    }
+    return &pixel_aa_kernels_scalar;
+}
 
-#ifdef USE_OPENMP
-#pragma omp parallel
-#endif  // USE_OPENMP
-        {
-#ifdef USE_OPENMP
-            int num_threads = omp_get_num_threads();
-            int thread_num = omp_get_thread_num();
-#else   // !USE_OPENMP
-            int num_threads = 1;
-            int thread_num = 0;
-#endif  // USE_OPENMP
-
-            int start_y = border_y + (out_height - border_y - border_y) *
-                                         thread_num / num_threads;
-            int end_y = border_y + (out_height - border_y - border_y) *
-                                       (thread_num + 1) / num_threads;
-
-            int in_y_error = ((in_height / 2 - out_height / 2 - out_height +
-                               start_y * in_height + out_height) %
-                              out_height) -
-                             out_height;
-
-            int in_start_y = (start_y * in_height + in_height / 2);
-            in_start_y = in_start_y / out_height -
-                         (in_start_y % out_height < out_height / 2 ? 1 : 0);
-            int in_row_offset = in_start_y * in_width;
-            for (int y = start_y; y < end_y; ++y, in_y_error += in_height) {
-                // Shift input row when we've moved enough.
-                if (in_y_error >= 0) {
-                    in_y_error -= out_height;
-                    in_row_offset += in_width;
-                }
+const char* pixel_aa_get_kernels_name(const PixelAAContext* ctx) {
+    return ctx->kernels->name;
+}
 
-                const int out_row_offset = y * out_width;
-
-                const weight_t offset_y = weights_y[y];
-
-                // Left border, offset_x = 0
-                uint32_t col;
-                if (offset_y < WEIGHT_TOL) {
-                    col = in[in_row_offset];
-                } else if (offset_y > WEIGHT_TOL_UPPER) {
-                    col = in[in_row_offset + in_width];
-                } else {
-                    col = GET_COL(
-                        mix(GET_CH(in[in_row_offset], 0),
-                            GET_CH(in[in_row_offset + in_width], 0), offset_y),
-                        mix(GET_CH(in[in_row_offset], 1),
-                            GET_CH(in[in_row_offset + in_width], 1), offset_y),
-                        mix(GET_CH(in[in_row_offset], 2),
-                            GET_CH(in[in_row_offset + in_width], 2), offset_y));
-                }
-                for (int x = 0; x < border_x; ++x) {
-                    out[out_row_offset + x] = col;
-                }
+// Weights of one axis, for output pixels whose phase is
+// (error + out_size) / out_size. Once the error term has settled in
+// [-out_size, 0), the phases repeat every out_size / gcd(out_size, in_size)
+// pixels, so the curve is only evaluated up to the end of the first cycle.
+static void compute_axis_weights(weight_t* weights, int out_size, int in_size,
+                                 curve_fn curve, float sharpness) {
+    const int cycle_length = out_size / gcd(out_size, in_size);
+    int cycle_end = -1;
+    for (int i = 0, error = in_size / 2 - out_size / 2 - out_size;
+         i < out_size; ++i, error += in_size) {
+        if (error >= 0) {
+            error -= out_size;
+        }
+        if (error >= -out_size && cycle_end < 0) {
+            cycle_end = i + cycle_length;
+        }
+        weights[i] = cycle_end < 0 || i < cycle_end
+                         ? curve(error + out_size, in_size, out_size, sharpness)
+                         : weights[i - cycle_length];
+    }
+}
 
-                // Keep all values relevant for interpolation in memory
-                // and update them lazily.
-                int in_x_error = in_width / 2 - out_width / 2 - out_width +
-                                 in_width * border_x;
-                uint32_t* in_ptr[4] = {in + in_row_offset,
-                                       in + in_row_offset + 1,
-                                       in + in_row_offset + in_width,
-                                       in + in_row_offset + in_width + 1};
-                // Center part of image
-                for (int x = border_x; x < out_width - border_x;
-                     ++x, in_x_error += in_width) {
-                    // Update samples when we've moved enough.
-                    if (in_x_error >= 0) {
-                        in_x_error -= out_width;
-                        // Shift samples one to right.
-                        ++in_ptr[0];
-                        ++in_ptr[1];
-                        ++in_ptr[2];
-                        ++in_ptr[3];
-                    }
-
-                    // Calc. and write output pixel
-                    // Do a bilinear sampling with branching for often-occuring
-                    // 0 and 1 weight samples.
-                    const weight_t offset_x = weights_x[x];
-                    if (offset_y < WEIGHT_TOL) {
-                        if (offset_x < WEIGHT_TOL) {
-                            // Need 1 sample, no mixing
-                            out[out_row_offset + x] = *in_ptr[0];
-                        } else if (offset_x > WEIGHT_TOL_UPPER) {
-                            // Need 1 sample, no mixing
-                            out[out_row_offset + x] = *in_ptr[1];
-                        } else {
-                            // Need 2 samples, mix with offset_x
-                            out[out_row_offset + x] =
-                                GET_COL(mix(GET_CH(*in_ptr[0], 0),
-                                            GET_CH(*in_ptr[1], 0), offset_x),
-                                        mix(GET_CH(*in_ptr[0], 1),
-                                            GET_CH(*in_ptr[1], 1), offset_x),
-                                        mix(GET_CH(*in_ptr[0], 2),
-                                            GET_CH(*in_ptr[1], 2), offset_x));
-                        }
-                    } else if (offset_y > WEIGHT_TOL_UPPER) {
-                        if (offset_x < WEIGHT_TOL) {
-                            // Need 1 sample, no mixing
-                            out[out_row_offset + x] = *in_ptr[2];
-                        } else if (offset_x > WEIGHT_TOL_UPPER) {
-                            // Need 1 sample, no mixing
-                            out[out_row_offset + x] = *in_ptr[3];
-                        } else {
-                            // Need 2 samples, mix with offset_x
-                            out[out_row_offset + x] =
-                                GET_COL(mix(GET_CH(*in_ptr[2], 0),
-                                            GET_CH(*in_ptr[3], 0), offset_x),
-                                        mix(GET_CH(*in_ptr[2], 1),
-                                            GET_CH(*in_ptr[3], 1), offset_x),
-                                        mix(GET_CH(*in_ptr[2], 2),
-                                            GET_CH(*in_ptr[3], 2), offset_x));
-                        }
-                    } else {
-                        if (offset_x < WEIGHT_TOL) {
-                            // Need 2 samples, mix with offset_y
-                            out[out_row_offset + x] =
-                                GET_COL(mix(GET_CH(*in_ptr[0], 0),
-                                            GET_CH(*in_ptr[2], 0), offset_y),
-                                        mix(GET_CH(*in_ptr[0], 1),
-                                            GET_CH(*in_ptr[2], 1), offset_y),
-                                        mix(GET_CH(*in_ptr[0], 2),
-                                            GET_CH(*in_ptr[2], 2), offset_y));
-                        } else if (offset_x > WEIGHT_TOL_UPPER) {
-                            // Need 2 samples, mix with offset_y
-                            out[out_row_offset + x] =
-                                GET_COL(mix(GET_CH(*in_ptr[1], 0),
-                                            GET_CH(*in_ptr[3], 0), offset_y),
-                                        mix(GET_CH(*in_ptr[1], 1),
-                                            GET_CH(*in_ptr[3], 1), offset_y),
-                                        mix(GET_CH(*in_ptr[1], 2),
-                                            GET_CH(*in_ptr[3], 2), offset_y));
-                        } else {
-                            // Need 4 samples, mix with offset_x and offset_y
-                            out[out_row_offset + x] = GET_COL(
-                                mix(mix(GET_CH(*in_ptr[0], 0),
-                                        GET_CH(*in_ptr[1], 0), offset_x),
-                                    mix(GET_CH(*in_ptr[2], 0),
-                                        GET_CH(*in_ptr[3], 0), offset_x),
-                                    offset_y),
-                                mix(mix(GET_CH(*in_ptr[0], 1),
-                                        GET_CH(*in_ptr[1], 1), offset_x),
-                                    mix(GET_CH(*in_ptr[2], 1),
-                                        GET_CH(*in_ptr[3], 1), offset_x),
-                                    offset_y),
-                                mix(mix(GET_CH(*in_ptr[0], 2),
-                                        GET_CH(*in_ptr[1], 2), offset_x),
-                                    mix(GET_CH(*in_ptr[2], 2),
-                                        GET_CH(*in_ptr[3], 2), offset_x),
-                                    offset_y));
-                        }
-                    }
-                }
+// Fills the weights and samples of all output columns and rows for the
+// current curve.
+static void compute_samples(PixelAAContext* ctx) {
+    const int in_width = ctx->in_width;
+    const int in_height = ctx->in_height;
+    const int out_width = ctx->out_width;
+    const int out_height = ctx->out_height;
+    weight_t* weights_x = ctx->weights_x;
+    weight_t* weights_y = ctx->weights_y;
+    int32_t* src_x = ctx->src_x;
+    int32_t* src_y = ctx->src_y;
 
-                // Right border, offset_x = 1
-                if (offset_y < WEIGHT_TOL) {
-                    col = in[in_row_offset + in_width - 1];
-                } else if (offset_y > WEIGHT_TOL_UPPER) {
-                    col = in[in_row_offset + 2 * in_width - 1];
-                } else {
-                    col = GET_COL(
-                        mix(GET_CH(in[in_row_offset + in_width - 1], 0),
-                            GET_CH(in[in_row_offset + 2 * in_width - 1], 0),
-                            offset_y),
-                        mix(GET_CH(in[in_row_offset + in_width - 1], 1),
-                            GET_CH(in[in_row_offset + 2 * in_width - 1], 1),
+    const curve_fn curve = curves[ctx->curve];
+    compute_axis_weights(weights_x, out_width, in_width, curve,
+                         ctx->sharpness);
+    compute_axis_weights(weights_y, out_height, in_height, curve,
+                         ctx->sharpness);
+    snap_weights(weights_x, out_width);
+    snap_weights(weights_y, out_height);
+
+    // Walk the center columns the same way the scaling loop used to, keeping
+    // track of the left sample.
+    const int border_x = ctx->border_x;
+    for (int x = border_x,
+             in_x_error = in_width / 2 - out_width / 2 - out_width +
+                          in_width * border_x,
+             in_x = 0;
+         x < out_width - border_x; ++x, in_x_error += in_width) {
+        // Update samples when we've moved enough.
+        if (in_x_error >= 0) {
+            in_x_error -= out_width;
+            ++in_x;
+        }
+        src_x[x] = in_x;
+    }
+    clamp_samples(src_x + border_x, weights_x + border_x,
+                  out_width - border_x - border_x, in_width);
+
+    // Same for the center rows.
+    const int border_y = ctx->border_y;
+    int in_y_error = ((in_height / 2 - out_height / 2 - out_height +
+                       border_y * in_height + out_height) %
+                      out_height) -
+                     out_height;
+    int in_y = (border_y * in_height + in_height / 2);
+    in_y = in_y / out_height - (in_y % out_height < out_height / 2 ? 1 : 0);
+    for (int y = border_y; y < out_height - border_y;
+         ++y, in_y_error += in_height) {
+        // Shift input row when we've moved enough.
+        if (in_y_error >= 0) {
+            in_y_error -= out_height;
+            ++in_y;
+        }
+        src_y[y] = in_y;
+    }
+    clamp_samples(src_y + border_y, weights_y + border_y,
+                  out_height - border_y - border_y, in_height);
+
+    // The top and bottom border rows sample the first and last input row.
+    for (int y = 0; y < border_y; ++y) {
+        src_y[y] = 0;
+        weights_y[y] = 0;
+        src_y[out_height - 1 - y] = in_height - 1;
+        weights_y[out_height - 1 - y] = 0;
+    }
+}
+
+// Builds the duplicate rows and the span tables from the weights.
+static void build_tables(PixelAAContext* ctx) {
+    const int in_width = ctx->in_width;
+    const int in_height = ctx->in_height;
+    const int out_width = ctx->out_width;
+    const int out_height = ctx->out_height;
+    const int border_x = ctx->border_x;
+    const weight_t* weights_x = ctx->weights_x;
+    const weight_t* weights_y = ctx->weights_y;
+    const int32_t* src_x = ctx->src_x;
+    const int32_t* src_y = ctx->src_y;
+
+    // Output rows with offset_y = 0 or 1 only depend on one input row. All
+    // but the first of the output rows that depend on the same input row are
+    // byte-identical copies of it.
+    int32_t* first_row = ctx->first_row;
+    for (int i = 0; i < in_height; ++i) {
+        first_row[i] = -1;
+    }
+    ctx->num_copy_rows = 0;
+    for (int y = 0; y < out_height; ++y) {
+        ctx->copy_src_y[y] = -1;
+        int sample;
+        if (weights_y[y] < WEIGHT_TOL) {
+            sample = src_y[y];
+        } else if (weights_y[y] > WEIGHT_TOL_UPPER) {
+            sample = src_y[y] + 1;
+        } else {
+            continue;
+        }
+        if (first_row[sample] < 0) {
+            first_row[sample] = y;
+        } else {
+            ctx->copy_src_y[y] = first_row[sample];
+            ++ctx->num_copy_rows;
+        }
+    }
+
+    // Build the span tables. The pattern of source offsets and weights repeats
+    // every x_cycle_length columns, except possibly for the first columns
+    // where the error term hasn't settled yet. Those go into the prologue.
+    const int center_width = out_width - border_x - border_x;
+    const int x_gcd = gcd(out_width, in_width);
+    ctx->x_cycle_length = out_width / x_gcd;
+    ctx->x_in_advance = in_width / x_gcd;
+    const int32_t* center_src_x = src_x + border_x;
+    const weight_t* center_weights_x = weights_x + border_x;
+    int prologue_width = 0;
+    for (int x = center_width - ctx->x_cycle_length - 1; x >= 0; --x) {
+        if (center_src_x[x + ctx->x_cycle_length] !=
+                center_src_x[x] + ctx->x_in_advance ||
+            center_weights_x[x + ctx->x_cycle_length] != center_weights_x[x]) {
+            prologue_width = x + 1;
+            break;
+        }
+    }
+    int num_blend = 0;
+    ctx->prologue_width = prologue_width;
+    ctx->num_prologue_spans = build_spans(
+        center_src_x, center_weights_x, prologue_width, 0, ctx->spans,
+        ctx->blend_src, ctx->blend_weights, &num_blend);
+    const int cycle_width = center_width - prologue_width < ctx->x_cycle_length
+                                ? center_width - prologue_width
+                                : ctx->x_cycle_length;
+    ctx->num_cycle_spans = 0;
+    if (cycle_width > 0) {
+        ctx->cycle_src_x = center_src_x[prologue_width];
+        ctx->num_cycle_spans = build_spans(
+            center_src_x + prologue_width, center_weights_x + prologue_width,
+            cycle_width, ctx->cycle_src_x,
+            ctx->spans + ctx->num_prologue_spans, ctx->blend_src,
+            ctx->blend_weights, &num_blend);
+    }
+
+    for (int i = 0; i < ctx->num_prologue_spans + ctx->num_cycle_spans; ++i) {
+        const Span* span = &ctx->spans[i];
+        const int offset = i < ctx->num_prologue_spans ? 0 : prologue_width;
+        for (int x = 0; x < span->count; ++x) {
+            ctx->column_span[offset + span->start + x] = i;
+        }
+    }
+
+    // Spans only pay off when they are long. At the common 2x - 3x ratios
+    // they are 1 - 2 pixels long, and the per column kernels are faster.
+    ctx->use_spans = ctx->num_cycle_spans > 0 &&
+                     cycle_width >= SPAN_MIN_AVG_LENGTH * ctx->num_cycle_spans;
+}
+
+// Upscaling: Computes the borders, weights and samples of ctx and the tables
+// derived from them. Returns 0 on success.
+static int init_samples(PixelAAContext* ctx) {
+    const int in_width = ctx->in_width;
+    const int in_height = ctx->in_height;
+    const int out_width = ctx->out_width;
+    const int out_height = ctx->out_height;
+
+    // Derivation of the border size:
+    /*
+    in_x >= pixel transition start
+    in_x >= 0.5f - in_x_step * 0.5f
+    (0.5 + x) * s - 0.5 >= 0.5 - s * 0.5
+    =>
+    x >= 1 / s - 1
+    */
+    ctx->border_x = out_width / in_width - 1;
+    ctx->border_y = out_height / in_height - 1;
+    // A single input column or row has nothing to interpolate with.
+    if (in_width == 1) {
+        ctx->border_x = (out_width + 1) / 2;
+    }
+    if (in_height == 1) {
+        ctx->border_y = (out_height + 1) / 2;
+    }
+
+    // Precompute interpolation weights and the tables derived from them.
+    ctx->weights_x = (weight_t*)malloc(out_width * sizeof(weight_t));
+    ctx->weights_y = (weight_t*)malloc(out_height * sizeof(weight_t));
+    ctx->src_x = (int32_t*)calloc(out_width, sizeof(int32_t));
+    ctx->src_y = (int32_t*)calloc(out_height, sizeof(int32_t));
+    ctx->copy_src_y = (int32_t*)malloc(out_height * sizeof(int32_t));
+    ctx->first_row = (int32_t*)malloc(in_height * sizeof(int32_t));
+    const int center_width = out_width - ctx->border_x - ctx->border_x;
+    const int table_size = center_width > 0 ? center_width : 1;
+    ctx->spans = (Span*)malloc(table_size * sizeof(Span));
+    ctx->blend_src = (int32_t*)malloc(table_size * sizeof(int32_t));
+    ctx->blend_weights = (weight_t*)malloc(table_size * sizeof(weight_t));
+    ctx->column_span = (int32_t*)malloc(table_size * sizeof(int32_t));
+    if (!ctx->weights_x || !ctx->weights_y || !ctx->src_x || !ctx->src_y ||
+        !ctx->copy_src_y || !ctx->first_row || !ctx->spans ||
+        !ctx->blend_src || !ctx->blend_weights || !ctx->column_span) {
+        return -1;
+    }
+    compute_samples(ctx);
+    build_tables(ctx);
+    return 0;
+}
+
+void pixel_aa_default_options(PixelAAOptions* options) {
+    options->separable = 0;
+    options->num_threads = 0;
+    options->cpus = NULL;
+    options->tile_width = 0;
+    options->in_format = PIXEL_AA_FORMAT_XRGB8888;
+    options->out_format = PIXEL_AA_FORMAT_XRGB8888;
+    options->incremental = 0;
+    options->curve = PIXEL_AA_CURVE_SMOOTHSTEP;
+    options->sharpness = 1.5f;
+}
+
+PixelAAContext* pixel_aa_create(int in_width, int in_height, int out_width,
+                                int out_height) {
+    PixelAAOptions options;
+    pixel_aa_default_options(&options);
+    return pixel_aa_create_with_options(in_width, in_height, out_width,
+                                        out_height, &options);
+}
+
+PixelAAContext* pixel_aa_create_with_options(int in_width, int in_height,
+                                             int out_width, int out_height,
+                                             const PixelAAOptions* options) {
+    // Downscaling on either axis area averages both, and has no incremental
+    // mode.
+    const int downscale = out_width < in_width || out_height < in_height;
+    if (in_width <= 0 || in_height <= 0 || out_width <= 0 || out_height <= 0 ||
+        (downscale && options->incremental) ||
+        (unsigned)options->in_format > PIXEL_AA_FORMAT_INDEX8 ||
+        (unsigned)options->out_format > PIXEL_AA_FORMAT_RGB565 ||
+        (unsigned)options->curve > PIXEL_AA_CURVE_LINEAR ||
+        !(options->sharpness > 0.0f)) {
+        return NULL;
+    }
+
+    PixelAAContext* ctx = (PixelAAContext*)calloc(1, sizeof(PixelAAContext));
+    if (!ctx) {
+        return NULL;
+    }
+    ctx->in_width = in_width;
+    ctx->in_height = in_height;
+    ctx->out_width = out_width;
+    ctx->out_height = out_height;
+    ctx->in_format = options->in_format;
+    ctx->out_format = options->out_format;
+    ctx->in_layout = format_layout(options->in_format);
+    ctx->out_layout = format_layout(options->out_format);
+    ctx->curve = options->curve;
+    ctx->sharpness = options->sharpness;
+    ctx->downscale = downscale;
+    if (!downscale && init_samples(ctx) != 0) {
+        pixel_aa_destroy(ctx);
+        return NULL;
+    }
+
+    ctx->kernels = select_kernels();
+
+#ifdef USE_THREADS
+    ctx->num_threads = options->num_threads > 0
+                           ? options->num_threads
+                           : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (ctx->num_threads < 1) {
+        ctx->num_threads = 1;
+    }
+    if (ctx->num_threads > 1) {
+        ctx->pool = thread_pool_create(ctx->num_threads, options->cpus);
+        if (!ctx->pool) {
+            pixel_aa_destroy(ctx);
+            return NULL;
+        }
+    }
+#else   // !USE_THREADS
+    ctx->num_threads = 1;
+#endif  // USE_THREADS
+    // Palette indices are only ever scaled horizontally, into the ring.
+    // Downscaling is separable by itself and has no ring.
+    ctx->separable = !downscale && (options->separable ||
+                                    ctx->in_layout == LAYOUT_INDEX8);
+
+    // A few tiles per thread leave room for balancing, but tiles shouldn't
+    // get too short: Every tile starts with a cold ring in separable mode.
+    ctx->tile_height = out_height / (ctx->num_threads * 4);
+    if (ctx->tile_height < MIN_TILE_HEIGHT) {
+        ctx->tile_height = MIN_TILE_HEIGHT;
+    }
+    ctx->num_tiles_y = (out_height + ctx->tile_height - 1) / ctx->tile_height;
+    if (options->tile_width > 0) {
+        ctx->tile_width =
+            options->tile_width < out_width ? options->tile_width : out_width;
+    } else {
+        // Split the columns only when there are too few rows to go around.
+        // Narrower tiles don't pay off otherwise, even the ring rows of 4K
+        // outputs are faster in one piece than cache-blocked.
+        int num_tiles_x = 1;
+        const int min_tiles = ctx->num_threads > 1 ? ctx->num_threads * 4 : 1;
+        if (num_tiles_x * ctx->num_tiles_y < min_tiles) {
+            num_tiles_x =
+                (min_tiles + ctx->num_tiles_y - 1) / ctx->num_tiles_y;
+        }
+        if (num_tiles_x > out_width / MIN_TILE_WIDTH) {
+            num_tiles_x = out_width / MIN_TILE_WIDTH;
+        }
+        if (num_tiles_x < 1) {
+            num_tiles_x = 1;
+        }
+        // Multiples of 16 keep tile starts aligned for the SIMD kernels.
+        ctx->tile_width = (out_width + num_tiles_x - 1) / num_tiles_x;
+        if (num_tiles_x > 1) {
+            ctx->tile_width = (ctx->tile_width + 15) & ~15;
+        }
+    }
+    ctx->num_tiles_x = (out_width + ctx->tile_width - 1) / ctx->tile_width;
+
+    if (ctx->separable) {
+        // Two rows per thread, always XRGB8888
+        ctx->ring = (uint32_t*)malloc(ctx->num_threads * 2 * ctx->tile_width *
+                                      sizeof(uint32_t));
+        if (!ctx->ring) {
+            pixel_aa_destroy(ctx);
+            return NULL;
+        }
+    }
+
+    if (downscale && downscale_init(ctx) != 0) {
+        pixel_aa_destroy(ctx);
+        return NULL;
+    }
+
+    if (ctx->in_layout == LAYOUT_INDEX8 && palette_init(ctx) != 0) {
+        pixel_aa_destroy(ctx);
+        return NULL;
+    }
+
+    ctx->incremental = options->incremental;
+    if (ctx->incremental && init_incremental(ctx) != 0) {
+        pixel_aa_destroy(ctx);
+        return NULL;
+    }
+
+#ifdef USE_STATS
+    if (stats_init(ctx) != 0) {
+        pixel_aa_destroy(ctx);
+        return NULL;
+    }
+#endif  // USE_STATS
+
+    return ctx;
+}
+
+// One pass over rows: The kernels and the layouts they read and write. The
+// direct path goes from the input to the output format in one pass, the
+// separable path through the ring in XRGB8888.
+typedef struct {
+    const RowKernels* kernels;
+    int in_layout;
+    int out_layout;
+} RowPass;
+
+// Copies `count` pixels between the layouts of a pass.
+static inline void copy_pixels(const RowPass* pass, const void* row,
+                               void* out, int count) {
+    if (pass->in_layout == pass->out_layout) {
+        memcpy(out, row, count * layout_bytes(pass->in_layout));
+    } else {
+        // A mix with weight 0 is exact, and converts with the SIMD kernels.
+        pass->kernels->blend_y_row(row, row, 0, out, count);
+    }
+}
+
+// Runs `count` output pixels of one span, starting `skip` pixels into it. If
+// row1 is set, every pixel is additionally mixed vertically between row0 and
+// row1 with weight_y.
+static inline void run_span(const PixelAAContext* ctx, const RowPass* pass,
+                            const Span* span, int skip, int count,
+                            const void* row0, const void* row1,
+                            weight_t weight_y, void* out) {
+    const RowKernels* kernels = pass->kernels;
+    const int in_layout = pass->in_layout;
+    switch (span->type) {
+        case SPAN_FILL: {
+            const uint32_t col =
+                row1 ? mix_col(load_pixel(row0, span->index, in_layout),
+                               load_pixel(row1, span->index, in_layout),
+                               weight_y)
+                     : load_pixel(row0, span->index, in_layout);
+            for (int x = 0; x < count; ++x) {
+                store_pixel(out, x, col, pass->out_layout);
+            }
+            break;
+        }
+        case SPAN_COPY: {
+            const int index = span->index + skip;
+            if (row1) {
+                kernels->blend_y_row(pixel_offset(row0, index, in_layout),
+                                     pixel_offset(row1, index, in_layout),
+                                     weight_y, out, count);
+            } else {
+                copy_pixels(pass, pixel_offset(row0, index, in_layout), out,
+                            count);
+            }
+            break;
+        }
+        case SPAN_BLEND: {
+            const int index = span->index + skip;
+            if (row1) {
+                kernels->blend_xy_row(row0, row1, ctx->blend_src + index,
+                                      ctx->blend_weights + index, weight_y,
+                                      out, count);
+            } else {
+                kernels->blend_x_row(row0, ctx->blend_src + index,
+                                     ctx->blend_weights + index, out, count);
+            }
+            break;
+        }
+    }
+}
+
+// Produces `count` center columns of one output row, starting at center
+// column `start`. If row1 is set, every pixel is additionally mixed
+// vertically between row0 and row1 with weight_y.
+// With the span tables, the span of the first column is looked up, then the
+// spans run from there: The rest of the prologue once, then the cycle spans
+// until the range is full.
+static void scale_center_row(const PixelAAContext* ctx, const RowPass* pass,
+                             const void* row0, const void* row1,
+                             weight_t weight_y, void* out, int start,
+                             int count) {
+    if (!ctx->use_spans) {
+        const int32_t* src_x = ctx->src_x + ctx->border_x + start;
+        const weight_t* weights_x = ctx->weights_x + ctx->border_x + start;
+        if (row1) {
+            pass->kernels->blend_xy_row(row0, row1, src_x, weights_x,
+                                        weight_y, out, count);
+        } else {
+            pass->kernels->blend_x_row(row0, src_x, weights_x, out, count);
+        }
+        return;
+    }
+
+    const int in_layout = pass->in_layout;
+    const int out_layout = pass->out_layout;
+    int x = start;
+    const int end = start + count;
+    if (x < ctx->prologue_width) {
+        for (int i = ctx->column_span[x];
+             i < ctx->num_prologue_spans && x < end; ++i) {
+            const Span* span = &ctx->spans[i];
+            const int skip = x - span->start;
+            const int span_count = span->count - skip < end - x
+                                       ? span->count - skip
+                                       : end - x;
+            run_span(ctx, pass, span, skip, span_count, row0, row1, weight_y,
+                     pixel_offset_mut(out, x - start, out_layout));
+            x += span_count;
+        }
+    }
+    if (x >= end) {
+        return;
+    }
+
+    const Span* cycle = ctx->spans + ctx->num_prologue_spans;
+    const int in_advance = ctx->x_in_advance;
+    const int cycle_x = x - ctx->prologue_width;
+    const int in_offset =
+        ctx->cycle_src_x + cycle_x / ctx->x_cycle_length * in_advance;
+    row0 = pixel_offset(row0, in_offset, in_layout);
+    if (row1) {
+        row1 = pixel_offset(row1, in_offset, in_layout);
+    }
+    int i = ctx->column_span[ctx->prologue_width +
+                             cycle_x % ctx->x_cycle_length] -
+            ctx->num_prologue_spans;
+    int skip = cycle_x % ctx->x_cycle_length - cycle[i].start;
+    while (x < end) {
+        for (; i < ctx->num_cycle_spans && x < end; ++i) {
+            const int span_count = cycle[i].count - skip < end - x
+                                       ? cycle[i].count - skip
+                                       : end - x;
+            run_span(ctx, pass, &cycle[i], skip, span_count, row0, row1,
+                     weight_y, pixel_offset_mut(out, x - start, out_layout));
+            x += span_count;
+            skip = 0;
+        }
+        i = 0;
+        row0 = pixel_offset(row0, in_advance, in_layout);
+        if (row1) {
+            row1 = pixel_offset(row1, in_advance, in_layout);
+        }
+    }
+}
+
+// Produces output columns [x0, x1) of one row from input rows row0 and row1,
+// mixed with weight_y if row1 is set. The border columns are filled with
+// `left` and `right`, given as 0xAARRGGBB.
+static void scale_row_range(const PixelAAContext* ctx, const RowPass* pass,
+                            const void* row0, const void* row1,
+                            weight_t weight_y, uint32_t left, uint32_t right,
+                            void* out, int x0, int x1) {
+    const int border_x = ctx->border_x;
+    const int center_end = ctx->out_width - border_x;
+    const int out_layout = pass->out_layout;
+    int x = x0;
+
+    // Left border, offset_x = 0
+    STATS_TIMER(left_start);
+    for (; x < x1 && x < border_x; ++x) {
+        store_pixel(out, x - x0, left, out_layout);
+    }
+
+    // Center part
+    STATS_TIMER(center_start);
+    if (x < x1 && x < center_end) {
+        const int end = x1 < center_end ? x1 : center_end;
+        scale_center_row(ctx, pass, row0, row1, weight_y,
+                         pixel_offset_mut(out, x - x0, out_layout),
+                         x - border_x, end - x);
+        x = end;
+    }
+
+    // Right border, offset_x = 1
+    STATS_TIMER(right_start);
+    for (; x < x1; ++x) {
+        store_pixel(out, x - x0, right, out_layout);
+    }
+    STATS_TIMER(end);
+    STATS_ADD_TIME(PIXEL_AA_STAGE_BORDER, left_start, center_start);
+    STATS_ADD_TIME(PIXEL_AA_STAGE_CENTER, center_start, right_start);
+    STATS_ADD_TIME(PIXEL_AA_STAGE_BORDER, right_start, end);
+}
+
+// Scales one input row horizontally into output columns [x0, x1), i.e. an
+// output row with offset_y effectively = 0.
+static void scale_row_x(const PixelAAContext* ctx, const RowPass* pass,
+                        const void* row, void* out, int x0, int x1) {
+    const int in_layout = pass->in_layout;
+    scale_row_range(ctx, pass, row, NULL, 0, load_pixel(row, 0, in_layout),
+                    load_pixel(row, ctx->in_width - 1, in_layout), out, x0,
+                    x1);
+}
+
+typedef struct {
+    const PixelAAContext* ctx;
+    // Top left pixel of the input rectangle and of the output, and the
+    // distance between rows in bytes
+    const void* in;
+    int in_stride;
+    void* out;
+    int out_stride;
+    // Output rows [y0, y1) are scaled, `out` points at row y0. Task i is
+    // tile first_tile + i, clipped to those rows.
+    int y0;
+    int y1;
+    int first_tile;
+    // Input to output format
+    RowPass direct;
+    // Separable mode: Input format to the ring, and the ring to the output
+    // format
+    RowPass horizontal;
+    RowPass vertical;
+} ScaleJob;
+
+// Returns columns [x0, x1) of input row `in_y` scaled horizontally, from the
+// ring if they're still there. Consecutive input rows go to different slots,
+// so the two rows needed for a vertical mix are always available at the same
+// time. The ring is only valid for one column range.
+static const uint32_t* get_ring_row(const ScaleJob* job, int in_y, int x0,
+                                    int x1, uint32_t* ring, int* ring_src) {
+    const int slot = in_y & 1;
+    uint32_t* ring_row = ring + slot * job->ctx->tile_width;
+    if (ring_src[slot] != in_y) {
+        const void* row = row_offset(job->in, in_y, job->in_stride);
+        if (job->ctx->in_layout == LAYOUT_INDEX8) {
+            STATS_TIMER(start);
+            palette_scale_row_x(job->ctx, (const uint8_t*)row, ring_row, x0,
+                                x1);
+            STATS_TIMER(end);
+            STATS_ADD_TIME(PIXEL_AA_STAGE_CENTER, start, end);
+        } else {
+            scale_row_x(job->ctx, &job->horizontal, row, ring_row, x0, x1);
+        }
+        ring_src[slot] = in_y;
+    }
+    return ring_row;
+}
+
+// Separable path: Each input row is scaled horizontally once into the ring,
+// output rows are copies or vertical mixes of two ring rows.
+static void scale_row_separable(const ScaleJob* job, int y, void* out, int x0,
+                                int x1, uint32_t* ring, int* ring_src) {
+    const PixelAAContext* ctx = job->ctx;
+    const int in_y = ctx->src_y[y];
+    const weight_t offset_y = ctx->weights_y[y];
+    if (offset_y < WEIGHT_TOL || offset_y > WEIGHT_TOL_UPPER) {
+        const uint32_t* row =
+            get_ring_row(job, offset_y < WEIGHT_TOL ? in_y : in_y + 1, x0, x1,
+                         ring, ring_src);
+        STATS_TIMER(start);
+        copy_pixels(&job->vertical, row, out, x1 - x0);
+        STATS_TIMER(end);
+        STATS_ADD_TIME(PIXEL_AA_STAGE_VERTICAL, start, end);
+    } else {
+        const uint32_t* row0 =
+            get_ring_row(job, in_y, x0, x1, ring, ring_src);
+        const uint32_t* row1 =
+            get_ring_row(job, in_y + 1, x0, x1, ring, ring_src);
+        STATS_TIMER(start);
+        job->vertical.kernels->blend_y_row(row0, row1, offset_y, out, x1 - x0);
+        STATS_TIMER(end);
+        STATS_ADD_TIME(PIXEL_AA_STAGE_VERTICAL, start, end);
+    }
+}
+
+// Direct path: Produces output columns [x0, x1) of a row that samples input
+// rows row0 and row1 with offset_y.
+static void scale_rows(const PixelAAContext* ctx, const RowPass* pass,
+                       const void* row0, const void* row1, weight_t offset_y,
+                       void* out, int x0, int x1) {
+    const int in_width = ctx->in_width;
+    const int in_layout = pass->in_layout;
+    if (offset_y < WEIGHT_TOL) {
+        // Need 1 row, no mixing
+        scale_row_x(ctx, pass, row0, out, x0, x1);
+        return;
+    }
+    if (offset_y > WEIGHT_TOL_UPPER) {
+        // Need 1 row, no mixing
+        scale_row_x(ctx, pass, row1, out, x0, x1);
+        return;
+    }
+
+    scale_row_range(ctx, pass, row0, row1, offset_y,
+                    mix_col(load_pixel(row0, 0, in_layout),
+                            load_pixel(row1, 0, in_layout), offset_y),
+                    mix_col(load_pixel(row0, in_width - 1, in_layout),
+                            load_pixel(row1, in_width - 1, in_layout),
                             offset_y),
-                        mix(GET_CH(in[in_row_offset + in_width - 1], 2),
-                            GET_CH(in[in_row_offset + 2 * in_width - 1], 2),
-                            offset_y));
+                    out, x0, x1);
+}
+
+static void scale_row_direct(const ScaleJob* job, int y, void* out, int x0,
+                             int x1) {
+    const PixelAAContext* ctx = job->ctx;
+    const void* row0 = row_offset(job->in, ctx->src_y[y], job->in_stride);
+    const void* row1 = row_offset(row0, 1, job->in_stride);
+    scale_rows(ctx, &job->direct, row0, row1, ctx->weights_y[y], out, x0, x1);
+}
+
+// Output rows [*y0, *y1) and columns [*x0, *x1) of a tile.
+static void get_tile(const PixelAAContext* ctx, int tile, int* x0, int* x1,
+                     int* y0, int* y1) {
+    *x0 = tile % ctx->num_tiles_x * ctx->tile_width;
+    *x1 = *x0 + ctx->tile_width < ctx->out_width ? *x0 + ctx->tile_width
+                                                 : ctx->out_width;
+    *y0 = tile / ctx->num_tiles_x * ctx->tile_height;
+    *y1 = *y0 + ctx->tile_height < ctx->out_height ? *y0 + ctx->tile_height
+                                                   : ctx->out_height;
+}
+
+// Tile of a task, clipped to the rows of the job.
+static void get_job_tile(const ScaleJob* job, int task, int* x0, int* x1,
+                         int* y0, int* y1) {
+    get_tile(job->ctx, job->first_tile + task, x0, x1, y0, y1);
+    *y0 = *y0 > job->y0 ? *y0 : job->y0;
+    *y1 = *y1 < job->y1 ? *y1 : job->y1;
+}
+
+// Whether output row y is filled as a copy of an earlier row of the job.
+static int is_copy_row(const ScaleJob* job, int y) {
+    return job->ctx->copy_src_y[y] >= job->y0;
+}
+
+// Computes all rows of a tile that aren't duplicates of an earlier row.
+static void scale_tile(void* arg, int tile, int thread_num) {
+    const ScaleJob* job = (const ScaleJob*)arg;
+    const PixelAAContext* ctx = job->ctx;
+    int x0, x1, y0, y1;
+    get_job_tile(job, tile, &x0, &x1, &y0, &y1);
+
+    if (ctx->incremental) {
+        // One column range for the whole tile, the ring is only valid for
+        // one.
+        int dirty_x0 = x1;
+        int dirty_x1 = x0;
+        for (int y = y0; y < y1; ++y) {
+            if (!is_copy_row(job, y) && ctx->out_dirty_x0[y] < x1 &&
+                ctx->out_dirty_x1[y] > x0) {
+                if (ctx->out_dirty_x0[y] < dirty_x0) {
+                    dirty_x0 = ctx->out_dirty_x0[y];
                 }
-                for (int x = out_width - border_x; x < out_width; ++x) {
-                    out[out_row_offset + x] = col;
+                if (ctx->out_dirty_x1[y] > dirty_x1) {
+                    dirty_x1 = ctx->out_dirty_x1[y];
                 }
             }
         }
+        x0 = dirty_x0 > x0 ? dirty_x0 : x0;
+        x1 = dirty_x1 < x1 ? dirty_x1 : x1;
+        if (x0 >= x1) {
+            return;
+        }
+    }
 
-        // Bottom border, offset_y is effectively = 1
-        const int in_row_offset = (in_height - 1) * in_width;
-        for (int y = out_height - border_y; y < out_height; ++y) {
-            const int out_row_offset = y * out_width;
+    uint32_t* ring =
+        ctx->separable ? ctx->ring + thread_num * 2 * ctx->tile_width : NULL;
+    int ring_src[2] = {-1, -1};
 
-            // Bottom left corner, offset_x = 0
-            for (int x = 0; x < border_x; ++x) {
-                out[out_row_offset + x] = in[in_row_offset];
+    for (int y = y0; y < y1; ++y) {
+        if (is_copy_row(job, y)) {
+            continue;
+        }
+        if (ctx->incremental && (ctx->out_dirty_x0[y] >= x1 ||
+                                 ctx->out_dirty_x1[y] <= x0)) {
+            continue;
+        }
+        void* out = pixel_offset_mut(
+            row_offset_mut(job->out, y - job->y0, job->out_stride), x0,
+            ctx->out_layout);
+        if (ctx->separable) {
+            scale_row_separable(job, y, out, x0, x1, ring, ring_src);
+        } else {
+            scale_row_direct(job, y, out, x0, x1);
+        }
+        STATS_COUNT_ROW(ctx, y, x0, x1);
+    }
+}
+
+// Fills the duplicate rows of a tile.
+static void copy_tile(void* arg, int tile, int thread_num) {
+    const ScaleJob* job = (const ScaleJob*)arg;
+    const PixelAAContext* ctx = job->ctx;
+    const int out_layout = ctx->out_layout;
+    int x0, x1, y0, y1;
+    get_job_tile(job, tile, &x0, &x1, &y0, &y1);
+    (void)thread_num;
+
+    STATS_TIMER(start);
+    for (int y = y0; y < y1; ++y) {
+        if (!is_copy_row(job, y)) {
+            continue;
+        }
+        int copy_x0 = x0;
+        int copy_x1 = x1;
+        if (ctx->incremental) {
+            copy_x0 = ctx->out_dirty_x0[y] > x0 ? ctx->out_dirty_x0[y] : x0;
+            copy_x1 = ctx->out_dirty_x1[y] < x1 ? ctx->out_dirty_x1[y] : x1;
+            if (copy_x0 >= copy_x1) {
+                continue;
             }
+        }
+        const void* src = row_offset(job->out, ctx->copy_src_y[y] - job->y0,
+                                     job->out_stride);
+        void* dst = row_offset_mut(job->out, y - job->y0, job->out_stride);
+        memcpy(pixel_offset_mut(dst, copy_x0, out_layout),
+               pixel_offset(src, copy_x0, out_layout),
+               (copy_x1 - copy_x0) * layout_bytes(out_layout));
+        STATS_ADD_PIXELS(PIXEL_AA_PATH_COPY, copy_x1 - copy_x0);
+    }
+    STATS_TIMER(end);
+    STATS_ADD_TIME(PIXEL_AA_STAGE_COPY, start, end);
+}
 
-            // Middle part of bottom bar
-            int in_x_error =
-                in_width / 2 - out_width / 2 - out_width + in_width * border_x;
-            uint32_t* in_ptr[2] = {in + in_row_offset, in + in_row_offset + 1};
-            for (int x = border_x; x < out_width - border_x;
-                 ++x, in_x_error += in_width) {
-                // Update samples when we've moved enough.
-                if (in_x_error >= 0) {
-                    in_x_error -= out_width;
-                    // Shift samples one to right.
-                    ++in_ptr[0];
-                    ++in_ptr[1];
-                }
+static void run_tasks(const PixelAAContext* ctx, int num_tasks,
+                      thread_pool_task_fn fn, void* arg) {
+#ifdef USE_STATS
+    StatsTasks tasks = {ctx, fn, arg};
+    fn = stats_run_task;
+    arg = &tasks;
+    const int64_t start = stats_now_ns();
+#endif  // USE_STATS
+#ifdef USE_THREADS
+    if (ctx->pool) {
+        thread_pool_run(ctx->pool, num_tasks, fn, arg);
+    } else
+#endif  // USE_THREADS
+    {
+        for (int task = 0; task < num_tasks; ++task) {
+            fn(arg, task, 0);
+        }
+    }
+#ifdef USE_STATS
+    ctx->stats->job_ns += stats_now_ns() - start;
+#endif  // USE_STATS
+}
 
-                const weight_t offset_x = weights_x[x];
-                if (offset_x < WEIGHT_TOL) {
-                    // Need 1 sample, no mixing
-                    out[out_row_offset + x] = *in_ptr[0];
-                } else if (offset_x > WEIGHT_TOL_UPPER) {
-                    // Need 1 sample, no mixing
-                    out[out_row_offset + x] = *in_ptr[1];
-                } else {
-                    // Need 2 samples, mix with offset_x
-                    out[out_row_offset + x] =
-                        GET_COL(mix(GET_CH(*in_ptr[0], 0),
-                                    GET_CH(*in_ptr[1], 0), offset_x),
-                                mix(GET_CH(*in_ptr[0], 1),
-                                    GET_CH(*in_ptr[1], 1), offset_x),
-                                mix(GET_CH(*in_ptr[0], 2),
-                                    GET_CH(*in_ptr[1], 2), offset_x));
+// Runs `fn` for the tiles that overlap the rows of the job.
+static void run_tiles(const ScaleJob* job, thread_pool_task_fn fn) {
+    const PixelAAContext* ctx = job->ctx;
+    const int tile_y0 = job->y0 / ctx->tile_height;
+    const int tile_y1 = (job->y1 + ctx->tile_height - 1) / ctx->tile_height;
+    run_tasks(ctx, (tile_y1 - tile_y0) * ctx->num_tiles_x, fn, (void*)job);
+}
+
+static inline uint64_t rotl64(uint64_t x, int n) {
+    return x << n | x >> (64 - n);
+}
+
+// Non-cryptographic 64 bit hash, four independent multiply-rotate lanes
+// over 8 byte words so that it runs at memory speed.
+static uint64_t hash_bytes(const uint8_t* data, int size) {
+    const uint64_t k = 0x9E3779B97F4A7C15ull;
+    uint64_t h[4] = {1, 2, 3, 4};
+    int i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; ++lane) {
+            uint64_t word;
+            memcpy(&word, data + i + 8 * lane, 8);
+            h[lane] = rotl64((h[lane] ^ word) * k, 29);
+        }
+    }
+    for (; i < size; ++i) {
+        h[0] = rotl64((h[0] ^ data[i]) * k, 29);
+    }
+    uint64_t hash = h[0] ^ rotl64(h[1], 16) ^ rotl64(h[2], 32) ^
+                    rotl64(h[3], 48) ^ (uint64_t)size;
+    hash ^= hash >> 32;
+    return hash * k;
+}
+
+// Incremental mode: Hashes the blocks of DIRTY_ROWS_PER_TASK input rows and
+// records the changed columns of each row.
+static void hash_rows(void* arg, int task, int thread_num) {
+    const ScaleJob* job = (const ScaleJob*)arg;
+    const PixelAAContext* ctx = job->ctx;
+    const int in_width = ctx->in_width;
+    const int bytes = layout_bytes(ctx->in_layout);
+    const int y0 = task * DIRTY_ROWS_PER_TASK;
+    const int y1 = y0 + DIRTY_ROWS_PER_TASK < ctx->in_height
+                       ? y0 + DIRTY_ROWS_PER_TASK
+                       : ctx->in_height;
+    (void)thread_num;
+
+    STATS_TIMER(start);
+    for (int y = y0; y < y1; ++y) {
+        const uint8_t* row =
+            (const uint8_t*)row_offset(job->in, y, job->in_stride);
+        uint64_t* hashes = ctx->block_hashes + (size_t)y * ctx->num_hash_blocks;
+        int dirty_x0 = in_width;
+        int dirty_x1 = 0;
+        for (int block = 0; block < ctx->num_hash_blocks; ++block) {
+            const int x0 = block * DIRTY_BLOCK_WIDTH;
+            const int x1 =
+                x0 + DIRTY_BLOCK_WIDTH < in_width ? x0 + DIRTY_BLOCK_WIDTH
+                                                  : in_width;
+            const uint64_t hash =
+                hash_bytes(row + x0 * bytes, (x1 - x0) * bytes);
+            if (!ctx->have_previous || hash != hashes[block]) {
+                hashes[block] = hash;
+                if (dirty_x0 == in_width) {
+                    dirty_x0 = x0;
                 }
+                dirty_x1 = x1;
             }
+        }
+        ctx->in_dirty_x0[y] = dirty_x0;
+        ctx->in_dirty_x1[y] = dirty_x1;
+    }
+    STATS_TIMER(end);
+    STATS_ADD_TIME(PIXEL_AA_STAGE_HASH, start, end);
+}
 
-            // Bottom right corner, offset_x = 1
-            for (int x = out_width - border_x; x < out_width; ++x) {
-                out[out_row_offset + x] = in[in_row_offset + in_width - 1];
-            }
+// Incremental mode: Derives the output columns to recompute for each output
+// row from the changed input columns of the rows it samples, and their
+// bounding box. Returns 0 if nothing changed.
+static int mark_dirty_rows(PixelAAContext* ctx) {
+    ctx->dirty_x0 = ctx->out_width;
+    ctx->dirty_y0 = ctx->out_height;
+    ctx->dirty_x1 = 0;
+    ctx->dirty_y1 = 0;
+    for (int y = 0; y < ctx->out_height; ++y) {
+        const int row0 = ctx->src_y[y];
+        const int row1 = row0 + 1 < ctx->in_height ? row0 + 1 : row0;
+        const int in_x0 = ctx->in_dirty_x0[row0] < ctx->in_dirty_x0[row1]
+                              ? ctx->in_dirty_x0[row0]
+                              : ctx->in_dirty_x0[row1];
+        const int in_x1 = ctx->in_dirty_x1[row0] > ctx->in_dirty_x1[row1]
+                              ? ctx->in_dirty_x1[row0]
+                              : ctx->in_dirty_x1[row1];
+        if (in_x0 >= in_x1) {
+            ctx->out_dirty_x0[y] = 0;
+            ctx->out_dirty_x1[y] = 0;
+            continue;
+        }
+        const int x0 = ctx->dep_x0[in_x0];
+        const int x1 = ctx->dep_x1[in_x1 - 1];
+        ctx->out_dirty_x0[y] = x0;
+        ctx->out_dirty_x1[y] = x1;
+        if (x0 < ctx->dirty_x0) {
+            ctx->dirty_x0 = x0;
+        }
+        if (x1 > ctx->dirty_x1) {
+            ctx->dirty_x1 = x1;
         }
+        if (y < ctx->dirty_y0) {
+            ctx->dirty_y0 = y;
+        }
+        ctx->dirty_y1 = y + 1;
     }
+    return ctx->dirty_x0 < ctx->dirty_x1;
+}
+
+static RowPass get_pass(const PixelAAContext* ctx, int in_layout,
+                        int out_layout) {
+    return (RowPass){&ctx->kernels->rows[in_layout][out_layout], in_layout,
+                     out_layout};
+}
 
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    long duration_ms = (end.tv_sec - start.tv_sec) * 1000 +
-                       (end.tv_nsec - start.tv_nsec) / 1000000;
-    printf("Time for %d passes: %ld ms, that is %f ms per pass.\n",
-           num_perf_passes, duration_ms, (float)duration_ms / num_perf_passes);
-
-    // Save the resulting image
-    char* directory = get_parent_path(input_path);
-    char* file_name = get_filename(input_path);
-    char* output_file_name = remove_extension(file_name);
-    char* output_path = get_output_path(directory, output_file_name);
-    printf("Saving output image to path: %s\n", output_path);
-
-    if (stbi_write_png(output_path, out_width, out_height, channels,
-                       out_img_data, out_width * channels) == 0) {
-        printf("Failed to save the output image.\n");
-        free(directory);
-        free(file_name);
-        free(output_file_name);
-        free(output_path);
-        free(weights_x);
-        free(weights_y);
-        free(out_img_data);
-        stbi_image_free(in_img_data);
-        return 1;
-    }
-
-    printf("Output image saved successfully!\n");
-
-    free(directory);
-    free(file_name);
-    free(output_file_name);
-    free(output_path);
-    free(weights_x);
-    free(weights_y);
-    free(out_img_data);
-    stbi_image_free(in_img_data);
+void scale_row_pair(const PixelAAContext* ctx, const void* row0,
+                    const void* row1, weight_t offset_y, void* out) {
+    const RowPass pass = get_pass(ctx, ctx->in_layout, ctx->out_layout);
+    scale_rows(ctx, &pass, row0, row1, offset_y, out, 0, ctx->out_width);
+}
 
+void scale_row_horizontal(const PixelAAContext* ctx, const void* row,
+                          uint32_t* out) {
+    if (ctx->in_layout == LAYOUT_INDEX8) {
+        palette_scale_row_x(ctx, (const uint8_t*)row, out, 0, ctx->out_width);
+        return;
+    }
+    const RowPass pass = get_pass(ctx, ctx->in_layout, LAYOUT_ALPHA_HIGH);
+    scale_row_x(ctx, &pass, row, out, 0, ctx->out_width);
+}
+
+void scale_row_vertical(const PixelAAContext* ctx, const uint32_t* row0,
+                        const uint32_t* row1, weight_t offset_y, void* out) {
+    const RowPass pass = get_pass(ctx, LAYOUT_ALPHA_HIGH, ctx->out_layout);
+    if (offset_y < WEIGHT_TOL) {
+        copy_pixels(&pass, row0, out, ctx->out_width);
+    } else if (offset_y > WEIGHT_TOL_UPPER) {
+        copy_pixels(&pass, row1, out, ctx->out_width);
+    } else {
+        pass.kernels->blend_y_row(row0, row1, offset_y, out, ctx->out_width);
+    }
+}
+
+void pixel_aa_scale(PixelAAContext* ctx, const void* in, void* out) {
+    pixel_aa_scale_rect(
+        ctx, in, 0, 0, ctx->in_width * pixel_aa_bytes_per_pixel(ctx->in_format),
+        out, ctx->out_width * pixel_aa_bytes_per_pixel(ctx->out_format));
+}
+
+// Job for output rows [y0, y1), `out` points at row y0.
+static ScaleJob make_job(const PixelAAContext* ctx, const void* in, int in_x,
+                         int in_y, int in_stride, void* out, int out_stride,
+                         int y0, int y1) {
+    // The passes are looked up per frame, ctx->kernels may be swapped
+    // between frames. Palette input has no kernels, but only needs the
+    // vertical pass.
+    const int in_layout =
+        ctx->in_layout == LAYOUT_INDEX8 ? LAYOUT_ALPHA_HIGH : ctx->in_layout;
+    return (ScaleJob){
+        ctx,
+        pixel_offset(row_offset(in, in_y, in_stride), in_x, ctx->in_layout),
+        in_stride,
+        out,
+        out_stride,
+        y0,
+        y1,
+        y0 / ctx->tile_height * ctx->num_tiles_x,
+        get_pass(ctx, in_layout, ctx->out_layout),
+        get_pass(ctx, in_layout, LAYOUT_ALPHA_HIGH),
+        get_pass(ctx, LAYOUT_ALPHA_HIGH, ctx->out_layout),
+    };
+}
+
+// Downscaling: Computes all rows of a tile.
+static void downscale_tile(void* arg, int tile, int thread_num) {
+    const ScaleJob* job = (const ScaleJob*)arg;
+    const PixelAAContext* ctx = job->ctx;
+    int x0, x1, y0, y1;
+    get_job_tile(job, tile, &x0, &x1, &y0, &y1);
+    STATS_TIMER(start);
+    downscale_rows(ctx, job->in, job->in_stride,
+                   pixel_offset_mut(row_offset_mut(job->out, y0 - job->y0,
+                                                   job->out_stride),
+                                    x0, ctx->out_layout),
+                   job->out_stride, x0, x1, y0, y1, thread_num);
+    STATS_TIMER(end);
+    STATS_ADD_TIME(PIXEL_AA_STAGE_DOWNSCALE, start, end);
+    STATS_ADD_PIXELS(PIXEL_AA_PATH_AREA, (int64_t)(x1 - x0) * (y1 - y0));
+}
+
+static void run_job(const ScaleJob* job) {
+    if (job->ctx->downscale) {
+        run_tiles(job, downscale_tile);
+        return;
+    }
+    run_tiles(job, scale_tile);
+    // Duplicates may refer to rows of other tiles, so they are filled once
+    // all tiles are done.
+    if (job->ctx->num_copy_rows > 0) {
+        run_tiles(job, copy_tile);
+    }
+}
+
+void pixel_aa_scale_rect(PixelAAContext* ctx, const void* in, int in_x,
+                         int in_y, int in_stride, void* out, int out_stride) {
+    STATS_TIMER(start);
+    const ScaleJob job = make_job(ctx, in, in_x, in_y, in_stride, out,
+                                  out_stride, 0, ctx->out_height);
+    int changed = 1;
+    if (ctx->incremental) {
+        run_tasks(ctx,
+                  (ctx->in_height + DIRTY_ROWS_PER_TASK - 1) /
+                      DIRTY_ROWS_PER_TASK,
+                  hash_rows, (void*)&job);
+        ctx->have_previous = 1;
+        changed = mark_dirty_rows(ctx);
+    } else {
+        ctx->dirty_x0 = 0;
+        ctx->dirty_y0 = 0;
+        ctx->dirty_x1 = ctx->out_width;
+        ctx->dirty_y1 = ctx->out_height;
+    }
+    if (changed) {
+        run_job(&job);
+    }
+    STATS_END_FRAME(ctx, start);
+}
+
+int pixel_aa_scale_band(PixelAAContext* ctx, const void* in, int in_stride,
+                        int y0, int y1, void* out, int out_stride) {
+    if (ctx->incremental || y0 < 0 || y1 > ctx->out_height || y0 >= y1) {
+        return -1;
+    }
+    STATS_TIMER(start);
+    const ScaleJob job =
+        make_job(ctx, in, 0, 0, in_stride, out, out_stride, y0, y1);
+    ctx->dirty_x0 = 0;
+    ctx->dirty_y0 = y0;
+    ctx->dirty_x1 = ctx->out_width;
+    ctx->dirty_y1 = y1;
+    run_job(&job);
+    STATS_END_FRAME(ctx, start);
+    return 0;
+}
+
+int pixel_aa_set_curve(PixelAAContext* ctx, PixelAACurve curve,
+                       float sharpness) {
+    if ((unsigned)curve > PIXEL_AA_CURVE_LINEAR || !(sharpness > 0.0f)) {
+        return -1;
+    }
+    // Nothing below allocates, so the context is either unchanged or fully
+    // switched to the new curve.
+    ctx->curve = curve;
+    ctx->sharpness = sharpness;
+    if (ctx->downscale) {
+        return 0;
+    }
+    compute_samples(ctx);
+#ifdef USE_STATS
+    stats_set_samples(ctx);
+#endif  // USE_STATS
+    build_tables(ctx);
+    if (ctx->in_layout == LAYOUT_INDEX8) {
+        palette_set_weights(ctx);
+    }
+    // All pixels may have changed.
+    ctx->have_previous = 0;
     return 0;
 }
+
+void pixel_aa_invalidate(PixelAAContext* ctx) { ctx->have_previous = 0; }
+
+int pixel_aa_get_dirty_rect(const PixelAAContext* ctx, int* x, int* y,
+                            int* width, int* height) {
+    if (ctx->dirty_x0 >= ctx->dirty_x1) {
+        *x = *y = *width = *height = 0;
+        return 0;
+    }
+    *x = ctx->dirty_x0;
+    *y = ctx->dirty_y0;
+    *width = ctx->dirty_x1 - ctx->dirty_x0;
+    *height = ctx->dirty_y1 - ctx->dirty_y0;
+    return 1;
+}
+
+void pixel_aa_destroy(PixelAAContext* ctx) {
+    if (!ctx) {
+        return;
+    }
+    free(ctx->weights_x);
+    free(ctx->weights_y);
+    free(ctx->src_x);
+    free(ctx->src_y);
+    free(ctx->spans);
+    free(ctx->blend_src);
+    free(ctx->blend_weights);
+    free(ctx->column_span);
+    free(ctx->ring);
+    free(ctx->copy_src_y);
+    free(ctx->first_row);
+    free(ctx->pair_weights);
+    free(ctx->column_weight);
+    free(ctx->pair_tables);
+    free(ctx->block_hashes);
+    free(ctx->in_dirty_x0);
+    free(ctx->in_dirty_x1);
+    free(ctx->dep_x0);
+    free(ctx->dep_x1);
+    free(ctx->out_dirty_x0);
+    free(ctx->out_dirty_x1);
+    free(ctx->coverage_x);
+    free(ctx->coverage_y);
+    free(ctx->area_weights_x);
+    free(ctx->area_weights_y);
+    free(ctx->area_sums);
+#ifdef USE_STATS
+    stats_destroy(ctx);
+#endif  // USE_STATS
+#ifdef USE_THREADS
+    thread_pool_destroy(ctx->pool);
+#endif  // USE_THREADS
+    free(ctx);
+}
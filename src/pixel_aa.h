@@ -0,0 +1,356 @@
+#ifndef PIXEL_AA_H
+#define PIXEL_AA_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Scaling context for one fixed (in_width, in_height) -> (out_width,
+// out_height) configuration. Everything that's constant over a frame (borders,
+// interpolation weights) is computed once in pixel_aa_create(), so that
+// pixel_aa_scale() can be called every frame without allocating or
+// recomputing anything.
+typedef struct PixelAAContext PixelAAContext;
+
+// Pixel formats, named after the channels of a pixel read as a native
+// uint32_t or uint16_t, most significant first. The scaler mixes all color
+// channels the same way, so formats that only differ in the channel order
+// work as well, e.g. stbi_load()'s RGBA bytes are XRGB8888 to it. The alpha
+// or padding channel is 0xFF in mixed pixels and copied in others.
+typedef enum {
+    PIXEL_AA_FORMAT_XRGB8888,
+    PIXEL_AA_FORMAT_BGRA8888,
+    PIXEL_AA_FORMAT_RGBA8888,
+    PIXEL_AA_FORMAT_RGB565,
+    // 8 bit indices into the palette of the context, see
+    // pixel_aa_set_palette(). Input only, always scaled separably.
+    PIXEL_AA_FORMAT_INDEX8,
+} PixelAAFormat;
+
+// 4, 2 for RGB565 and 1 for INDEX8.
+int pixel_aa_bytes_per_pixel(PixelAAFormat format);
+
+// Shape of the transition between two input pixels, over the width of one
+// input pixel in output pixels.
+typedef enum {
+    // Smooth at both ends, the default
+    PIXEL_AA_CURVE_SMOOTHSTEP,
+    // Two mirrored power curves, the sharpness is the exponent. Values
+    // above 1 make the edges crisper, 1 is linear.
+    PIXEL_AA_CURVE_SLOPESTEP,
+    PIXEL_AA_CURVE_LINEAR,
+} PixelAACurve;
+
+typedef struct {
+    // Scale separably: Each input row is scaled horizontally once into a
+    // small ring of cached rows, and each output row is a copy or a vertical
+    // mix of two cached rows. Saves about half the arithmetic. Identical
+    // output in FIXED_POINT builds, in float builds the horizontal result is
+    // truncated to 8 bits before mixing vertically, so pixels may differ by
+    // 1 from the direct path.
+    int separable;
+    // Threads for pixel_aa_scale(), including the calling thread. 0 uses one
+    // per online CPU. Only used in builds with USE_THREADS, others always
+    // run on the calling thread.
+    int num_threads;
+    // If not NULL, the num_threads - 1 worker threads are pinned to the CPUs
+    // cpus[0], ..., cpus[num_threads - 2]. The calling thread isn't pinned.
+    const int* cpus;
+    // Width of the tiles a frame is split into. 0 picks one: Full rows,
+    // unless there are too few rows to keep all threads busy.
+    int tile_width;
+    // Formats of the input and the output image, XRGB8888 by default. The
+    // conversion is part of the scaling, there is no extra pass.
+    PixelAAFormat in_format;
+    PixelAAFormat out_format;
+    // Only rescale what changed since the previous frame: Input rows are
+    // hashed in small blocks, frames without a changed block are skipped
+    // entirely, otherwise only the output pixels that sample a changed
+    // block are recomputed. The output passed to pixel_aa_scale() must
+    // still hold the previous frame, see pixel_aa_invalidate(). Not
+    // supported by the pipeline, whose frames go to different buffers, nor
+    // when downscaling.
+    int incremental;
+    // Transition curve, smoothstep by default. The sharpness is only used
+    // by PIXEL_AA_CURVE_SLOPESTEP, 1.5 by default. See pixel_aa_set_curve()
+    // to change them later.
+    PixelAACurve curve;
+    float sharpness;
+} PixelAAOptions;
+
+// Fills `options` with the defaults used by pixel_aa_create().
+void pixel_aa_default_options(PixelAAOptions* options);
+
+// Creates a scaling context. Returns NULL if the configuration is not
+// supported or if allocation fails.
+//
+// Targets smaller than the input on either axis, e.g. thumbnails, are
+// downscaled instead: Each output pixel is the average of the input area it
+// covers, in integer arithmetic with the coverage rounded to 12 bits per
+// axis. Unless the ratios are powers of 2, channels can be off by one from
+// the exact rounded mean.
+// The transition curve and the separable option don't apply, and there is
+// no incremental or streaming mode.
+// Reductions by exactly 2 or 4 on both axes between equal 32 bit formats
+// average the blocks with SIMD kernels.
+PixelAAContext* pixel_aa_create(int in_width, int in_height, int out_width,
+                                int out_height);
+PixelAAContext* pixel_aa_create_with_options(int in_width, int in_height,
+                                             int out_width, int out_height,
+                                             const PixelAAOptions* options);
+
+// Name of the SIMD kernels picked when the context was created, e.g. "avx2"
+// or "scalar". They are the fastest ones built in that the CPU supports, or
+// the ones named by the environment variable PIXEL_AA_KERNELS if the CPU
+// supports them, to compare kernels or to test the fallbacks.
+const char* pixel_aa_get_kernels_name(const PixelAAContext* ctx);
+
+// Scales one frame. `in` holds in_width * in_height tightly packed pixels,
+// `out` must have room for out_width * out_height pixels, in the formats of
+// the context. Both buffers are owned by the caller. Pixels are expected to
+// be opaque, blended pixels are always written with alpha 0xFF.
+void pixel_aa_scale(PixelAAContext* ctx, const void* in, void* out);
+
+// Same as pixel_aa_scale() on images with padded rows, e.g. straight into a
+// mapped framebuffer. The input is the in_width * in_height rectangle at
+// (in_x, in_y) of a bigger image, to skip overscan. Strides are the distance
+// between the starts of two rows in bytes, and may be negative for bottom-up
+// images. The output must not overlap the input.
+void pixel_aa_scale_rect(PixelAAContext* ctx, const void* in, int in_x,
+                         int in_y, int in_stride, void* out, int out_stride);
+
+// Banded mode, for outputs too big to hold at once: Scales only output rows
+// [y0, y1) into `out`, which holds y1 - y0 rows starting with row y0. Going
+// through the output in consecutive bands gives the same pixels as one
+// pixel_aa_scale(). Returns -1 if the rows are out of range or the context
+// is incremental.
+int pixel_aa_scale_band(PixelAAContext* ctx, const void* in, int in_stride,
+                        int y0, int y1, void* out, int out_stride);
+
+// Switches to another transition curve or sharpness, e.g. from a user
+// setting. Only the curve's values for the phases of one cycle are
+// evaluated, the rest is integer work over the rows and columns, so this is
+// cheap enough to call between any two frames. Not while a frame is being
+// scaled. Has no effect on downscaling contexts. Returns -1 if the curve is
+// unknown or the sharpness isn't positive, the context is unchanged then.
+int pixel_aa_set_curve(PixelAAContext* ctx, PixelAACurve curve,
+                       float sharpness);
+
+// Incremental mode: Makes the next frame a full one, e.g. after switching to
+// a different output buffer.
+void pixel_aa_invalidate(PixelAAContext* ctx);
+
+// Returns the bounding box of the output pixels the last frame recomputed,
+// for partial display updates. That's the whole output unless the context
+// is incremental. Returns 0 if nothing was recomputed, e.g. for a repeated
+// frame.
+int pixel_aa_get_dirty_rect(const PixelAAContext* ctx, int* x, int* y,
+                            int* width, int* height);
+
+// Sets the palette of INDEX8 input, `num_colors` colors in XRGB8888. The
+// blends of all pairs of colors are precomputed here, up to 4 MiB of them,
+// so changing the palette costs about as much as scaling a frame. Indices
+// must be below num_colors. Must not be called while a frame is being
+// scaled. Returns 0 on success, -1 if num_colors is not in [1, 256].
+int pixel_aa_set_palette(PixelAAContext* ctx, const uint32_t* colors,
+                         int num_colors);
+
+// How output pixels were produced, see PixelAAStats.
+typedef enum {
+    // Copied from an identical output row
+    PIXEL_AA_PATH_COPY,
+    // Sampled from one input pixel
+    PIXEL_AA_PATH_1_SAMPLE,
+    // Mixed from two input pixels, horizontally or vertically
+    PIXEL_AA_PATH_2_SAMPLES,
+    // Mixed from four input pixels
+    PIXEL_AA_PATH_4_SAMPLES,
+    // Averaged over the covered area, when downscaling
+    PIXEL_AA_PATH_AREA,
+    PIXEL_AA_NUM_PATHS,
+} PixelAAPath;
+
+// Parts of a frame that are timed separately, see PixelAAStats.
+typedef enum {
+    // Border columns, which repeat the first or last input column
+    PIXEL_AA_STAGE_BORDER,
+    // Center columns. In separable mode that's the horizontal pass.
+    PIXEL_AA_STAGE_CENTER,
+    // Separable mode: Vertical mixes and copies of the horizontal pass
+    PIXEL_AA_STAGE_VERTICAL,
+    // Rows copied from identical rows
+    PIXEL_AA_STAGE_COPY,
+    // Incremental mode: Hashing the input to find the changes
+    PIXEL_AA_STAGE_HASH,
+    PIXEL_AA_STAGE_DOWNSCALE,
+    PIXEL_AA_NUM_STAGES,
+} PixelAAStage;
+
+// Latencies are kept for this many of the most recent frames.
+#define PIXEL_AA_STATS_HISTORY 256
+
+// Counters of a context since it was created or pixel_aa_reset_stats().
+// Only collected in builds with USE_STATS, other builds don't pay for them.
+// Frames are calls of pixel_aa_scale(), pixel_aa_scale_rect() and
+// pixel_aa_scale_band(), rows of a PixelAAStream aren't counted.
+typedef struct {
+    int64_t frames;
+    // Output pixels written per PixelAAPath. Pixels that incremental frames
+    // skip aren't counted.
+    int64_t pixels[PIXEL_AA_NUM_PATHS];
+    // Time per PixelAAStage, summed over all threads
+    double stage_ms[PIXEL_AA_NUM_STAGES];
+    // Duration of a frame, mean and maximum over all frames, percentiles
+    // over the last PIXEL_AA_STATS_HISTORY
+    double frame_ms_mean;
+    double frame_ms_p50;
+    double frame_ms_p90;
+    double frame_ms_p99;
+    double frame_ms_max;
+    // Threads scaling the frames, see pixel_aa_get_thread_stats()
+    int num_threads;
+} PixelAAStats;
+
+typedef struct {
+    // Time spent on tasks, and waiting for other threads while the frame
+    // wasn't done
+    double busy_ms;
+    double idle_ms;
+    int64_t tasks;
+} PixelAAThreadStats;
+
+// Reads the counters of a context, e.g. for an on-screen display. Not
+// while a frame is being scaled. Returns -1 and zeroes `stats` in builds
+// without USE_STATS.
+int pixel_aa_get_stats(const PixelAAContext* ctx, PixelAAStats* stats);
+
+// Same for thread `thread` in [0, num_threads), 0 being the calling thread.
+// Returns -1 in builds without USE_STATS or if the thread doesn't exist.
+int pixel_aa_get_thread_stats(const PixelAAContext* ctx, int thread,
+                              PixelAAThreadStats* stats);
+
+// Sets all counters back to 0.
+void pixel_aa_reset_stats(PixelAAContext* ctx);
+
+void pixel_aa_destroy(PixelAAContext* ctx);
+
+// Pipeline of frames in flight around one context, for video: While frame N
+// is scaled on a dedicated thread, the caller can fill frame N + 1 and
+// present frame N - 1. Frames go through a fixed ring of `depth` slots, each
+// with an input and an output buffer, strictly in order:
+//   acquire_input -> fill -> submit -> (scaled) -> complete -> use -> release
+// pixel_aa_pipeline_acquire_input() blocks while all slots are in flight,
+// which bounds the queue. Producer and consumer may be different threads,
+// but there may only be one of each. Without USE_THREADS, frames are scaled
+// synchronously in pixel_aa_pipeline_submit().
+typedef struct PixelAAPipeline PixelAAPipeline;
+
+typedef struct {
+    int64_t frames_submitted;
+    int64_t frames_completed;
+    // pixel_aa_scale() per frame
+    double scale_ms_mean;
+    double scale_ms_max;
+    // From submit until the frame is scaled, including queueing
+    double latency_ms_mean;
+    double latency_ms_max;
+    // Total time each stage waited for another one. A growing input stall
+    // means the scaler or the consumer can't keep up, scaler idle time means
+    // the producer can't, and output stall means the scaler can't.
+    double input_stall_ms;
+    double scaler_idle_ms;
+    double output_stall_ms;
+    // Scaled frames per second from the first submit until the last frame
+    // was scaled. Frames the consumer hasn't released yet are included, so
+    // this is the throughput of the scaler, not of the consumer.
+    double frames_per_s;
+} PixelAAPipelineStats;
+
+// Creates a pipeline with `depth` slots, at least 2. The context must
+// outlive the pipeline and must not be used for anything else meanwhile.
+// Returns NULL if allocation fails or the context is incremental.
+PixelAAPipeline* pixel_aa_pipeline_create(PixelAAContext* ctx, int depth);
+
+// Returns the input buffer of the next slot, with room for
+// in_width * in_height pixels of the input format, waiting until the slot is
+// free. Returns NULL if the previous input hasn't been submitted yet or after
+// pixel_aa_pipeline_finish(). Without USE_THREADS, returns NULL instead of
+// waiting, since only the caller could free the slot.
+void* pixel_aa_pipeline_acquire_input(PixelAAPipeline* pipeline);
+
+// Queues the acquired input buffer for scaling.
+void pixel_aa_pipeline_submit(PixelAAPipeline* pipeline);
+
+// Marks the end of the input. No more frames can be acquired afterwards.
+void pixel_aa_pipeline_finish(PixelAAPipeline* pipeline);
+
+// Waits for the oldest frame that hasn't been completed yet and returns its
+// output buffer. It stays valid until it is released. Returns NULL once
+// pixel_aa_pipeline_finish() was called and all frames are completed. Without
+// USE_THREADS, returns NULL whenever no frame is in flight.
+const void* pixel_aa_pipeline_complete(PixelAAPipeline* pipeline);
+
+// Hands the oldest completed output buffer back to the pipeline.
+void pixel_aa_pipeline_release(PixelAAPipeline* pipeline);
+
+void pixel_aa_pipeline_get_stats(PixelAAPipeline* pipeline,
+                                 PixelAAPipelineStats* stats);
+
+// Waits for the frame currently being scaled, drops all others.
+void pixel_aa_pipeline_destroy(PixelAAPipeline* pipeline);
+
+// Streaming mode around one context, for row-by-row decoders, encoders and
+// scanout: Input rows are pushed top to bottom, each output row is handed to
+// a callback as soon as the input rows it samples are in. Memory is bounded
+// to two rows of history and one output row, independent of the image
+// height. Rows are scaled on the calling thread, tiles and incremental mode
+// don't apply.
+typedef struct PixelAAStream PixelAAStream;
+
+// Receives output row y in the output format, out_width pixels. The row is
+// only valid during the call.
+typedef void (*pixel_aa_emit_row_fn)(void* user, int y, const void* row);
+
+// Creates a stream. The context must outlive it and must not be used for
+// anything else meanwhile. Returns NULL if allocation fails or the context
+// downscales.
+PixelAAStream* pixel_aa_stream_create(PixelAAContext* ctx,
+                                      pixel_aa_emit_row_fn emit, void* user);
+
+// Pushes the next input row, in_width pixels of the input format, and emits
+// all output rows that became complete. Returns the number of rows emitted.
+// After the last input row of a frame, all output rows have been emitted and
+// the next push starts a new frame.
+int pixel_aa_stream_push_row(PixelAAStream* stream, const void* row);
+
+void pixel_aa_stream_destroy(PixelAAStream* stream);
+
+// Whole-frame kernel for one configuration, see pixel_aa_generate_kernel().
+typedef void (*pixel_aa_kernel_fn)(const uint32_t* in, uint32_t* out);
+
+// Generates C source for a size-specialized kernel named `name` with the
+// signature of pixel_aa_kernel_fn. It produces the same output as
+// pixel_aa_scale() without the separable option, with all source offsets
+// and weights of one x and y cycle unrolled into constants. The source only
+// needs <stdint.h> and <string.h>, so it can be compiled at run time, e.g.
+// with libtcc. Returns a malloc'd string, or NULL if allocation fails or the
+// context doesn't upscale XRGB8888 to XRGB8888.
+char* pixel_aa_generate_kernel(const PixelAAContext* ctx, const char* name);
+
+// Same kernel as textual LLVM IR, for JITs without a C frontend.
+char* pixel_aa_generate_kernel_ir(const PixelAAContext* ctx, const char* name);
+
+// Writes a key that identifies the generated kernel of this configuration to
+// `key`: sizes, curve, weight type, target architecture and generator
+// version, e.g. "256x224_640x480_smoothstep_float_x86_64_v1". Meant as a
+// file name for caching compiled kernels. Returns the length of the key like
+// snprintf().
+int pixel_aa_kernel_key(const PixelAAContext* ctx, char* key, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PIXEL_AA_H
@@ -0,0 +1,551 @@
+#ifndef PIXEL_AA_INTERNAL_H
+#define PIXEL_AA_INTERNAL_H
+
+#include <stdint.h>
+
+#include "pixel_aa.h"
+
+#ifdef FIXED_POINT
+// We need a data type that's at least 8 bits bigger than
+// FIXED_POINT_BITS to handle multiplication with uchar and not overflow.
+// We need a signed fixed point type to deal with mix operation containing a
+// difference operation.
+// #define FIXED_POINT
+#define FIXED_POINT_BITS 8
+typedef int16_t fixed_point_t;
+typedef fixed_point_t weight_t;
+
+static inline fixed_point_t mix(fixed_point_t x, fixed_point_t y,
+                                fixed_point_t a) {
+    return x + ((a * (y - x)) >> FIXED_POINT_BITS);
+}
+
+#define WEIGHT_TOL 1
+#define WEIGHT_TOL_UPPER ((1 << FIXED_POINT_BITS) - WEIGHT_TOL)
+#define WEIGHT_ONE (1 << FIXED_POINT_BITS)
+#else  // !FIXED_POINT
+typedef float weight_t;
+
+static inline float mix(float x, float y, float a) { return x + a * (y - x); }
+
+#define WEIGHT_TOL 1.0e-2f
+#define WEIGHT_TOL_UPPER (1.0f - WEIGHT_TOL)
+#define WEIGHT_ONE 1.0f
+#endif  // FIXED_POINT
+
+#define GET_CH(color, c) (((color) >> (8 * (2 - (c)))) & 0xFF)
+#define GET_COL(r, g, b)                                              \
+    (((uint32_t)(r) << 16) | ((uint32_t)(g) << 8) | ((uint32_t)(b)) | \
+     0xFFu << 24)
+
+static inline uint32_t mix_col(uint32_t x, uint32_t y, weight_t a) {
+    return GET_COL(mix(GET_CH(x, 0), GET_CH(y, 0), a),
+                   mix(GET_CH(x, 1), GET_CH(y, 1), a),
+                   mix(GET_CH(x, 2), GET_CH(y, 2), a));
+}
+
+// Memory layouts of the pixel formats, by how a native 32 bit load relates
+// to 0xAARRGGBB. Values are used as array indices and in
+// PIXEL_AA_DEFINE_ROW_KERNELS().
+enum {
+    // 32 bit, alpha in the high byte: XRGB8888
+    LAYOUT_ALPHA_HIGH = 0,
+    // 32 bit, alpha in the low byte: RGBA8888
+    LAYOUT_ALPHA_LOW = 1,
+    // 16 bit 5:6:5
+    LAYOUT_RGB565 = 2,
+    // 32 bit, all bytes reversed: BGRA8888
+    LAYOUT_SWAPPED = 3,
+    NUM_LAYOUTS = 4,
+    // 8 bit palette indices, input only. Has no row kernels, see
+    // palette_scale_row_x().
+    LAYOUT_INDEX8 = NUM_LAYOUTS,
+};
+
+static inline int layout_bytes(int layout) {
+    return layout == LAYOUT_RGB565 ? 2 : layout == LAYOUT_INDEX8 ? 1 : 4;
+}
+
+static inline const void* pixel_offset(const void* row, int i, int layout) {
+    return (const uint8_t*)row + (intptr_t)i * layout_bytes(layout);
+}
+
+static inline void* pixel_offset_mut(void* row, int i, int layout) {
+    return (uint8_t*)row + (intptr_t)i * layout_bytes(layout);
+}
+
+// Row y of an image whose rows are `stride` bytes apart.
+static inline const void* row_offset(const void* image, int y, int stride) {
+    return (const uint8_t*)image + (intptr_t)y * stride;
+}
+
+static inline void* row_offset_mut(void* image, int y, int stride) {
+    return (uint8_t*)image + (intptr_t)y * stride;
+}
+
+// Widens a channel of `bits` bits to 8 bits, so that 0 and the maximum map
+// to 0 and 0xFF.
+#define WIDEN_5(c) (((c) << 3) | ((c) >> 2))
+#define WIDEN_6(c) (((c) << 2) | ((c) >> 4))
+
+// Pixel i of a row as 0xAARRGGBB, the layout of GET_CH and GET_COL. RGB565
+// pixels get alpha 0xFF.
+static inline uint32_t load_pixel(const void* row, int i, int layout) {
+    if (layout == LAYOUT_RGB565) {
+        const uint32_t p = ((const uint16_t*)row)[i];
+        return 0xFF000000u | WIDEN_5(p >> 11) << 16 |
+               WIDEN_6((p >> 5) & 0x3F) << 8 | WIDEN_5(p & 0x1F);
+    }
+    const uint32_t p = ((const uint32_t*)row)[i];
+    if (layout == LAYOUT_SWAPPED) {
+        return __builtin_bswap32(p);
+    }
+    return layout == LAYOUT_ALPHA_LOW ? p >> 8 | p << 24 : p;
+}
+
+// Inverse of load_pixel(). RGB565 truncates the channels.
+static inline void store_pixel(void* row, int i, uint32_t col, int layout) {
+    if (layout == LAYOUT_RGB565) {
+        ((uint16_t*)row)[i] = (uint16_t)((col >> 8 & 0xF800) |
+                                         (col >> 5 & 0x07E0) |
+                                         (col >> 3 & 0x001F));
+    } else if (layout == LAYOUT_SWAPPED) {
+        ((uint32_t*)row)[i] = __builtin_bswap32(col);
+    } else {
+        ((uint32_t*)row)[i] =
+            layout == LAYOUT_ALPHA_LOW ? col << 8 | col >> 24 : col;
+    }
+}
+
+// Row kernels for the center part of the image, i.e. the part where we
+// actually interpolate. Output pixel i samples the input pixels at
+// src_x[i] and src_x[i] + 1 of the given row(s).
+// Weights are snapped to exactly 0 and WEIGHT_ONE outside of
+// [WEIGHT_TOL, WEIGHT_TOL_UPPER] at plan time, so branch-free kernels
+// produce the same result as the branching scalar ones.
+// Pixels are unpacked from the input layout and packed into the output
+// layout as part of the blend, there is one kernel per combination.
+typedef void (*blend_x_row_fn)(const void* row, const int32_t* src_x,
+                               const weight_t* weights_x, void* out,
+                               int count);
+typedef void (*blend_y_row_fn)(const void* row0, const void* row1,
+                               weight_t weight_y, void* out, int count);
+typedef void (*blend_xy_row_fn)(const void* row0, const void* row1,
+                                const int32_t* src_x,
+                                const weight_t* weights_x, weight_t weight_y,
+                                void* out, int count);
+
+typedef struct {
+    // Need 2 samples, mix with weights_x
+    blend_x_row_fn blend_x_row;
+    // Need 2 samples, mix contiguous pixels of two rows with weight_y
+    blend_y_row_fn blend_y_row;
+    // Need 4 samples, mix with weights_x and weight_y
+    blend_xy_row_fn blend_xy_row;
+} RowKernels;
+
+// Downscaling by an exact factor: Averages blocks of factor x factor pixels
+// into `count` output pixels, both in the same 32 bit layout. `row` points at
+// the top left pixel of the first block, the rows of a block are `stride`
+// bytes apart. Channels are rounded to nearest, and the alpha or padding
+// byte is set with `alpha`, 0xFF in the byte of that layout.
+typedef void (*reduce_row_fn)(const void* row, int stride, uint32_t alpha,
+                              void* out, int count);
+
+typedef struct {
+    const char* name;
+    // Indexed by input and output layout
+    RowKernels rows[NUM_LAYOUTS][NUM_LAYOUTS];
+    reduce_row_fn reduce_2x2_row;
+    reduce_row_fn reduce_4x4_row;
+} PixelAAKernels;
+
+// Each kernel set implements blend_x_row_<isa>(), blend_y_row_<isa>() and
+// blend_xy_row_<isa>() with two trailing arguments, the input and the output
+// layout. PIXEL_AA_DEFINE_ROW_KERNELS(isa) instantiates them for every
+// combination with constant layouts, so the layout checks fold away.
+// PIXEL_AA_ROW_KERNEL_TABLE(isa) is the matching PixelAAKernels.rows.
+#define PIXEL_AA_ALWAYS_INLINE static inline __attribute__((always_inline))
+
+#define PIXEL_AA_ROW_KERNELS(isa, in, out)                                   \
+    static void blend_x_row_##isa##_##in##_##out(                            \
+        const void* row, const int32_t* src_x, const weight_t* weights_x,    \
+        void* dst, int count) {                                              \
+        blend_x_row_##isa(row, src_x, weights_x, dst, count, in, out);       \
+    }                                                                        \
+    static void blend_y_row_##isa##_##in##_##out(                            \
+        const void* row0, const void* row1, weight_t weight_y, void* dst,    \
+        int count) {                                                         \
+        blend_y_row_##isa(row0, row1, weight_y, dst, count, in, out);        \
+    }                                                                        \
+    static void blend_xy_row_##isa##_##in##_##out(                           \
+        const void* row0, const void* row1, const int32_t* src_x,            \
+        const weight_t* weights_x, weight_t weight_y, void* dst,             \
+        int count) {                                                         \
+        blend_xy_row_##isa(row0, row1, src_x, weights_x, weight_y, dst,      \
+                           count, in, out);                                  \
+    }
+
+#define PIXEL_AA_DEFINE_ROW_KERNELS(isa) \
+    PIXEL_AA_ROW_KERNELS(isa, 0, 0)      \
+    PIXEL_AA_ROW_KERNELS(isa, 0, 1)      \
+    PIXEL_AA_ROW_KERNELS(isa, 0, 2)      \
+    PIXEL_AA_ROW_KERNELS(isa, 0, 3)      \
+    PIXEL_AA_ROW_KERNELS(isa, 1, 0)      \
+    PIXEL_AA_ROW_KERNELS(isa, 1, 1)      \
+    PIXEL_AA_ROW_KERNELS(isa, 1, 2)      \
+    PIXEL_AA_ROW_KERNELS(isa, 1, 3)      \
+    PIXEL_AA_ROW_KERNELS(isa, 2, 0)      \
+    PIXEL_AA_ROW_KERNELS(isa, 2, 1)      \
+    PIXEL_AA_ROW_KERNELS(isa, 2, 2)      \
+    PIXEL_AA_ROW_KERNELS(isa, 2, 3)      \
+    PIXEL_AA_ROW_KERNELS(isa, 3, 0)      \
+    PIXEL_AA_ROW_KERNELS(isa, 3, 1)      \
+    PIXEL_AA_ROW_KERNELS(isa, 3, 2)      \
+    PIXEL_AA_ROW_KERNELS(isa, 3, 3)
+
+#define PIXEL_AA_ROW_KERNEL_ENTRY(isa, in, out)               \
+    {                                                          \
+        blend_x_row_##isa##_##in##_##out,                      \
+            blend_y_row_##isa##_##in##_##out,                  \
+            blend_xy_row_##isa##_##in##_##out,                 \
+    }
+
+#define PIXEL_AA_ROW_KERNEL_ROW(isa, in)           \
+    {                                              \
+        PIXEL_AA_ROW_KERNEL_ENTRY(isa, in, 0),     \
+            PIXEL_AA_ROW_KERNEL_ENTRY(isa, in, 1), \
+            PIXEL_AA_ROW_KERNEL_ENTRY(isa, in, 2), \
+            PIXEL_AA_ROW_KERNEL_ENTRY(isa, in, 3), \
+    }
+
+#define PIXEL_AA_ROW_KERNEL_TABLE(isa)                                    \
+    {                                                                     \
+        PIXEL_AA_ROW_KERNEL_ROW(isa, 0), PIXEL_AA_ROW_KERNEL_ROW(isa, 1), \
+            PIXEL_AA_ROW_KERNEL_ROW(isa, 2),                              \
+            PIXEL_AA_ROW_KERNEL_ROW(isa, 3),                              \
+    }
+
+// The SIMD kernels hand the last count % width pixels of a row to these.
+extern const PixelAAKernels pixel_aa_kernels_scalar;
+
+// SIMD kernels are built in if the target flags allow them. With
+// PIXEL_AA_RUNTIME_DISPATCH, all kernels of the architecture are built, each
+// translation unit with its own flags, and the CPU is checked at run time.
+#if defined(__x86_64__) || defined(__i386__)
+#define PIXEL_AA_X86
+#endif
+#if defined(__AVX2__) || \
+    (defined(PIXEL_AA_RUNTIME_DISPATCH) && defined(PIXEL_AA_X86))
+#define PIXEL_AA_HAVE_AVX2
+extern const PixelAAKernels pixel_aa_kernels_avx2;
+#endif
+#if defined(__SSE2__) || \
+    (defined(PIXEL_AA_RUNTIME_DISPATCH) && defined(PIXEL_AA_X86))
+#define PIXEL_AA_HAVE_SSE2
+extern const PixelAAKernels pixel_aa_kernels_sse2;
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || \
+    (defined(PIXEL_AA_RUNTIME_DISPATCH) && defined(__arm__))
+#define PIXEL_AA_HAVE_NEON
+extern const PixelAAKernels pixel_aa_kernels_neon;
+#endif
+
+// All kernel sets built in, slowest first.
+extern const PixelAAKernels* const pixel_aa_kernel_sets[];
+extern const int pixel_aa_num_kernel_sets;
+
+// Whether the CPU can run a built-in kernel set.
+int kernels_supported(const PixelAAKernels* kernels);
+
+// Palette input: Sets up the pair weights of ctx, with a grayscale palette.
+// Returns 0 on success.
+int palette_init(PixelAAContext* ctx);
+
+// Palette input: Rebuilds the pair weights and blends after the weights of
+// ctx changed, keeping the palette. Can't fail, without memory for the
+// blends they are mixed per pixel.
+void palette_set_weights(PixelAAContext* ctx);
+
+// Palette input: Scales one row of indices horizontally into output columns
+// [x0, x1), as XRGB8888.
+void palette_scale_row_x(const PixelAAContext* ctx, const uint8_t* row,
+                         uint32_t* out, int x0, int x1);
+
+// Downscaling: Builds the coverage tables of ctx and the scratch rows for
+// its threads. Returns 0 on success.
+int downscale_init(PixelAAContext* ctx);
+
+// Downscaling: Scales output columns [x0, x1) of rows [y0, y1). `in` is the
+// top left input pixel, `out` output pixel (x0, y0).
+void downscale_rows(const PixelAAContext* ctx, const void* in, int in_stride,
+                    void* out, int out_stride, int x0, int x1, int y0, int y1,
+                    int thread_num);
+
+// Whole output rows on the calling thread, for the streaming mode. Direct
+// path: Scales input rows row0 and row1, mixed with offset_y. row1 is only
+// read if offset_y is not snapped to 0.
+void scale_row_pair(const PixelAAContext* ctx, const void* row0,
+                    const void* row1, weight_t offset_y, void* out);
+// Separable path: Scales one input row horizontally to XRGB8888, then mixes
+// two of those vertically into the output format.
+void scale_row_horizontal(const PixelAAContext* ctx, const void* row,
+                          uint32_t* out);
+void scale_row_vertical(const PixelAAContext* ctx, const uint32_t* row0,
+                        const uint32_t* row1, weight_t offset_y, void* out);
+
+#ifdef USE_STATS
+// Counters of one thread of a context, written only by that thread.
+typedef struct {
+    int64_t pixels[PIXEL_AA_NUM_PATHS];
+    int64_t stage_ns[PIXEL_AA_NUM_STAGES];
+    int64_t busy_ns;
+    int64_t tasks;
+} ThreadStats;
+
+typedef struct {
+    // Mixed center columns before each column, so columns [x0, x1) have
+    // mixed_x[x1] - mixed_x[x0] of them. Kept by pixel_aa_reset_stats().
+    int32_t* mixed_x;
+    int64_t frames;
+    int64_t frame_ns_total;
+    int64_t frame_ns_max;
+    // Duration of frame i at i % PIXEL_AA_STATS_HISTORY
+    int64_t frame_ns[PIXEL_AA_STATS_HISTORY];
+    // Wall time of all jobs, how long each thread could have been busy
+    int64_t job_ns;
+    // One per thread of the context
+    ThreadStats threads[];
+} ContextStats;
+
+// A job whose tasks run through stats_run_task(), which times them per
+// thread.
+typedef struct {
+    const PixelAAContext* ctx;
+    void (*fn)(void* arg, int task, int thread_num);
+    void* arg;
+} StatsTasks;
+
+// Counters of the task running on this thread, NULL outside of tasks.
+extern _Thread_local ThreadStats* stats_thread;
+
+int64_t stats_now_ns(void);
+// Allocates the counters of ctx. Returns 0 on success.
+int stats_init(PixelAAContext* ctx);
+// Recounts the mixed columns after the weights changed.
+void stats_set_samples(PixelAAContext* ctx);
+void stats_destroy(PixelAAContext* ctx);
+void stats_run_task(void* arg, int task, int thread_num);
+// Counts output columns [x0, x1) of row y by the samples they mix.
+void stats_count_row(const PixelAAContext* ctx, int y, int x0, int x1);
+void stats_end_frame(PixelAAContext* ctx, int64_t start_ns);
+
+// Instrumentation of the hot paths, which compiles to nothing without
+// USE_STATS.
+#define STATS_TIMER(name) const int64_t name = stats_now_ns()
+#define STATS_ADD_TIME(stage, start, end)                     \
+    do {                                                      \
+        if (stats_thread) {                                   \
+            stats_thread->stage_ns[stage] += (end) - (start); \
+        }                                                     \
+    } while (0)
+#define STATS_ADD_PIXELS(path, count)              \
+    do {                                           \
+        if (stats_thread) {                        \
+            stats_thread->pixels[path] += (count); \
+        }                                          \
+    } while (0)
+#define STATS_COUNT_ROW(ctx, y, x0, x1) stats_count_row(ctx, y, x0, x1)
+#define STATS_END_FRAME(ctx, start) stats_end_frame(ctx, start)
+#else  // !USE_STATS
+#define STATS_TIMER(name)
+#define STATS_ADD_TIME(stage, start, end) ((void)0)
+#define STATS_ADD_PIXELS(path, count) ((void)0)
+#define STATS_COUNT_ROW(ctx, y, x0, x1) ((void)0)
+#define STATS_END_FRAME(ctx, start) ((void)0)
+#endif  // USE_STATS
+
+// The center columns of a row are split into spans of output pixels that are
+// produced the same way. The pattern repeats every x_cycle_length output
+// columns, advancing by x_in_advance input columns, so only one cycle is
+// stored. The first few center columns may not be part of the cycle yet,
+// they get their own prologue spans.
+enum {
+    // Output pixels are all copies of one input pixel
+    SPAN_FILL,
+    // Output pixels are copies of consecutive input pixels
+    SPAN_COPY,
+    // Output pixels are mixed from two input pixels each
+    SPAN_BLEND,
+};
+
+// Minimum average span length (in output pixels) for the span tables to be
+// used over the per column kernels.
+#define SPAN_MIN_AVG_LENGTH 8
+
+// Lower limits for automatically sized tiles, see PixelAAContext.tile_width.
+#define MIN_TILE_WIDTH 64
+#define MIN_TILE_HEIGHT 8
+
+// Palette input: Upper limit for the pair tables of all blend weights
+// together. Above it, pairs are mixed per pixel.
+#define MAX_PAIR_TABLE_BYTES (4 << 20)
+
+// Incremental mode: Input rows are compared in blocks of this many pixels,
+// and hashed in tasks of this many rows.
+#define DIRTY_BLOCK_WIDTH 32
+#define DIRTY_ROWS_PER_TASK 16
+
+// Downscaling: Output pixels are averages of the input area they cover,
+// weighted per axis in fractions of AREA_ONE. The weights of one output
+// column or row sum to exactly AREA_ONE, so that sums of 8 bit channels
+// weighted on both axes fit 32 bits.
+#define AREA_BITS 12
+#define AREA_ONE (1 << AREA_BITS)
+
+// Downscaling: Input columns or rows [src, src + count) covered by one output
+// column or row. The weights of output column x are
+// area_weights_x[x * area_taps_x + i], padded with zeros to area_taps_x,
+// same for rows.
+typedef struct {
+    int32_t src;
+    int32_t count;
+} Coverage;
+
+typedef struct {
+    int32_t type;
+    int32_t count;
+    // SPAN_FILL, SPAN_COPY: Input column relative to the start of the
+    // prologue or cycle.
+    // SPAN_BLEND: Index of the first entry in blend_src and blend_weights.
+    int32_t index;
+    // First output column, relative to the start of the prologue or cycle
+    int32_t start;
+} Span;
+
+struct PixelAAContext {
+    int in_width;
+    int in_height;
+    int out_width;
+    int out_height;
+    PixelAAFormat in_format;
+    PixelAAFormat out_format;
+    int in_layout;
+    int out_layout;
+    // Iteration limits: For the first and last N pixels in each row and
+    // column, we don't need to interpolate as we simply sample the border
+    // pixel from the input image. This not just saves computations, but also
+    // allows us to drop boundary checks throughout the sampling.
+    int border_x;
+    int border_y;
+    // Transition curve the weights were computed with
+    PixelAACurve curve;
+    float sharpness;
+    // Precomputed interpolation weights
+    weight_t* weights_x;
+    weight_t* weights_y;
+    // Input column of the left sample for each output column, and input row
+    // of the top sample for each output row
+    int32_t* src_x;
+    int32_t* src_y;
+    // For each output row, an earlier output row with the same content, or
+    // -1 if the row has to be computed.
+    int32_t* copy_src_y;
+    int num_copy_rows;
+    // Scratch of build_tables(), one entry per input row. Allocated up
+    // front, so that pixel_aa_set_curve() can't fail halfway.
+    int32_t* first_row;
+    // Span tables for the center columns, see Span.
+    int use_spans;
+    Span* spans;
+    int num_prologue_spans;
+    int num_cycle_spans;
+    int prologue_width;
+    int x_cycle_length;
+    int x_in_advance;
+    // Input column at the start of the first cycle
+    int cycle_src_x;
+    // Left sample relative to the start of the prologue or cycle, and weight,
+    // for each pixel in a SPAN_BLEND.
+    int32_t* blend_src;
+    weight_t* blend_weights;
+    // Index into spans for each column of the prologue and the first cycle,
+    // so that a row can start at any column without walking the spans.
+    int32_t* column_span;
+    const PixelAAKernels* kernels;
+    // The frame is processed in tiles, row major. Each tile is one task of
+    // the thread pool.
+    int tile_width;
+    int tile_height;
+    int num_tiles_x;
+    int num_tiles_y;
+    int num_threads;
+    struct ThreadPool* pool;
+    // Separable mode: ring of two horizontally scaled rows per thread, each
+    // tile_width wide
+    int separable;
+    uint32_t* ring;
+    // Palette input, see pixel_aa_set_palette(). Indices are masked with
+    // palette_mask, num_colors rounded up to a power of two minus one.
+    uint32_t palette[256];
+    int num_colors;
+    int palette_mask;
+    // Distinct weights of the blended center columns
+    int num_pair_weights;
+    weight_t* pair_weights;
+    // For each output column: 0 takes the left sample, 1 the right one,
+    // k >= 2 blends them with pair_weights[k - 2].
+    int32_t* column_weight;
+    // For each pair weight k, the blend of colors a and b at
+    // (k * (palette_mask + 1) + a) * (palette_mask + 1) + b, or NULL if that
+    // would be bigger than MAX_PAIR_TABLE_BYTES.
+    uint32_t* pair_tables;
+    // Downscaling, set if the output is smaller than the input on either
+    // axis. The weights, samples and spans above aren't used then, both axes
+    // are area averaged, see Coverage.
+    int downscale;
+    Coverage* coverage_x;
+    Coverage* coverage_y;
+    uint16_t* area_weights_x;
+    uint16_t* area_weights_y;
+    int area_taps_x;
+    int area_taps_y;
+    // 2 or 4 if both axes are reduced by that factor and the reduce kernels
+    // apply to the layouts, 0 otherwise
+    int reduce_factor;
+    // Weighted sums of the input rows of one output row, 4 bytes per input
+    // column, in_width + area_taps_x columns per thread
+    uint32_t* area_sums;
+    // Incremental mode, see PixelAAOptions.incremental.
+    int incremental;
+    // Whether block_hashes and the output hold a previous frame.
+    int have_previous;
+    // Hash of each block of DIRTY_BLOCK_WIDTH pixels of each input row of
+    // the previous frame, num_hash_blocks per row.
+    int num_hash_blocks;
+    uint64_t* block_hashes;
+    // Changed input columns [in_dirty_x0[y], in_dirty_x1[y]) of each input
+    // row of the current frame
+    int32_t* in_dirty_x0;
+    int32_t* in_dirty_x1;
+    // Output columns [dep_x0[x], dep_x1[x]) that sample input column x,
+    // including both samples of blended pixels
+    int32_t* dep_x0;
+    int32_t* dep_x1;
+    // Output columns [out_dirty_x0[y], out_dirty_x1[y]) of each output row
+    // that have to be recomputed in the current frame
+    int32_t* out_dirty_x0;
+    int32_t* out_dirty_x1;
+    // Bounding box of the output pixels changed by the last frame
+    int dirty_x0;
+    int dirty_y0;
+    int dirty_x1;
+    int dirty_y1;
+#ifdef USE_STATS
+    // See pixel_aa_get_stats(). The pointer stays the same, the counters
+    // are written during frames.
+    ContextStats* stats;
+#endif  // USE_STATS
+};
+
+#endif  // PIXEL_AA_INTERNAL_H
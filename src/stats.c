@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pixel_aa_internal.h"
+
+// Instrumentation, see pixel_aa_get_stats(). Tasks of the thread pool run
+// through stats_run_task(), which points stats_thread at the counters of
+// its thread, so the scaling code doesn't pass them around. Pixels are
+// counted per row from the weights, outside of the kernels, and stages are
+// timed with the monotonic clock around the loops that produce them.
+
+#ifdef USE_STATS
+
+_Thread_local ThreadStats* stats_thread;
+
+int64_t stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static size_t stats_size(const PixelAAContext* ctx) {
+    return sizeof(ContextStats) + ctx->num_threads * sizeof(ThreadStats);
+}
+
+int stats_init(PixelAAContext* ctx) {
+    ctx->stats = (ContextStats*)calloc(1, stats_size(ctx));
+    if (!ctx->stats) {
+        return -1;
+    }
+    if (ctx->downscale) {
+        return 0;
+    }
+    ctx->stats->mixed_x =
+        (int32_t*)malloc((ctx->out_width + 1) * sizeof(int32_t));
+    if (!ctx->stats->mixed_x) {
+        return -1;
+    }
+    stats_set_samples(ctx);
+    return 0;
+}
+
+void stats_set_samples(PixelAAContext* ctx) {
+    int32_t* mixed_x = ctx->stats->mixed_x;
+    mixed_x[0] = 0;
+    for (int x = 0; x < ctx->out_width; ++x) {
+        const weight_t weight = ctx->weights_x[x];
+        mixed_x[x + 1] = mixed_x[x] +
+                         (weight >= WEIGHT_TOL && weight <= WEIGHT_TOL_UPPER);
+    }
+}
+
+void stats_destroy(PixelAAContext* ctx) {
+    if (ctx->stats) {
+        free(ctx->stats->mixed_x);
+        free(ctx->stats);
+    }
+}
+
+void stats_run_task(void* arg, int task, int thread_num) {
+    const StatsTasks* tasks = (const StatsTasks*)arg;
+    ThreadStats* stats = &tasks->ctx->stats->threads[thread_num];
+    stats_thread = stats;
+    const int64_t start = stats_now_ns();
+    tasks->fn(tasks->arg, task, thread_num);
+    stats->busy_ns += stats_now_ns() - start;
+    ++stats->tasks;
+    stats_thread = NULL;
+}
+
+void stats_count_row(const PixelAAContext* ctx, int y, int x0, int x1) {
+    if (!stats_thread) {
+        return;
+    }
+    const int32_t* mixed_x = ctx->stats->mixed_x;
+    const int64_t mixed = mixed_x[x1] - mixed_x[x0];
+    const int64_t unmixed = x1 - x0 - mixed;
+    const weight_t weight = ctx->weights_y[y];
+    if (weight >= WEIGHT_TOL && weight <= WEIGHT_TOL_UPPER) {
+        stats_thread->pixels[PIXEL_AA_PATH_4_SAMPLES] += mixed;
+        stats_thread->pixels[PIXEL_AA_PATH_2_SAMPLES] += unmixed;
+    } else {
+        stats_thread->pixels[PIXEL_AA_PATH_2_SAMPLES] += mixed;
+        stats_thread->pixels[PIXEL_AA_PATH_1_SAMPLE] += unmixed;
+    }
+}
+
+void stats_end_frame(PixelAAContext* ctx, int64_t start_ns) {
+    ContextStats* stats = ctx->stats;
+    const int64_t frame_ns = stats_now_ns() - start_ns;
+    stats->frame_ns[stats->frames % PIXEL_AA_STATS_HISTORY] = frame_ns;
+    ++stats->frames;
+    stats->frame_ns_total += frame_ns;
+    if (frame_ns > stats->frame_ns_max) {
+        stats->frame_ns_max = frame_ns;
+    }
+}
+
+static int compare_ns(const void* a, const void* b) {
+    const int64_t x = *(const int64_t*)a;
+    const int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+int pixel_aa_get_stats(const PixelAAContext* ctx, PixelAAStats* stats) {
+    const ContextStats* context_stats = ctx->stats;
+    memset(stats, 0, sizeof(*stats));
+    stats->frames = context_stats->frames;
+    stats->num_threads = ctx->num_threads;
+    for (int t = 0; t < ctx->num_threads; ++t) {
+        const ThreadStats* thread = &context_stats->threads[t];
+        for (int i = 0; i < PIXEL_AA_NUM_PATHS; ++i) {
+            stats->pixels[i] += thread->pixels[i];
+        }
+        for (int i = 0; i < PIXEL_AA_NUM_STAGES; ++i) {
+            stats->stage_ms[i] += thread->stage_ns[i] * 1.0e-6;
+        }
+    }
+    if (context_stats->frames == 0) {
+        return 0;
+    }
+    stats->frame_ms_mean =
+        context_stats->frame_ns_total * 1.0e-6 / context_stats->frames;
+    stats->frame_ms_max = context_stats->frame_ns_max * 1.0e-6;
+
+    // Nearest rank percentiles of the recent frames
+    const int count = context_stats->frames < PIXEL_AA_STATS_HISTORY
+                          ? (int)context_stats->frames
+                          : PIXEL_AA_STATS_HISTORY;
+    int64_t frame_ns[PIXEL_AA_STATS_HISTORY];
+    memcpy(frame_ns, context_stats->frame_ns, count * sizeof(int64_t));
+    qsort(frame_ns, count, sizeof(int64_t), compare_ns);
+    stats->frame_ms_p50 = frame_ns[(count * 50 + 99) / 100 - 1] * 1.0e-6;
+    stats->frame_ms_p90 = frame_ns[(count * 90 + 99) / 100 - 1] * 1.0e-6;
+    stats->frame_ms_p99 = frame_ns[(count * 99 + 99) / 100 - 1] * 1.0e-6;
+    return 0;
+}
+
+int pixel_aa_get_thread_stats(const PixelAAContext* ctx, int thread,
+                              PixelAAThreadStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (thread < 0 || thread >= ctx->num_threads) {
+        return -1;
+    }
+    const ThreadStats* thread_stats = &ctx->stats->threads[thread];
+    const int64_t idle_ns = ctx->stats->job_ns - thread_stats->busy_ns;
+    stats->busy_ms = thread_stats->busy_ns * 1.0e-6;
+    stats->idle_ms = idle_ns > 0 ? idle_ns * 1.0e-6 : 0.0;
+    stats->tasks = thread_stats->tasks;
+    return 0;
+}
+
+void pixel_aa_reset_stats(PixelAAContext* ctx) {
+    int32_t* mixed_x = ctx->stats->mixed_x;
+    memset(ctx->stats, 0, stats_size(ctx));
+    ctx->stats->mixed_x = mixed_x;
+}
+
+#else  // !USE_STATS
+
+int pixel_aa_get_stats(const PixelAAContext* ctx, PixelAAStats* stats) {
+    (void)ctx;
+    memset(stats, 0, sizeof(*stats));
+    return -1;
+}
+
+int pixel_aa_get_thread_stats(const PixelAAContext* ctx, int thread,
+                              PixelAAThreadStats* stats) {
+    (void)ctx;
+    (void)thread;
+    memset(stats, 0, sizeof(*stats));
+    return -1;
+}
+
+void pixel_aa_reset_stats(PixelAAContext* ctx) { (void)ctx; }
+
+#endif  // USE_STATS
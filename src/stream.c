@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixel_aa.h"
+#include "pixel_aa_internal.h"
+
+// Streaming mode. Output rows are emitted in order as soon as the input rows
+// they sample have been pushed. Output row y needs input row src_y[y] and,
+// unless its offset is snapped to 0, src_y[y] + 1. Once row r was pushed,
+// every pending output row needs row r - 1 at the earliest, so two rows of
+// history are enough.
+
+struct PixelAAStream {
+    PixelAAContext* ctx;
+    pixel_aa_emit_row_fn emit;
+    void* user;
+    // Two rows, indexed by input row & 1. Raw input rows for the direct
+    // path, horizontally scaled XRGB8888 rows for the separable path.
+    void* rows[2];
+    int row_bytes;
+    void* out_row;
+    // Next input row expected, next output row to emit
+    int next_in_y;
+    int next_out_y;
+    // Output row whose content is in out_row, after resolving copy_src_y,
+    // or -1.
+    int out_row_src;
+};
+
+// Last input row output row y depends on.
+static int needed_row(const PixelAAContext* ctx, int y) {
+    return ctx->src_y[y] + (ctx->weights_y[y] < WEIGHT_TOL ? 0 : 1);
+}
+
+PixelAAStream* pixel_aa_stream_create(PixelAAContext* ctx,
+                                      pixel_aa_emit_row_fn emit, void* user) {
+    if (ctx->downscale) {
+        return NULL;
+    }
+    PixelAAStream* stream = (PixelAAStream*)calloc(1, sizeof(PixelAAStream));
+    if (!stream) {
+        return NULL;
+    }
+    stream->ctx = ctx;
+    stream->emit = emit;
+    stream->user = user;
+    stream->row_bytes = ctx->separable
+                            ? ctx->out_width * (int)sizeof(uint32_t)
+                            : ctx->in_width * layout_bytes(ctx->in_layout);
+    stream->rows[0] = malloc(stream->row_bytes);
+    stream->rows[1] = malloc(stream->row_bytes);
+    stream->out_row = malloc((size_t)ctx->out_width *
+                             pixel_aa_bytes_per_pixel(ctx->out_format));
+    if (!stream->rows[0] || !stream->rows[1] || !stream->out_row) {
+        pixel_aa_stream_destroy(stream);
+        return NULL;
+    }
+    stream->out_row_src = -1;
+    return stream;
+}
+
+int pixel_aa_stream_push_row(PixelAAStream* stream, const void* row) {
+    const PixelAAContext* ctx = stream->ctx;
+    const int in_y = stream->next_in_y;
+    void* slot = stream->rows[in_y & 1];
+
+    // Rows above the first sample of the next output row are never read.
+    const int wanted = stream->next_out_y < ctx->out_height &&
+                       in_y >= ctx->src_y[stream->next_out_y];
+    if (wanted) {
+        if (ctx->separable) {
+            scale_row_horizontal(ctx, row, (uint32_t*)slot);
+        } else {
+            memcpy(slot, row, stream->row_bytes);
+        }
+    }
+
+    int num_emitted = 0;
+    while (stream->next_out_y < ctx->out_height &&
+           needed_row(ctx, stream->next_out_y) <= in_y) {
+        const int y = stream->next_out_y;
+        const int src = ctx->copy_src_y[y] >= 0 ? ctx->copy_src_y[y] : y;
+        if (src != stream->out_row_src) {
+            const void* row0 = stream->rows[ctx->src_y[y] & 1];
+            const void* row1 = stream->rows[(ctx->src_y[y] + 1) & 1];
+            if (ctx->separable) {
+                scale_row_vertical(ctx, (const uint32_t*)row0,
+                                   (const uint32_t*)row1, ctx->weights_y[y],
+                                   stream->out_row);
+            } else {
+                scale_row_pair(ctx, row0, row1, ctx->weights_y[y],
+                               stream->out_row);
+            }
+            stream->out_row_src = src;
+        }
+        stream->emit(stream->user, y, stream->out_row);
+        ++stream->next_out_y;
+        ++num_emitted;
+    }
+
+    // The last input row completes the frame, start over with the next one.
+    if (++stream->next_in_y == ctx->in_height) {
+        stream->next_in_y = 0;
+        stream->next_out_y = 0;
+        stream->out_row_src = -1;
+    }
+    return num_emitted;
+}
+
+void pixel_aa_stream_destroy(PixelAAStream* stream) {
+    if (!stream) {
+        return;
+    }
+    free(stream->rows[0]);
+    free(stream->rows[1]);
+    free(stream->out_row);
+    free(stream);
+}
@@ -29,16 +29,19 @@ char* remove_extension(const char* filename) {
     return strdup(filename);
 }
 
-char* get_output_path(const char* directory, const char* output_file_name) {
+char* get_output_path(const char* directory, const char* output_file_name,
+                      const char* extension) {
     size_t directory_length = strlen(directory);
     size_t filename_length = strlen(output_file_name);
-    const char* output_suffix = "_output.png";
-    char* output_path = (char*)malloc(
-        (directory_length + 1 + filename_length + strlen(output_suffix)) *
-        sizeof(char));
+    const char* output_suffix = "_output.";
+    char* output_path =
+        (char*)malloc((directory_length + 1 + filename_length +
+                       strlen(output_suffix) + strlen(extension) + 1) *
+                      sizeof(char));
     strcpy(output_path, directory);
     strcat(output_path, "/");
     strcat(output_path, output_file_name);
     strcat(output_path, output_suffix);
+    strcat(output_path, extension);
     return output_path;
 }
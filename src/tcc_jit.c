@@ -1,9 +1,13 @@
-#include <math.h>
-#include <stdarg.h>
+#include <assert.h>
+#include <dlfcn.h>
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 // clang-format off
 #define STB_IMAGE_IMPLEMENTATION
@@ -14,161 +18,161 @@
 
 #include <libtcc.h>
 
+#include "pixel_aa.h"
 #include "string_manip.h"
+#ifdef USE_LLVM_JIT
+#include "llvm_jit.h"
+#endif
 
-/*
-void kernel_static(uint32_t* restrict in, uint32_t* restrict out, int in_width,
-                   int in_height, int out_width, int out_height) {
-    for (int y = 0; y < out_height; ++y) {
-        const int out_y_offset = y * out_width;
-        const int in_y = y * (float)in_height / out_height;
-        const int in_y_offset = in_y * in_width;
-        for (int x = 0; x < out_width; ++x) {
-            const int in_x = x * (float)in_width / out_width;
-            out[out_y_offset + x] = in[in_y_offset + in_x];
-        }
-    }
+void handle_tcc_error(void* opaque, const char* msg) {
+    fprintf((FILE*)opaque, "%s\n", msg);
 }
-*/
 
-static inline void fill_row(const uint32_t* restrict in,
-                            uint32_t* restrict out) {
-    int x = 127;
-    do {
-        out[0] = in[0];
-        out[1] = in[0];
-        out[2] = in[0];
-        out[3] = in[1];
-        out[4] = in[1];
-        out += 5;
-        in += 2;
-    } while (x--);
+// Creates a TCC state for `output_type`. Paths for TCC are taken from the
+// -B, -I and -L arguments.
+TCCState* new_tcc_state(int argc, char* argv[], int output_type) {
+    TCCState* tcc = tcc_new();
+    if (!tcc) {
+        printf("Failed to create TCC instance!\n");
+        return NULL;
+    }
+    tcc_set_error_func(tcc, stderr, handle_tcc_error);
+    assert(tcc_get_error_func(tcc) == handle_tcc_error);
+    assert(tcc_get_error_opaque(tcc) == stderr);
+    // Help TCC figure out where stuff is.
+    // On a desktop system, in this configuration, we need at least:
+    // -B./lib_tcc/x86_64 -L./lib_tcc/x86_64
+    // On the MM, we need additionally to add -I and -L for libc and related
+    // files.
+    for (int i = 1; i < argc; ++i) {
+        char* a = argv[i];
+        if (a[0] == '-') {
+            if (a[1] == 'B')
+                tcc_set_lib_path(tcc, a + 2);
+            else if (a[1] == 'I')
+                tcc_add_include_path(tcc, a + 2);
+            else if (a[1] == 'L')
+                tcc_add_library_path(tcc, a + 2);
+        }
+    }
+    tcc_set_output_type(tcc, output_type);
+    return tcc;
 }
 
-void kernel_static(const uint32_t* restrict in_ptr,
-                   uint32_t* restrict out_ptr) {
-    const uint32_t* restrict in = in_ptr;
-    uint32_t* restrict out = out_ptr;
-    for (int y = 32; y > 0; --y) {
-        fill_row(in, out);
-        out += 640;
-        fill_row(in, out);
-        out += 640;
-        fill_row(in, out);
-        out += 640;
-        in += 256;
-        fill_row(in, out);
-        out += 640;
-        fill_row(in, out);
-        out += 640;
-        in += 256;
-        fill_row(in, out);
-        out += 640;
-        fill_row(in, out);
-        out += 640;
-        in += 256;
-        fill_row(in, out);
-        out += 640;
-        fill_row(in, out);
-        out += 640;
-        in += 256;
-        fill_row(in, out);
-        out += 640;
-        fill_row(in, out);
-        out += 640;
-        in += 256;
-        fill_row(in, out);
-        out += 640;
-        fill_row(in, out);
-        out += 640;
-        in += 256;
-        fill_row(in, out);
-        out += 640;
-        fill_row(in, out);
-        out += 640;
-        in += 256;
+// Compiles `source` into memory and looks up `name` in it. Returns NULL on
+// failure, otherwise the TCC state owning the code, to be deleted after the
+// last call.
+TCCState* compile_kernel(const char* source, const char* name, int argc,
+                         char* argv[], pixel_aa_kernel_fn* kernel) {
+    TCCState* tcc = new_tcc_state(argc, argv, TCC_OUTPUT_MEMORY);
+    if (!tcc) {
+        return NULL;
+    }
+    if (tcc_compile_string(tcc, source) != 0) {
+        printf("Failed to compile!\n");
+        tcc_delete(tcc);
+        return NULL;
+    }
+    if (tcc_relocate(tcc, TCC_RELOCATE_AUTO) != 0) {
+        printf("Failed to relocate!\n");
+        tcc_delete(tcc);
+        return NULL;
+    }
+    *kernel = (pixel_aa_kernel_fn)tcc_get_symbol(tcc, name);
+    if (!*kernel) {
+        printf("Failed to retrieve kernel function pointer!\n");
+        tcc_delete(tcc);
+        return NULL;
     }
+    return tcc;
 }
 
-// Used for finding "cycle length" of repeating pixel offsets
-// Between input and output.
-int gcd(int a, int b) {
-    if (b > a) {
-        int temp = a;
-        a = b;
-        b = temp;
+// Compiles `source` into a shared object at `path`. The object is written
+// under a temporary name first and renamed, so concurrent runs never load a
+// partially written file. Returns 0 on success.
+int compile_kernel_to_file(const char* source, const char* path, int argc,
+                           char* argv[]) {
+    TCCState* tcc = new_tcc_state(argc, argv, TCC_OUTPUT_DLL);
+    if (!tcc) {
+        return -1;
     }
-
-    while (b != 0) {
-        int remainder = a % b;
-        a = b;
-        b = remainder;
+    char* tmp_path = (char*)malloc(strlen(path) + 32);
+    sprintf(tmp_path, "%s.%d.tmp", path, (int)getpid());
+    int result = -1;
+    if (tcc_compile_string(tcc, source) != 0) {
+        printf("Failed to compile!\n");
+    } else if (tcc_output_file(tcc, tmp_path) != 0) {
+        printf("Failed to write %s!\n", tmp_path);
+    } else if (rename(tmp_path, path) != 0) {
+        printf("Failed to move kernel to %s!\n", path);
+        remove(tmp_path);
+    } else {
+        result = 0;
     }
-
-    return a;
+    tcc_delete(tcc);
+    free(tmp_path);
+    return result;
 }
 
-typedef struct {
-    char* str;
-    int allocated_size;
-    int used_size;
-} DynamicString;
-
-// Function to initialize the string
-void init(DynamicString* str) {
-    str->allocated_size = 2;
-    str->used_size = 0;
-    str->str = malloc(str->allocated_size * sizeof(char));
-    str->str[0] = '\0';
+// Loads `name` from a compiled kernel at `path`. Returns NULL if there is no
+// usable kernel, otherwise the handle owning the code, to be closed after the
+// last call.
+void* load_kernel(const char* path, const char* name,
+                  pixel_aa_kernel_fn* kernel) {
+    void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        return NULL;
+    }
+    *kernel = (pixel_aa_kernel_fn)dlsym(handle, name);
+    if (!*kernel) {
+        dlclose(handle);
+        return NULL;
+    }
+    return handle;
 }
 
-// Function to add a const char* to the string
-void add_string(DynamicString* str, const char* new_str) {
-    int new_str_len = strlen(new_str);
-
-    // Check if more memory is needed
-    if (str->used_size + new_str_len >= str->allocated_size) {
-        while (str->used_size + new_str_len >= str->allocated_size)
-            str->allocated_size *= 2;
-
-        // Reallocate memory with the new size
-        str->str = realloc(str->str, str->allocated_size * sizeof(char));
+// Creates `path` and its parents if they don't exist. Returns 0 on success.
+int make_dirs(const char* path) {
+    char* dir = strdup(path);
+    int result = 0;
+    for (char* p = dir + 1; result == 0; ++p) {
+        if (*p != '/' && *p != '\0') {
+            continue;
+        }
+        const char c = *p;
+        *p = '\0';
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+            result = -1;
+        }
+        *p = c;
+        if (c == '\0') {
+            break;
+        }
     }
-
-    // Add the new string to the dynamic string
-    strcat(str->str, new_str);
-    str->used_size += new_str_len;
+    free(dir);
+    return result;
 }
 
-void add_fmt_string(DynamicString* str, const char* fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-
-    // Determine the size required for formatting
-    int needed_size = vsnprintf(NULL, 0, fmt, args);
-    va_end(args);
-
-    // Check if more memory is needed
-    if (str->used_size + needed_size >= str->allocated_size) {
-        while (str->used_size + needed_size >= str->allocated_size)
-            str->allocated_size *= 2;
+// Measures the average time of one frame in ms. If `kernel` is NULL, the
+// generic pixel_aa_scale() is measured.
+float measure(PixelAAContext* ctx, pixel_aa_kernel_fn kernel,
+              const uint32_t* in, uint32_t* out) {
+    struct timespec start, end;
+    const int num_perf_passes = 1000;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-        // Reallocate memory with the new size
-        str->str = realloc(str->str, str->allocated_size * sizeof(char));
+    for (int perf_pass = 0; perf_pass < num_perf_passes; ++perf_pass) {
+        if (kernel) {
+            kernel(in, out);
+        } else {
+            pixel_aa_scale(ctx, in, out);
+        }
     }
 
-    va_start(args, fmt);
-    vsprintf(str->str + str->used_size, fmt, args);
-    va_end(args);
-
-    str->used_size += needed_size;
-}
-
-// Function to destroy the string and free the memory
-void destroy(DynamicString* str) { free(str->str); }
-
-void handle_tcc_error(void* opaque, const char* msg) {
-    fprintf((FILE*)opaque, "%s\n", msg);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    int duration_ms = (end.tv_sec - start.tv_sec) * 1000 +
+                      (end.tv_nsec - start.tv_nsec) / 1000000;
+    return (float)duration_ms / num_perf_passes;
 }
 
 int main(int argc, char* argv[]) {
@@ -176,11 +180,52 @@ int main(int argc, char* argv[]) {
     struct timespec start, end;
 
     if (argc < 4) {
-        printf("Usage: %s <input_path> <target_width> <target_height>\n",
-               argv[0]);
+        printf(
+            "Usage: %s <input_path> <target_width> <target_height> "
+            "[-B<tcc_lib_path>] [-I<include_path>] [-L<library_path>] "
+            "[-C<cache_dir>] [-J<tcc|llvm>]\n"
+            "Compiled kernels are cached in <cache_dir>, by default "
+            "$HOME/.cache/pixel_aa. -C without a path disables the cache.\n"
+            "-J selects the JIT backend: tcc (default) compiles fast, llvm "
+            "generates faster code.\n",
+            argv[0]);
         return 1;
     }
 
+    // JIT backend
+    int use_llvm = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] == '-' && argv[i][1] == 'J') {
+            if (strcmp(argv[i] + 2, "llvm") == 0) {
+                use_llvm = 1;
+            } else if (strcmp(argv[i] + 2, "tcc") == 0) {
+                use_llvm = 0;
+            } else {
+                printf("Unknown JIT backend: %s\n", argv[i] + 2);
+                return 1;
+            }
+        }
+    }
+#ifndef USE_LLVM_JIT
+    if (use_llvm) {
+        printf("Built without LLVM, configure with USE_LLVM_JIT=ON.\n");
+        return 1;
+    }
+#endif
+
+    // Directory for compiled kernels
+    char* cache_dir = NULL;
+    if (getenv("HOME")) {
+        cache_dir = (char*)malloc(strlen(getenv("HOME")) + 32);
+        sprintf(cache_dir, "%s/.cache/pixel_aa", getenv("HOME"));
+    }
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] == '-' && argv[i][1] == 'C') {
+            free(cache_dir);
+            cache_dir = argv[i][2] != '\0' ? strdup(argv[i] + 2) : NULL;
+        }
+    }
+
     const char* input_path = argv[1];
     int in_width, in_height, channels;
     unsigned char* in_img_data =
@@ -210,237 +255,124 @@ int main(int argc, char* argv[]) {
         stbi_image_free(in_img_data);
         return 1;
     }
-    const int output_size = out_width * out_height * channels;
+    const size_t output_size = (size_t)out_width * out_height * channels;
     unsigned char* out_img_data =
         (unsigned char*)malloc(output_size * sizeof(unsigned char));
     uint32_t* out = (uint32_t*)out_img_data;
 
-    // JIT the image kernel
-    TCCState* tcc = tcc_new();
-    if (!tcc) {
-        printf("Failed to create TCC instance!\n");
+    PixelAAContext* ctx =
+        pixel_aa_create(in_width, in_height, out_width, out_height);
+    if (!ctx) {
+        printf("Failed to create scaling context.\n");
+        free(out_img_data);
+        stbi_image_free(in_img_data);
         return 1;
     }
-    tcc_set_error_func(tcc, stderr, handle_tcc_error);
-    assert(tcc_get_error_func(tcc) == handle_tcc_error);
-    assert(tcc_get_error_opaque(tcc) == stderr);
-    // Help TCC figure out where stuff is.
-    // On a desktop system, in this configuration, we need at least:
-    // -B./lib_tcc/x86_64 -L./lib_tcc/x86_64
-    // On the MM, we need additionally to add -I and -L for libc and related
-    // files.
-    for (int i = 1; i < argc; ++i) {
-        char* a = argv[i];
-        if (a[0] == '-') {
-            if (a[1] == 'B')
-                tcc_set_lib_path(tcc, a + 2);
-            else if (a[1] == 'I')
-                tcc_add_include_path(tcc, a + 2);
-            else if (a[1] == 'L')
-                tcc_add_library_path(tcc, a + 2);
-        }
-    }
-    tcc_set_output_type(tcc, TCC_OUTPUT_MEMORY);
 
-    // Kernel that we're jitting:
-    // clang-format off
-    /*
-    #include <stdint.h>
-    void kernel(const uint32_t* restrict in, uint32_t* restrict out) {
-        for (int y = 0, out_y_offset = 0, in_y_offset = 0; y < %d; ++y) {
-            for (int y = 0, out_y_offset = 0, in_y_offset = 0; y < out_height / y_cycle_len; ++y) {
-        for (int x = 0, in_x = 0; x < out_width; x += x_cycle len, in_x += x_in_advance) {
-            out[out_y_offset + number] = in[in_y_offset + number];
-            out[out_y_offset + number] = in[in_y_offset + number];
-            out[out_y_offset + number] = in[in_y_offset + number];
-            // Complete up to cycle_length statements
-        }
-        out_y_offset += <number>;
-        in_y_offset += <number>;
-        // Repeat this inner block <y cycle length> times.
+    // Compiled kernels are cached per configuration, see
+    // pixel_aa_kernel_key().
+    char* cache_path = NULL;
+    if (cache_dir) {
+        char key[128];
+        pixel_aa_kernel_key(ctx, key, sizeof(key));
+        cache_path = (char*)malloc(strlen(cache_dir) + strlen(key) + 8);
+        sprintf(cache_path, "%s/%s.so", cache_dir, key);
     }
-    */
-    // clang-format on
 
-    const int x_cycle_length = out_width / gcd(out_width, in_width);
-    const int x_in_advance = in_width / gcd(out_width, in_width);
-    const int y_cycle_length = out_height / gcd(out_height, in_height);
-    // const int y_in_advance = in_height / gcd(out_height, in_height);
-
-#if 1
-    const char* source =
-        "#include <stdint.h>\n"
-        "static inline void fill_row(const uint32_t* restrict in,\n"
-        "                            uint32_t* restrict out) {\n"
-        "    int x = 128;\n"
-        "    do {\n"
-        "        __asm__ __volatile__(\n"
-        "            \"ldr r2, %[in]       \\n\\t\"\n"
-        "            \"ldr r1, %[in], #4   \\n\\t\"\n"
-        "\n"
-        "            \"str r2, %[out]      \\n\\t\"\n"
-        "            \"str r2, %[out], #4  \\n\\t\"\n"
-        "            \"str r2, %[out], #8  \\n\\t\"\n"
-        "            \"str r1, %[out], #12 \\n\\t\"\n"
-        "\n"
-        "            :\n"
-        "            : [ in ] \"r\"(in), [ out ] \"r\"(out)\n"
-        "            : \"r1\", \"r2\");\n"
-        "        in += 2;\n"
-        "        out += 5;\n"
-        "    } while (--x);\n"
-        "}\n"
-        "void kernel(const uint32_t* restrict in_ptr, uint32_t* restrict "
-        "out_ptr) {\n"
-        "    const uint32_t* restrict in = in_ptr;\n"
-        "    uint32_t* restrict out = out_ptr;\n"
-        "    for (int y = 32; y > 0; --y) {\n"
-        "        fill_row(in, out);\n"
-        "        out += 640;\n"
-        "        fill_row(in, out);\n"
-        "        out += 640;\n"
-        "        fill_row(in, out);\n"
-        "        out += 640;\n"
-        "        in += 256;\n"
-        "        fill_row(in, out);\n"
-        "        out += 640;\n"
-        "        fill_row(in, out);\n"
-        "        out += 640;\n"
-        "        in += 256;\n"
-        "        fill_row(in, out);\n"
-        "        out += 640;\n"
-        "        fill_row(in, out);\n"
-        "        out += 640;\n"
-        "        in += 256;\n"
-        "        fill_row(in, out);\n"
-        "        out += 640;\n"
-        "        fill_row(in, out);\n"
-        "        out += 640;\n"
-        "        in += 256;\n"
-        "        fill_row(in, out);\n"
-        "        out += 640;\n"
-        "        fill_row(in, out);\n"
-        "        out += 640;\n"
-        "        in += 256;\n"
-        "        fill_row(in, out);\n"
-        "        out += 640;\n"
-        "        fill_row(in, out);\n"
-        "        out += 640;\n"
-        "        in += 256;\n"
-        "        fill_row(in, out);\n"
-        "        out += 640;\n"
-        "        fill_row(in, out);\n"
-        "        out += 640;\n"
-        "        in += 256;\n"
-        "    }\n"
-        "}\n";
-#endif
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-    // Build the kernel source as string by emitting C source code.
-#if 0
-    DynamicString source_code;
-    init(&source_code);
-    add_fmt_string(
-        &source_code,
-        "#include <stdint.h>\n"
-        "void kernel(const uint32_t* restrict in, uint32_t* restrict out) {\n"
-        "\tfor (int y = 0, out_y_offset = 0, in_y_offset = 0; y < %d; ++y) {\n",
-        out_height / y_cycle_length);
-    // Emit y_cycle_length blocks of for loops over x
-    int last_emitted_in_i = 0;
-    for (int i = 0; i < y_cycle_length; ++i) {
-        add_fmt_string(
-            &source_code,
-            "\t\tfor (int x = 0, in_x = 0; x < %d; x += %d, in_x += %d) {\n",
-            out_width, x_cycle_length, x_in_advance);
-        // Emit x_cycle_length copy operations
-        for (int j = 0; j < x_cycle_length; ++j) {
-            int in_j = j * (float)in_width / out_width;
-            add_fmt_string(&source_code,
-                           "\t\t\tout[out_y_offset + x + %d] = in[in_y_offset "
-                           "+ in_x + %d];\n",
-                           j, in_j);
+    pixel_aa_kernel_fn kernel;
+    TCCState* tcc = NULL;
+    void* kernel_handle = NULL;
+#ifdef USE_LLVM_JIT
+    LlvmJitKernel* llvm_kernel = NULL;
+    if (use_llvm) {
+        // LLVM takes the kernel as IR, optimizes it at O3 and vectorizes it
+        // for the host. Its code is not cached.
+        printf("LLVM JIT compilation started...\n");
+        char* ir = pixel_aa_generate_kernel_ir(ctx, "kernel");
+        if (ir) {
+            llvm_kernel = llvm_jit_compile(ir, "kernel", &kernel);
+            free(ir);
         }
-        add_string(&source_code, "\t\t}\n");
-        add_fmt_string(&source_code, "\t\tout_y_offset += %d;\n", out_width);
-        int in_i = (i + 1) * (float)in_height / out_height;
-        if (in_i > last_emitted_in_i || i == y_cycle_length - 1) {
-            last_emitted_in_i = in_i;
-            add_fmt_string(&source_code, "\t\tin_y_offset += %d;\n", in_width);
+        if (!llvm_kernel) {
+            printf("Failed to compile kernel with LLVM!\n");
+            free(cache_path);
+            free(cache_dir);
+            pixel_aa_destroy(ctx);
+            free(out_img_data);
+            stbi_image_free(in_img_data);
+            return 1;
         }
     }
-    add_string(&source_code,
-               "\t}\n"
-               "}\n");
-    printf("%s", source_code.str);
 #endif
-
-    printf("JIT compilation started...\n");
-    clock_gettime(CLOCK_MONOTONIC, &start);
-
-    if (tcc_compile_string(tcc, source) != 0) {
-        printf("Failed to compile!\n");
-        tcc_delete(tcc);
-        return 1;
-    }
-    // destroy(&source_code);
-    if (tcc_add_library(tcc, "m") != 0) {
-        printf("Failed to add library!\n");
-        tcc_delete(tcc);
-        return 1;
-    }
-    if (tcc_relocate(tcc, TCC_RELOCATE_AUTO) != 0) {
-        printf("Failed to relocate!\n");
-        tcc_delete(tcc);
-        return 1;
+    if (!use_llvm && cache_path) {
+        kernel_handle = load_kernel(cache_path, "kernel", &kernel);
     }
-    void (*kernel)(const uint32_t* restrict, uint32_t* restrict);
-    kernel = tcc_get_symbol(tcc, "kernel");
-    if (!kernel) {
-        printf("Failed to retrieve kernel function pointer!\n");
-        tcc_delete(tcc);
-        return 1;
+    if (kernel_handle) {
+        printf("Loaded cached kernel %s\n", cache_path);
+    } else if (!use_llvm) {
+        // Generate a kernel with all offsets and weights for this size baked
+        // in.
+        printf("JIT compilation started...\n");
+        char* source = pixel_aa_generate_kernel(ctx, "kernel");
+        if (!source) {
+            printf("Failed to generate kernel source!\n");
+            free(cache_path);
+            free(cache_dir);
+            pixel_aa_destroy(ctx);
+            free(out_img_data);
+            stbi_image_free(in_img_data);
+            return 1;
+        }
+        // Compile into the cache and load from there. If that's not
+        // possible, compile into memory instead.
+        if (cache_path && make_dirs(cache_dir) == 0 &&
+            compile_kernel_to_file(source, cache_path, argc, argv) == 0) {
+            kernel_handle = load_kernel(cache_path, "kernel", &kernel);
+            if (kernel_handle) {
+                printf("Cached kernel %s\n", cache_path);
+            }
+        }
+        if (!kernel_handle) {
+            tcc = compile_kernel(source, "kernel", argc, argv, &kernel);
+        }
+        free(source);
+        if (!kernel_handle && !tcc) {
+            free(cache_path);
+            free(cache_dir);
+            pixel_aa_destroy(ctx);
+            free(out_img_data);
+            stbi_image_free(in_img_data);
+            return 1;
+        }
     }
+    free(cache_path);
+    free(cache_dir);
 
     clock_gettime(CLOCK_MONOTONIC, &end);
     int duration_ms = (end.tv_sec - start.tv_sec) * 1000 +
                       (end.tv_nsec - start.tv_nsec) / 1000000;
-    printf("JIT compilation finished. Time elapsed: %d ms\n", duration_ms);
-
-    // Measure performance
-
-    const int num_perf_passes = 1000;
-    clock_gettime(CLOCK_MONOTONIC, &start);
-
-    // Measure the JITted kernel
-    for (int perf_pass = 0; perf_pass < num_perf_passes; ++perf_pass) {
+    printf("Kernel ready. Time elapsed: %d ms\n", duration_ms);
+
+    // Measure performance, and use whichever kernel is faster.
+    const float jit_ms = measure(ctx, kernel, in, out);
+    printf("JIT kernel: %f ms per pass.\n", jit_ms);
+    const float generic_ms = measure(ctx, NULL, in, out);
+    printf("Generic kernel: %f ms per pass.\n", generic_ms);
+    if (jit_ms < generic_ms) {
+        printf("Using the JIT kernel.\n");
         kernel(in, out);
+    } else {
+        printf("Using the generic kernel.\n");
+        pixel_aa_scale(ctx, in, out);
     }
 
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    duration_ms = (end.tv_sec - start.tv_sec) * 1000 +
-                  (end.tv_nsec - start.tv_nsec) / 1000000;
-    printf("Time for %d passes: %d ms, that is %f ms per pass.\n",
-           num_perf_passes, duration_ms, (float)duration_ms / num_perf_passes);
-
-#if 1
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    // Measure the static kernel
-    for (int perf_pass = 0; perf_pass < num_perf_passes; ++perf_pass) {
-        kernel_static(in, out /*, in_width, in_height, out_width, out_height*/);
-    }
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    duration_ms = (end.tv_sec - start.tv_sec) * 1000 +
-                  (end.tv_nsec - start.tv_nsec) / 1000000;
-    printf("Time to beat: %d ms, that is %f ms per pass.\n", duration_ms,
-           (float)duration_ms / num_perf_passes);
-#endif
-
     // Save the resulting image
     char* directory = get_parent_path(input_path);
     char* file_name = get_filename(input_path);
     char* output_file_name = remove_extension(file_name);
-    char* output_path = get_output_path(directory, output_file_name);
+    char* output_path = get_output_path(directory, output_file_name, "png");
     printf("Saving output image to path: %s\n", output_path);
 
     if (stbi_write_png(output_path, out_width, out_height, channels,
@@ -450,7 +382,16 @@ int main(int argc, char* argv[]) {
         free(file_name);
         free(output_file_name);
         free(output_path);
-        tcc_delete(tcc);
+        if (tcc) {
+            tcc_delete(tcc);
+        }
+        if (kernel_handle) {
+            dlclose(kernel_handle);
+        }
+#ifdef USE_LLVM_JIT
+        llvm_jit_destroy(llvm_kernel);
+#endif
+        pixel_aa_destroy(ctx);
         free(out_img_data);
         stbi_image_free(in_img_data);
         return 1;
@@ -462,7 +403,16 @@ int main(int argc, char* argv[]) {
     free(file_name);
     free(output_file_name);
     free(output_path);
-    tcc_delete(tcc);
+    if (tcc) {
+        tcc_delete(tcc);
+    }
+    if (kernel_handle) {
+        dlclose(kernel_handle);
+    }
+#ifdef USE_LLVM_JIT
+    llvm_jit_destroy(llvm_kernel);
+#endif
+    pixel_aa_destroy(ctx);
     free(out_img_data);
     stbi_image_free(in_img_data);
 
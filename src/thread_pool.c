@@ -0,0 +1,237 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "thread_pool.h"
+
+#ifdef USE_THREADS
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Polls of the job counter before a worker sleeps, roughly 50 - 100 us.
+#define SPIN_COUNT 20000
+
+typedef struct {
+    // Next task in the low 32 bits, end of the range in the high 32 bits.
+    // The owner takes tasks from the front, thieves from the back.
+    _Atomic uint64_t range;
+    // Keep the queues of different threads on different cache lines.
+    char padding[64 - sizeof(uint64_t)];
+} TaskQueue;
+
+typedef struct {
+    ThreadPool* pool;
+    int thread_num;
+} Worker;
+
+struct ThreadPool {
+    int num_threads;
+    TaskQueue* queues;
+    pthread_t* threads;
+    Worker* workers;
+    int num_started;
+    // Current job
+    thread_pool_task_fn fn;
+    void* arg;
+    // Incremented for every job. Guarded by mutex for sleeping workers.
+    atomic_uint generation;
+    // Workers that haven't finished the current job yet
+    atomic_int active;
+    atomic_int stop;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+};
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__arm__) || defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static inline uint64_t pack_range(uint32_t begin, uint32_t end) {
+    return (uint64_t)end << 32 | begin;
+}
+
+// Takes the next task from the front of the own queue. Returns -1 if empty.
+static int pop_task(TaskQueue* queue) {
+    uint64_t range = atomic_load(&queue->range);
+    for (;;) {
+        const uint32_t begin = (uint32_t)range;
+        const uint32_t end = (uint32_t)(range >> 32);
+        if (begin >= end) {
+            return -1;
+        }
+        if (atomic_compare_exchange_weak(&queue->range, &range,
+                                         pack_range(begin + 1, end))) {
+            return (int)begin;
+        }
+    }
+}
+
+// Takes the last task from the back of another thread's queue. Returns -1 if
+// empty.
+static int steal_task(TaskQueue* queue) {
+    uint64_t range = atomic_load(&queue->range);
+    for (;;) {
+        const uint32_t begin = (uint32_t)range;
+        const uint32_t end = (uint32_t)(range >> 32);
+        if (begin >= end) {
+            return -1;
+        }
+        if (atomic_compare_exchange_weak(&queue->range, &range,
+                                         pack_range(begin, end - 1))) {
+            return (int)(end - 1);
+        }
+    }
+}
+
+static void run_tasks(ThreadPool* pool, int thread_num) {
+    int task;
+    while ((task = pop_task(&pool->queues[thread_num])) >= 0) {
+        pool->fn(pool->arg, task, thread_num);
+    }
+    // Own range is done, help the others.
+    for (int i = 1; i < pool->num_threads; ++i) {
+        TaskQueue* victim =
+            &pool->queues[(thread_num + i) % pool->num_threads];
+        while ((task = steal_task(victim)) >= 0) {
+            pool->fn(pool->arg, task, thread_num);
+        }
+    }
+}
+
+static void* worker_main(void* arg) {
+    const Worker* worker = (const Worker*)arg;
+    ThreadPool* pool = worker->pool;
+    // Not the current value, the first job might already be posted.
+    unsigned seen = 0;
+    for (;;) {
+        for (int spin = 0;
+             spin < SPIN_COUNT && atomic_load(&pool->generation) == seen;
+             ++spin) {
+            cpu_relax();
+        }
+        if (atomic_load(&pool->generation) == seen) {
+            pthread_mutex_lock(&pool->mutex);
+            while (atomic_load(&pool->generation) == seen &&
+                   !atomic_load(&pool->stop)) {
+                pthread_cond_wait(&pool->wake, &pool->mutex);
+            }
+            pthread_mutex_unlock(&pool->mutex);
+        }
+        if (atomic_load(&pool->stop)) {
+            return NULL;
+        }
+        seen = atomic_load(&pool->generation);
+        run_tasks(pool, worker->thread_num);
+        atomic_fetch_sub(&pool->active, 1);
+    }
+}
+
+ThreadPool* thread_pool_create(int num_threads, const int* cpus) {
+    if (num_threads < 1) {
+        return NULL;
+    }
+    ThreadPool* pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->num_threads = num_threads;
+    atomic_init(&pool->generation, 0);
+    atomic_init(&pool->active, 0);
+    atomic_init(&pool->stop, 0);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    void* queues = NULL;
+    if (posix_memalign(&queues, 64, num_threads * sizeof(TaskQueue)) != 0) {
+        thread_pool_destroy(pool);
+        return NULL;
+    }
+    pool->queues = (TaskQueue*)queues;
+    for (int i = 0; i < num_threads; ++i) {
+        atomic_init(&pool->queues[i].range, 0);
+    }
+    pool->threads = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
+    pool->workers = (Worker*)malloc(num_threads * sizeof(Worker));
+    if (!pool->threads || !pool->workers) {
+        thread_pool_destroy(pool);
+        return NULL;
+    }
+
+    for (int i = 1; i < num_threads; ++i) {
+        pool->workers[i] = (Worker){pool, i};
+        if (pthread_create(&pool->threads[i], NULL, worker_main,
+                           &pool->workers[i]) != 0) {
+            thread_pool_destroy(pool);
+            return NULL;
+        }
+        pool->num_started = i;
+#ifdef __linux__
+        if (cpus) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[i - 1], &set);
+            pthread_setaffinity_np(pool->threads[i], sizeof(set), &set);
+        }
+#else   // !__linux__
+        (void)cpus;
+#endif  // __linux__
+    }
+    return pool;
+}
+
+void thread_pool_run(ThreadPool* pool, int num_tasks, thread_pool_task_fn fn,
+                     void* arg) {
+    const int num_threads = pool->num_threads;
+    if (num_threads == 1 || num_tasks <= 1) {
+        for (int task = 0; task < num_tasks; ++task) {
+            fn(arg, task, 0);
+        }
+        return;
+    }
+
+    pool->fn = fn;
+    pool->arg = arg;
+    for (int i = 0; i < num_threads; ++i) {
+        atomic_store(&pool->queues[i].range,
+                     pack_range((uint32_t)((int64_t)num_tasks * i /
+                                           num_threads),
+                                (uint32_t)((int64_t)num_tasks * (i + 1) /
+                                           num_threads)));
+    }
+    atomic_store(&pool->active, num_threads - 1);
+    pthread_mutex_lock(&pool->mutex);
+    atomic_fetch_add(&pool->generation, 1);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+
+    run_tasks(pool, 0);
+    while (atomic_load(&pool->active) > 0) {
+        cpu_relax();
+    }
+}
+
+void thread_pool_destroy(ThreadPool* pool) {
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    atomic_store(&pool->stop, 1);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+    for (int i = 1; i <= pool->num_started; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->wake);
+    free(pool->queues);
+    free(pool->threads);
+    free(pool->workers);
+    free(pool);
+}
+#endif  // USE_THREADS
@@ -0,0 +1,28 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Persistent pool of worker threads. A job is a number of independent tasks,
+// which are handed out in contiguous ranges, one per thread, to keep
+// neighbouring tasks on the same core. Threads that run out of tasks steal
+// from the end of the other ranges. The calling thread takes part in every
+// job as thread 0. Workers spin for a short while after a job before they
+// go to sleep, so that back to back jobs don't pay for a wake up.
+
+typedef struct ThreadPool ThreadPool;
+
+// Runs task `task` of a job on thread `thread_num`, in [0, num_threads).
+typedef void (*thread_pool_task_fn)(void* arg, int task, int thread_num);
+
+// Starts num_threads - 1 workers. If `cpus` is not NULL, worker i is pinned
+// to CPU cpus[i - 1]. The calling thread is never pinned. Returns NULL on
+// failure.
+ThreadPool* thread_pool_create(int num_threads, const int* cpus);
+
+// Runs tasks [0, num_tasks) and returns when all of them are done. Not
+// reentrant, jobs of one pool must not overlap.
+void thread_pool_run(ThreadPool* pool, int num_tasks, thread_pool_task_fn fn,
+                     void* arg);
+
+void thread_pool_destroy(ThreadPool* pool);
+
+#endif  // THREAD_POOL_H